@@ -1,5 +1,10 @@
 #version 330 core
 
+// Built in variants (see cgra::shader_variants and Asteroid::draw):
+//  USE_TEXTURE   colour from uTexture instead of uColor
+//  HEAT_LIGHT    a second, red light from uHeatLightDir
+//  QUALITY_TIER  see oren_nayar.glsl
+
 // uniform data
 uniform mat4 uProjectionMatrix;
 uniform mat4 uModelViewMatrix;
@@ -9,7 +14,6 @@ uniform float uRoughness;
 uniform float uE_0;
 uniform float uLightIntensity;
 uniform sampler2D uTexture;
-uniform bool uUseTexture;
 uniform vec3 uHeatLightDir;
 
 // viewspace data (this must match the output of the fragment shader)
@@ -17,120 +21,37 @@ in VertexData {
     vec3 position;
     vec3 normal;
     vec2 textureCoord;
+    float occlusion;
 } f_in;
 
 // framebuffer output
 out vec4 fb_color;
 
-// Noticed a common pattern in all the C_n functions
-float C_helper(float sigma, float x) {
-    return sigma * sigma / (sigma * sigma + x);
-}
+#include "oren_nayar.glsl"
 
 void main() {
-    // Following https://en.wikipedia.org/wiki/Oren%E2%80%93Nayar_reflectance_model
     // Constants
     const vec3 light_pos = vec3(0, 50, 100); // (world-space)
-    const float PI = 3.14159265359;
-
     const vec3 heat_light_color = vec3(1, 0.2, 0);
 
+#ifdef USE_TEXTURE
+    vec3 texture_color = texture(uTexture, f_in.textureCoord).rgb;
+#else
     vec3 texture_color = uColor;
+#endif
 
-    if (uUseTexture) {
-        texture_color = texture(uTexture, f_in.textureCoord).rgb;
-    }
-
-    fb_color = vec4(0.0, 0.0, 0.0, 1.0);
-
-    {
-        // Useful vectors for later
-        vec3 L = normalize((vec4(light_pos, 1)).xyz - f_in.position);
-        vec3 V = normalize(-f_in.position);
-        vec3 N = normalize(f_in.normal);
-
-        // Angles
-        float theta_i = acos(dot(L, N));
-        float theta_r = acos(dot(V, N));
-
-        // Azimuthal angles
-        vec3 T1 = normalize(cross(N, V));
-        vec3 T2 = cross(N, T1);
-        vec3 L_proj = normalize(L - dot(L, N) * N);
-        vec3 V_proj = normalize(V - dot(V, N) * N);
-        float phi_i = atan(dot(L_proj, T2), dot(L_proj, T1));
-        float phi_r = atan(dot(V_proj, T2), dot(V_proj, T1));
-
-        float alpha = max(theta_i, theta_r);
-        float beta = min(theta_i, theta_r);
-
-        float C_1 = 1 - 0.5 * C_helper(uRoughness, 0.33);
-        float C_2 = 0.45 * C_helper(uRoughness, 0.09);
-        if (cos(phi_i - phi_r) >= 0) {
-            C_2 *= sin(alpha);
-        } else {
-            C_2 *= sin(alpha) - pow((2 * beta) / PI, 3);
-        }
-        float C_3 = 0.125 * C_helper(uRoughness, 0.09) * pow(4 * alpha * beta / (PI * PI), 2);
-
-        vec3 L_1 = texture_color / PI * uE_0 * cos(theta_i) * (C_1 + C_2 * cos(phi_i - phi_r) * tan(beta) + C_3 * (1 - abs(cos(phi_i - phi_r)) * tan((alpha + beta) / 2)));
-
-        vec3 L_2 = 0.17 * texture_color * texture_color / PI * uE_0 * cos(theta_i) * C_helper(uRoughness, 0.13) * (1 - cos(phi_i - phi_r) * pow(2 * beta / PI, 2));
-
-        // Fixed weird artifacts
-        if (dot(N, L) <= 0) {
-            L_1 = vec3(0);
-        }
-
-        vec3 L_r = L_1 + L_2;
-
-        fb_color += vec4(L_r, 0);
-    }
-
-    if (dot(uHeatLightDir, uHeatLightDir) > 0.1)
-    {
-        // Useful vectors for later
-        vec3 L = normalize(vec3(uViewMatrix * vec4(normalize(uHeatLightDir), 0)));
-        vec3 V = normalize(-f_in.position);
-        vec3 N = normalize(f_in.normal);
-
-        // Angles
-        float theta_i = acos(dot(L, N));
-        float theta_r = acos(dot(V, N));
-
-        // Azimuthal angles
-        vec3 T1 = normalize(cross(N, V));
-        vec3 T2 = cross(N, T1);
-        vec3 L_proj = normalize(L - dot(L, N) * N);
-        vec3 V_proj = normalize(V - dot(V, N) * N);
-        float phi_i = atan(dot(L_proj, T2), dot(L_proj, T1));
-        float phi_r = atan(dot(V_proj, T2), dot(V_proj, T1));
-
-        float alpha = max(theta_i, theta_r);
-        float beta = min(theta_i, theta_r);
-
-        float C_1 = 1 - 0.5 * C_helper(uRoughness, 0.33);
-        float C_2 = 0.45 * C_helper(uRoughness, 0.09);
-        if (cos(phi_i - phi_r) >= 0) {
-            C_2 *= sin(alpha);
-        } else {
-            C_2 *= sin(alpha) - pow((2 * beta) / PI, 3);
-        }
-        float C_3 = 0.125 * C_helper(uRoughness, 0.09) * pow(4 * alpha * beta / (PI * PI), 2);
-
-        vec3 L_1 = texture_color / PI * uE_0 * cos(theta_i) * (C_1 + C_2 * cos(phi_i - phi_r) * tan(beta) + C_3 * (1 - abs(cos(phi_i - phi_r)) * tan((alpha + beta) / 2)));
-
-        vec3 L_2 = 0.17 * texture_color * texture_color / PI * uE_0 * cos(theta_i) * C_helper(uRoughness, 0.13) * (1 - cos(phi_i - phi_r) * pow(2 * beta / PI, 2));
-
-        // Fixed weird artifacts
-        if (dot(N, L) <= 0) {
-            L_1 = vec3(0);
-        }
+    // Useful vectors for later
+    vec3 V = normalize(-f_in.position);
+    vec3 N = normalize(f_in.normal);
 
-        vec3 L_r = L_1 + L_2;
+    vec3 L = normalize((vec4(light_pos, 1)).xyz - f_in.position);
+    fb_color = vec4(oren_nayar(L, V, N, texture_color, uRoughness, uE_0), 1.0);
 
-        L_r *= heat_light_color;
+#ifdef HEAT_LIGHT
+    vec3 L_heat = normalize(vec3(uViewMatrix * vec4(normalize(uHeatLightDir), 0)));
+    fb_color.rgb += heat_light_color * oren_nayar(L_heat, V, N, texture_color, uRoughness, uE_0);
+#endif
 
-        fb_color += vec4(L_r, 0);
-    }
+    // Baked per-vertex ambient occlusion darkens the crevices
+    fb_color.rgb *= f_in.occlusion;
 }
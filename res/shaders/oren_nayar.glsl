@@ -0,0 +1,90 @@
+// Oren-Nayar diffuse reflectance, following
+// https://en.wikipedia.org/wiki/Oren%E2%80%93Nayar_reflectance_model
+// QUALITY_TIER picks how it's evaluated:
+//  0  the full model, interreflection (L_2) included, as the reference
+//  1  the qualitative model in Fujii's form, no trigonometry, no L_2
+//  2  the full model with its angular terms fetched from uBrdfLut (an
+//     OrenNayarLut) instead of computed
+
+#ifndef QUALITY_TIER
+#define QUALITY_TIER 0
+#endif
+
+#if QUALITY_TIER == 2
+uniform sampler2D uBrdfLut;
+#endif
+
+// Noticed a common pattern in all the C_n functions
+float C_helper(float sigma, float x) {
+    return sigma * sigma / (sigma * sigma + x);
+}
+
+// Radiance towards V from a light in direction L with irradiance E_0, for a
+// surface with normal N (all unit length, in the same space).
+vec3 oren_nayar(vec3 L, vec3 V, vec3 N, vec3 albedo, float roughness, float E_0) {
+    const float PI = 3.14159265359;
+
+    float C_1 = 1 - 0.5 * C_helper(roughness, 0.33);
+
+#if QUALITY_TIER == 1
+    // cos(phi_i - phi_r) sin(alpha) tan(beta) is s / max(N.L, N.V), and the
+    // qualitative model only keeps it where it's positive
+    float NL = dot(N, L);
+    if (NL <= 0) return vec3(0);
+    float s = dot(L, V) - NL * dot(N, V);
+    float st = s > 0 ? s / max(NL, dot(N, V)) : 0.0;
+    return albedo / PI * E_0 * NL * (C_1 + 0.45 * C_helper(roughness, 0.09) * st);
+
+#elif QUALITY_TIER == 2
+    float NL = dot(N, L);
+    if (NL <= 0) return vec3(0);
+    float NV = clamp(dot(N, V), 0.0, 1.0);
+
+    // texel centres, the table's first and last texels are at 0 and 1
+    float n = float(textureSize(uBrdfLut, 0).x);
+    vec4 t = texture(uBrdfLut, (vec2(NL, NV) * (n - 1) + 0.5) / n);
+
+    // cos(phi_i - phi_r), between L and V projected onto the surface
+    float cos_phi = (dot(L, V) - NL * NV) / sqrt(max((1 - NL * NL) * (1 - NV * NV), 1e-8));
+
+    float C_2 = 0.45 * C_helper(roughness, 0.09) * (cos_phi >= 0 ? t.r : t.g);
+    float C_3 = 0.125 * C_helper(roughness, 0.09) * t.b;
+    vec3 L_1 = albedo / PI * E_0 * (C_1 * NL + C_2 * cos_phi + C_3 * (1 - abs(cos_phi)));
+    vec3 L_2 = 0.17 * albedo * albedo / PI * E_0 * C_helper(roughness, 0.13) * (NL - cos_phi * t.a);
+    return L_1 + L_2;
+
+#else
+    // Angles
+    float theta_i = acos(dot(L, N));
+    float theta_r = acos(dot(V, N));
+
+    // Azimuthal angles
+    vec3 T1 = normalize(cross(N, V));
+    vec3 T2 = cross(N, T1);
+    vec3 L_proj = normalize(L - dot(L, N) * N);
+    vec3 V_proj = normalize(V - dot(V, N) * N);
+    float phi_i = atan(dot(L_proj, T2), dot(L_proj, T1));
+    float phi_r = atan(dot(V_proj, T2), dot(V_proj, T1));
+
+    float alpha = max(theta_i, theta_r);
+    float beta = min(theta_i, theta_r);
+
+    float C_2 = 0.45 * C_helper(roughness, 0.09);
+    if (cos(phi_i - phi_r) >= 0) {
+        C_2 *= sin(alpha);
+    } else {
+        C_2 *= sin(alpha) - pow((2 * beta) / PI, 3);
+    }
+    float C_3 = 0.125 * C_helper(roughness, 0.09) * pow(4 * alpha * beta / (PI * PI), 2);
+
+    vec3 L_1 = albedo / PI * E_0 * cos(theta_i) * (C_1 + C_2 * cos(phi_i - phi_r) * tan(beta) + C_3 * (1 - abs(cos(phi_i - phi_r))) * tan((alpha + beta) / 2));
+
+    // Fixed weird artifacts
+    if (dot(N, L) <= 0) {
+        L_1 = vec3(0);
+    }
+
+    vec3 L_2 = 0.17 * albedo * albedo / PI * E_0 * cos(theta_i) * C_helper(roughness, 0.13) * (1 - cos(phi_i - phi_r) * pow(2 * beta / PI, 2));
+    return L_1 + L_2;
+#endif
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+uniform sampler2D uText;
+
+in VertexData{
+    vec4 color; // and alpha
+    vec2 textCord;
+} f_in;
+
+// framebuffer output
+out vec4 fb_color;
+
+void main() {
+	float alpha = texture(uText, f_in.textCord).a * f_in.color.a;
+
+	vec4 color = vec4(f_in.color.rgb, alpha);
+	if(color == vec4(0,0,0,0)){
+		discard;
+	}
+	// output to the frambuffer
+	fb_color = color;
+}
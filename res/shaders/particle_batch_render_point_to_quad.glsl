@@ -0,0 +1,84 @@
+#version 330 core
+#extension GL_ARB_geometry_shader4 : enable
+
+// particle_render_point_to_quad.glsl with the per emitter lifetimes fetched
+// from the batch's parameter buffer, and sizes and colours from the
+// emitter's layer of the curve texture. Emitter records are dropped here
+// rather than discarded per fragment.
+
+layout(points) in;
+layout(triangle_strip) out;
+layout(max_vertices = 4) out;
+
+in VertexData{
+    float type;
+    vec3 position;
+    vec3 velocity;
+    float age;
+    float emitter;
+} g_in[];
+
+out VertexData{
+    vec4 color; // and alpha
+    vec2 textCord;
+} g_out;
+
+// texels of parameters per emitter, defined by EmitterBatch::initShaders
+#ifndef PARAM_STRIDE
+#error PARAM_STRIDE is not defined
+#endif
+
+uniform samplerBuffer uEmitterParams;
+uniform sampler1DArray uCurves;
+uniform mat4 uProjectionMatrix;
+uniform mat4 uModelViewMatrix;
+
+const int CURVE_SAMPLES = 64; // ParticleCurves::SAMPLES
+
+// A ParticleCurveTexture row at agePer, group 0 is colour and alpha,
+// group 1 the billboard size (x).
+vec4 lifetimeCurve(float layer, int group, float agePer) {
+    float x = float(group * CURVE_SAMPLES) + 0.5 + clamp(agePer, 0, 1) * float(CURVE_SAMPLES - 1);
+    return texture(uCurves, vec2(x / float(2 * CURVE_SAMPLES), layer));
+}
+
+void main(){
+	if(g_in[0].type == 1) return;
+
+	int base = int(g_in[0].emitter) * PARAM_STRIDE;
+	float lifeTime = texelFetch(uEmitterParams, base + 5).y;
+
+	float agePer = g_in[0].age / lifeTime; 
+    float billboardSize = lifetimeCurve(g_in[0].emitter, 1, agePer).x;
+
+    vec3 pos = gl_in[0].gl_Position.xyz;
+    vec3 camUp = vec3(uModelViewMatrix[0][1], uModelViewMatrix[1][1], uModelViewMatrix[2][1]);
+    vec3 camRight = vec3(uModelViewMatrix[0][0], uModelViewMatrix[1][0], uModelViewMatrix[2][0]);
+
+    g_out.color = lifetimeCurve(g_in[0].emitter, 0, agePer);
+
+    // top left
+    vec3 topLeftPos = pos + camRight * -0.5 * billboardSize + camUp * 0.5 * billboardSize;
+    gl_Position = uProjectionMatrix * (uModelViewMatrix * vec4(topLeftPos, 1));
+    g_out.textCord = vec2(0,1);
+    EmitVertex();
+
+    // bottom left
+    vec3 bottomLeftPos = pos + camRight * -0.5 * billboardSize + camUp * -0.5 * billboardSize;
+    gl_Position = uProjectionMatrix * (uModelViewMatrix * vec4(bottomLeftPos, 1));
+    g_out.textCord = vec2(0,0);
+    EmitVertex();
+
+    // top right
+    vec3 topRightPos = pos + camRight * 0.5 * billboardSize + camUp * 0.5 * billboardSize;
+    gl_Position = uProjectionMatrix * (uModelViewMatrix * vec4(topRightPos, 1));
+    g_out.textCord = vec2(1,1);
+    EmitVertex();
+
+    // bottom right
+    vec3 bottomRightPos = pos + camRight * 0.5 * billboardSize + camUp * -0.5 * billboardSize;
+    gl_Position = uProjectionMatrix * (uModelViewMatrix * vec4(bottomRightPos, 1));
+    g_out.textCord = vec2(1,0);
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,193 @@
+#version 330 core
+#extension GL_ARB_geometry_shader4 : enable
+
+// Same simulation as particle_update_geometry.glsl, but for every emitter of
+// an EmitterBatch at once. Each record carries the index of its emitter and
+// the emitter's parameters are fetched from a texture buffer instead of
+// uniforms (see EmitterBatch.cpp for the layout).
+
+layout(points) in;
+layout(points) out;
+layout(max_vertices = 100) out;
+
+in float type0[];
+in vec3 position0[];
+in vec3 velocity0[];
+in float age0[];
+in float emitter0[];
+
+out float type1;
+out vec3 position1;
+out vec3 velocity1;
+out float age1;
+out float emitter1;
+
+const float EMITTER_TYPE = 1;
+const float PARTICLE_TYPE = 2;
+// texels of parameters per emitter, defined by EmitterBatch::initShaders
+#ifndef PARAM_STRIDE
+#error PARAM_STRIDE is not defined
+#endif
+
+// ParticleSpawnShape
+const int SPAWN_CUBE = 0;
+const int SPAWN_SPHERE_SHELL = 1;
+const int SPAWN_CONE = 2;
+const int SPAWN_MESH_SURFACE = 3;
+
+// ParticleCollision
+const int COLLIDE_NONE = 0;
+const int COLLIDE_BOUNCE = 1;
+const int COLLIDE_STICK = 2;
+const int COLLIDE_KILL = 3;
+// MAX_PARTICLE_COLLIDERS
+const int MAX_COLLIDERS = 16;
+
+uniform samplerBuffer uEmitterParams;
+// every emitter's MeshSurfaceSampler table, one after the other
+uniform samplerBuffer spawnMesh;
+uniform int emitterCount;
+uniform float delta;
+
+// ForceField3D, 0 strength when there isn't one
+uniform sampler3D forceField;
+uniform mat4 forceFieldTransform;
+uniform float forceFieldStrength = 0;
+
+// per emitter parameters, loaded in main()
+vec3 emitterVelocity;
+float emitterSpeed;
+vec3 updatePos;
+bool shouldUpdatePosition;
+vec3 initVelocity;
+float initSpeed;
+vec3 velVariance;
+float spawnRadius;
+vec3 constForceDir;
+float constForceStrength;
+int emitCount;
+float lifeTime;
+float dragStrength;
+float randIteratorIn;
+int spawnShape;
+float coneAngle;
+int spawnMeshFirst;
+int spawnMeshTriangles;
+mat3 spawnMeshBasis;
+int collision;
+float restitution;
+int colliderFirst; // texel of the first sphere in uEmitterParams
+int colliderCount;
+
+void loadParams(int emitter){
+    int base = emitter * PARAM_STRIDE;
+    vec4 t0 = texelFetch(uEmitterParams, base + 0);
+    vec4 t1 = texelFetch(uEmitterParams, base + 1);
+    vec4 t2 = texelFetch(uEmitterParams, base + 2);
+    vec4 t3 = texelFetch(uEmitterParams, base + 3);
+    vec4 t4 = texelFetch(uEmitterParams, base + 4);
+    vec4 t5 = texelFetch(uEmitterParams, base + 5);
+    vec4 t6 = texelFetch(uEmitterParams, base + 6);
+
+    emitterVelocity = t0.xyz;
+    emitterSpeed = t0.w;
+    updatePos = t1.xyz;
+    shouldUpdatePosition = t1.w != 0;
+    initVelocity = t2.xyz;
+    initSpeed = t2.w;
+    velVariance = t3.xyz;
+    spawnRadius = t3.w;
+    constForceDir = t4.xyz;
+    constForceStrength = t4.w;
+    emitCount = int(t5.x);
+    lifeTime = t5.y;
+    dragStrength = t5.z;
+    randIteratorIn = t5.w;
+    spawnShape = int(t6.x);
+    coneAngle = t6.y;
+    spawnMeshFirst = int(t6.z);
+    spawnMeshTriangles = int(t6.w);
+    spawnMeshBasis = mat3(texelFetch(uEmitterParams, base + 7).xyz,
+                          texelFetch(uEmitterParams, base + 8).xyz,
+                          texelFetch(uEmitterParams, base + 9).xyz);
+    vec4 t10 = texelFetch(uEmitterParams, base + 10);
+    collision = int(t10.x);
+    restitution = t10.y;
+    colliderFirst = int(t10.z);
+    colliderCount = int(t10.w);
+}
+
+// the emitter's spheres are stored after every emitter's parameters
+vec4 collider(int i){
+    return texelFetch(uEmitterParams, colliderFirst + i);
+}
+
+#include "particle_update_common.glsl"
+
+// emits vertex with given parameters 
+void emit(float type, vec3 position, vec3 velocity, float age){
+    type1 = type;
+    position1 = position;
+    velocity1 = velocity;
+    age1 = age;
+    emitter1 = emitter0[0];
+    EmitVertex();
+    EndPrimitive(); 
+}
+
+// handles emitter type primative 
+void handleEmitter(){
+    float age = age0[0] + delta;
+    vec3 emitterPosition = position0[0];
+    if(length(emitterVelocity) > 0){
+        emitterPosition = position0[0] + (normalize(emitterVelocity) * emitterSpeed * delta);
+    }
+    if(shouldUpdatePosition){
+        emitterPosition = updatePos + (normalize(emitterVelocity) * emitterSpeed * delta);
+    }
+
+    if(emitCount > 0){ 
+        emit(EMITTER_TYPE, emitterPosition, emitterVelocity, 0);
+        for(int i = 0; i < emitCount; i++){
+            vec3 newPartVel = spawnDirection() * initSpeed;
+            vec3 spawnPos = position0[0] + spawnOffset();
+            emit(PARTICLE_TYPE, spawnPos, newPartVel, 0);
+        }
+    }else{
+        emit(EMITTER_TYPE, emitterPosition, emitterVelocity, age);
+    }
+}
+
+// handles particle type primative
+void handleParticle(){
+    float age = age0[0] + (delta * rand());
+    if(age < lifeTime){
+        vec3 acceleration = (-velocity0[0] * dragStrength) + (constForceDir * constForceStrength);
+        if(forceFieldStrength > 0){
+            acceleration += texture(forceField, (forceFieldTransform * vec4(position0[0], 1)).xyz).xyz * forceFieldStrength;
+        }
+        vec3 vel = velocity0[0] + (acceleration * delta);
+        float sp = length(vel);
+        if(sp > 0) vel = normalize(vel) * sp; 
+        vec3 newPosition = position0[0] + (vel * delta);
+        if(collide(newPosition, vel)){
+            emit(PARTICLE_TYPE, newPosition, vel, age);
+        }
+    }
+}
+
+void main(){
+    int emitter = int(emitter0[0]);
+    // records of emitters that have been removed from the batch
+    if(emitter >= emitterCount) return;
+    loadParams(emitter);
+
+    switch (int(type0[0])){
+        case int(EMITTER_TYPE):
+            handleEmitter();
+            break;
+        case int(PARTICLE_TYPE):
+            handleParticle();
+            break;
+    }
+}
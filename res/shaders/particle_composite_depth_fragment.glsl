@@ -0,0 +1,21 @@
+#version 330 core
+
+// Reduces the opaque depth buffer to the particle target's resolution. Each
+// target pixel keeps the farthest depth it covers, so particles are only
+// rejected where every full resolution pixel would reject them, and the
+// upsample decides the edges.
+
+uniform sampler2D uFullDepth;
+uniform int scale;
+
+void main() {
+	ivec2 base = ivec2(gl_FragCoord.xy) * scale;
+	ivec2 size = textureSize(uFullDepth, 0) - 1;
+	float depth = 0;
+	for (int y = 0; y < scale; y++) {
+		for (int x = 0; x < scale; x++) {
+			depth = max(depth, texelFetch(uFullDepth, min(base + ivec2(x, y), size), 0).r);
+		}
+	}
+	gl_FragDepth = depth;
+}
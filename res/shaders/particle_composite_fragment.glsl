@@ -0,0 +1,44 @@
+#version 330 core
+
+// Upsamples the particle target over the frame. The four target pixels
+// around this one are weighted bilinearly, and also by how close the depth
+// they were tested against is to this pixel's, so where the opaque depth
+// changes sharply the samples from the other side of the edge drop out.
+
+uniform sampler2D uLowColor; // premultiplied colour, coverage
+uniform sampler2D uLowDepth;
+uniform sampler2D uFullDepth;
+uniform vec2 depthParams; // view depth = y / (x + ndc depth)
+uniform vec2 lowSize;
+
+in vec2 vTexCoord;
+
+out vec4 fb_color;
+
+float viewDepth(float depth) {
+	return depthParams.y / (depthParams.x + depth * 2 - 1);
+}
+
+void main() {
+	float depth = viewDepth(texelFetch(uFullDepth, ivec2(gl_FragCoord.xy), 0).r);
+
+	vec2 p = vTexCoord * lowSize - 0.5;
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - floor(p);
+	ivec2 maxTexel = ivec2(lowSize) - 1;
+
+	vec4 color = vec4(0);
+	float total = 0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			ivec2 t = clamp(base + ivec2(x, y), ivec2(0), maxTexel);
+			float bilinear = (x == 1 ? f.x : 1 - f.x) * (y == 1 ? f.y : 1 - f.y);
+			float lowDepth = viewDepth(texelFetch(uLowDepth, t, 0).r);
+			// relative, so the tolerance scales with distance
+			float w = bilinear / (1e-3 + abs(lowDepth - depth) / depth);
+			color += texelFetch(uLowColor, t, 0) * w;
+			total += w;
+		}
+	}
+	fb_color = total > 0 ? color / total : vec4(0);
+}
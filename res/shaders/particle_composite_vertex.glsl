@@ -0,0 +1,11 @@
+#version 330 core
+
+// A triangle covering the screen, no attributes needed.
+
+out vec2 vTexCoord;
+
+void main() {
+	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	vTexCoord = p;
+	gl_Position = vec4(p * 2 - 1, 0, 1);
+}
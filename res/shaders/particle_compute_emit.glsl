@@ -0,0 +1,137 @@
+#version 430 core
+
+// Compute backend of ParticleEmitter, step 2: spawns the particles the
+// emitter released this frame (decided on the CPU) into slots popped off
+// the dead list. Runs after the update pass, so like the geometry shader,
+// new particles aren't integrated until the next step.
+
+layout(local_size_x = 64) in;
+
+struct Particle {
+    vec4 posAge;
+    vec4 velAlive;
+};
+
+layout(std430, binding = 0) buffer ParticlePool { Particle particles[]; };
+layout(std430, binding = 1) buffer DeadList { int deadCount; int dead[]; };
+layout(std430, binding = 2) buffer AliveList { uint alive[]; };
+layout(std430, binding = 3) buffer DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+uniform int spawnCount;
+uniform float delta;
+uniform float randIteratorIn;
+uniform vec3 emitterPosition; // before this step's move
+uniform vec3 initVelocity;
+uniform float initSpeed;
+uniform vec3 velVariance;
+uniform float spawnRadius;
+
+// ParticleSpawnShape
+const int SPAWN_CUBE = 0;
+const int SPAWN_SPHERE_SHELL = 1;
+const int SPAWN_CONE = 2;
+const int SPAWN_MESH_SURFACE = 3;
+
+uniform int spawnShape = SPAWN_CUBE;
+uniform float coneAngle = 0.3;
+uniform samplerBuffer spawnMesh;
+uniform int spawnMeshTriangles = 0;
+uniform mat3 spawnMeshBasis = mat3(1);
+const int spawnMeshFirst = 0;
+
+float offset;
+
+float randNoise(vec2 co){
+    return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+float rand(){
+    offset += delta * 100 + randIteratorIn * 1000;
+    return randNoise(vec2(offset, offset / 2));
+}
+
+float randRange(float min, float max){
+    return mix(min, max, rand());
+}
+
+// uniform over the triangles of the MeshSurfaceSampler table, u picks
+// the column and whether to take its alias
+vec3 sampleSurface(float u, float s, float t){
+    float column = u * spawnMeshTriangles;
+    int tri = min(int(column), spawnMeshTriangles - 1);
+    if(fract(column) >= texelFetch(spawnMesh, (spawnMeshFirst + tri) * 3).w){
+        tri = int(texelFetch(spawnMesh, (spawnMeshFirst + tri) * 3 + 1).w);
+    }
+    int base = (spawnMeshFirst + tri) * 3;
+    vec3 a = texelFetch(spawnMesh, base).xyz;
+    vec3 b = texelFetch(spawnMesh, base + 1).xyz;
+    vec3 c = texelFetch(spawnMesh, base + 2).xyz;
+    float r = sqrt(s);
+    return a * (1 - r) + b * (r * (1 - t)) + c * (r * t);
+}
+
+// direction of a new particle, every shape draws three numbers
+vec3 spawnDirection(){
+    float x = rand();
+    float y = rand();
+    float z = rand();
+    if(spawnShape == SPAWN_CONE){
+        vec3 axis = normalize(initVelocity);
+        vec3 side = normalize(cross(axis, abs(axis.x) < 0.9 ? vec3(1, 0, 0) : vec3(0, 1, 0)));
+        vec3 up = cross(axis, side);
+        float cosTheta = mix(cos(coneAngle), 1.0, x);
+        float sinTheta = sqrt(1 - cosTheta * cosTheta);
+        float phi = y * 6.2831853;
+        return (side * cos(phi) + up * sin(phi)) * sinTheta + axis * cosTheta;
+    }
+    return normalize(initVelocity + mix(-velVariance, velVariance, vec3(x, y, z)));
+}
+
+// where a new particle spawns relative to the emitter, three more numbers
+vec3 spawnOffset(){
+    float x = rand();
+    float y = rand();
+    float z = rand();
+    if(spawnShape == SPAWN_SPHERE_SHELL){
+        float cz = x * 2 - 1;
+        float ring = sqrt(1 - cz * cz);
+        float phi = y * 6.2831853;
+        return vec3(ring * cos(phi), ring * sin(phi), cz) * spawnRadius;
+    }
+    if(spawnShape == SPAWN_CONE){
+        return vec3(0);
+    }
+    if(spawnShape == SPAWN_MESH_SURFACE && spawnMeshTriangles > 0){
+        return spawnMeshBasis * sampleSurface(x, y, z);
+    }
+    return mix(vec3(-1), vec3(1), vec3(x, y, z)) * spawnRadius;
+}
+
+void main(){
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= uint(spawnCount)) return;
+
+    // pop a free slot, give it back if the pool was empty
+    int top = atomicAdd(deadCount, -1);
+    if(top <= 0){
+        atomicAdd(deadCount, 1);
+        return;
+    }
+    uint slot = uint(dead[top - 1]);
+
+    // the geometry shader draws 6 random numbers per particle from one
+    // sequence, skip ahead to this particle's share of it
+    offset = 1 + float(i * 6u) * (delta * 100 + randIteratorIn * 1000);
+
+    vec3 newPartVel = spawnDirection() * initSpeed;
+    vec3 spawnPos = emitterPosition + spawnOffset();
+
+    particles[slot].posAge = vec4(spawnPos, 0);
+    particles[slot].velAlive = vec4(newPartVel, 1);
+    alive[atomicAdd(count, 1u)] = slot;
+}
@@ -0,0 +1,30 @@
+#version 430 core
+
+// particle_render_vertex.glsl for the compute backend, fetches the particle
+// through the alive list instead of from vertex attributes.
+
+struct Particle {
+    vec4 posAge;
+    vec4 velAlive;
+};
+
+layout(std430, binding = 0) readonly buffer ParticlePool { Particle particles[]; };
+layout(std430, binding = 2) readonly buffer AliveList { uint alive[]; };
+
+out VertexData{
+    float type;
+    vec3 position;
+    vec3 velocity;
+    float age;
+	vec2 textCord;
+} v_out;
+
+void main() {
+	Particle p = particles[alive[gl_VertexID]];
+	gl_Position = vec4(p.posAge.xyz, 1);
+	v_out.type = 2;
+	v_out.position = p.posAge.xyz;
+	v_out.velocity = p.velAlive.xyz;
+	v_out.age = p.posAge.w;
+	v_out.textCord = vec2(0);
+}
@@ -0,0 +1,110 @@
+#version 430 core
+
+// Compute backend of ParticleEmitter, step 1: ages and integrates every live
+// particle in the pool (handleParticle in particle_update_geometry.glsl).
+// Dead particles have their slot pushed onto the dead list, survivors are
+// appended to the alive list and counted into the indirect draw command.
+
+layout(local_size_x = 256) in;
+
+struct Particle {
+    vec4 posAge; // position, age
+    vec4 velAlive; // velocity, 1 if the slot is in use
+};
+
+layout(std430, binding = 0) buffer ParticlePool { Particle particles[]; };
+layout(std430, binding = 1) buffer DeadList { int deadCount; int dead[]; };
+layout(std430, binding = 2) buffer AliveList { uint alive[]; };
+layout(std430, binding = 3) buffer DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+uniform int capacity;
+uniform float delta;
+uniform float lifeTime;
+uniform float dragStrength;
+uniform vec3 constForceDir;
+uniform float constForceStrength;
+uniform float randIteratorIn;
+
+// ForceField3D, 0 strength when there isn't one
+uniform sampler3D forceField;
+uniform mat4 forceFieldTransform;
+uniform float forceFieldStrength = 0;
+
+// ParticleCollision
+const int COLLIDE_NONE = 0;
+const int COLLIDE_BOUNCE = 1;
+const int COLLIDE_STICK = 2;
+const int COLLIDE_KILL = 3;
+// MAX_PARTICLE_COLLIDERS
+const int MAX_COLLIDERS = 16;
+
+// spheres (centre, radius) near the emitter, see ParticleColliders
+uniform vec4 colliders[MAX_COLLIDERS];
+uniform int colliderCount = 0;
+uniform int collision = COLLIDE_NONE;
+uniform float restitution = 0.5;
+
+float randNoise(vec2 co){
+    return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+// collide() of particle_update_common.glsl
+bool collide(inout vec3 position, inout vec3 vel){
+    for(int i = 0; i < colliderCount; i++){
+        vec3 d = position - colliders[i].xyz;
+        float d2 = dot(d, d);
+        if(d2 >= colliders[i].w * colliders[i].w) continue;
+        if(collision == COLLIDE_KILL) return false;
+
+        vec3 n = d2 > 0 ? d * inversesqrt(d2) : vec3(0, 1, 0);
+        position = colliders[i].xyz + n * colliders[i].w;
+        if(collision == COLLIDE_STICK){
+            vel = vec3(0);
+        }else{
+            vel -= (1 + restitution) * min(dot(vel, n), 0) * n;
+        }
+    }
+    return true;
+}
+
+void main(){
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= uint(capacity)) return;
+
+    Particle p = particles[i];
+    if(p.velAlive.w == 0) return;
+
+    // the geometry shader's rand() starts over for every particle, so they
+    // all get its first value
+    float offset = 1 + delta * 100 + randIteratorIn * 1000;
+    float age = p.posAge.w + delta * randNoise(vec2(offset, offset / 2));
+
+    vec3 vel = p.velAlive.xyz;
+    vec3 position = p.posAge.xyz;
+    bool survives = age < lifeTime;
+    if(survives){
+        vec3 acceleration = (-vel * dragStrength) + (constForceDir * constForceStrength);
+        if(forceFieldStrength > 0){
+            acceleration += texture(forceField, (forceFieldTransform * vec4(position, 1)).xyz).xyz * forceFieldStrength;
+        }
+        vel += acceleration * delta;
+        float sp = length(vel);
+        if(sp > 0) vel = normalize(vel) * sp; 
+        position += vel * delta;
+        survives = collide(position, vel);
+    }
+
+    if(survives){
+        particles[i].posAge = vec4(position, age);
+        particles[i].velAlive = vec4(vel, 1);
+        alive[atomicAdd(count, 1u)] = i;
+    }else{
+        particles[i].velAlive.w = 0;
+        dead[atomicAdd(deadCount, 1)] = int(i);
+    }
+}
@@ -7,10 +7,6 @@ uniform vec3 uColor;
 
 uniform sampler2D uText;
 
-uniform float totalLifeTime;
-uniform vec3 initColor;
-uniform vec3 endColor;
-
 // viewspace data (this must match the output of the geo shader)
 in VertexData{
     float type;
@@ -18,6 +14,7 @@ in VertexData{
     vec3 velocity;
     float age;
     vec2 textCord;
+    vec4 color; // from the lifetime curves, per particle
 } f_in;
 
 // framebuffer output
@@ -31,14 +28,9 @@ void main() {
 	// 	return;
 	// }
 
-	float agePer = f_in.age / totalLifeTime; 
-
-	vec3 col = mix(initColor, endColor, agePer);  
-	float alpha = texture(uText, f_in.textCord).a;
-
-	alpha = mix(alpha, 0, agePer);
+	float alpha = texture(uText, f_in.textCord).a * f_in.color.a;
 
-	vec4 color = vec4(col, alpha);
+	vec4 color = vec4(f_in.color.rgb, alpha);
 	if(color == vec4(0,0,0,0)){
 		discard;
 	}
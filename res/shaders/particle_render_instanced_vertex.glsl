@@ -0,0 +1,68 @@
+#version 330 core
+#ifdef PACKED_RECORDS
+#extension GL_ARB_shading_language_packing : require
+#endif
+
+// Instanced replacement for particle_render_vertex.glsl and
+// particle_render_point_to_quad.glsl. Each instance is one particle record
+// (attribute divisor 1), each vertex one corner of a static quad, drawn as
+// the same 4 vertex strip the geometry shader emits.
+
+#ifdef PACKED_RECORDS
+layout (location = 1) in vec3 position;
+layout (location = 2) in uvec2 velocityType; // half x, y | half z, type
+layout (location = 3) in float age;
+#else
+layout (location = 0) in float type;
+layout (location = 1) in vec3 position;
+layout (location = 2) in vec3 velocity;
+layout (location = 3) in float age;
+#endif
+layout (location = 4) in vec2 corner; // per vertex, -0.5 to 0.5
+
+out VertexData{
+    float type;
+    vec4 position;
+    vec3 velocity;
+    float age;
+    vec2 textCord;
+    vec4 color; // and alpha
+} v_out;
+
+uniform mat4 uProjectionMatrix;
+uniform mat4 uModelViewMatrix;
+
+uniform float totalLifeTime;
+uniform sampler1DArray uCurves;
+
+const int CURVE_SAMPLES = 64; // ParticleCurves::SAMPLES
+
+// A ParticleCurveTexture row at agePer, group 0 is colour and alpha,
+// group 1 the billboard size (x).
+vec4 lifetimeCurve(float layer, int group, float agePer) {
+    float x = float(group * CURVE_SAMPLES) + 0.5 + clamp(agePer, 0, 1) * float(CURVE_SAMPLES - 1);
+    return texture(uCurves, vec2(x / float(2 * CURVE_SAMPLES), layer));
+}
+
+void main() {
+#ifdef PACKED_RECORDS
+	float type = float(velocityType.y >> 16);
+	vec3 velocity = vec3(unpackHalf2x16(velocityType.x), unpackHalf2x16(velocityType.y).x);
+#endif
+	float agePer = age / totalLifeTime; 
+
+    float billboardSize = lifetimeCurve(0, 1, agePer).x;
+
+    vec3 camUp = vec3(uModelViewMatrix[0][1], uModelViewMatrix[1][1], uModelViewMatrix[2][1]);
+    vec3 camRight = vec3(uModelViewMatrix[0][0], uModelViewMatrix[1][0], uModelViewMatrix[2][0]);
+
+    vec3 cornerPos = position + camRight * corner.x * billboardSize + camUp * corner.y * billboardSize;
+
+    v_out.type = type;
+    v_out.velocity = velocity;
+    v_out.age = age;
+    v_out.color = lifetimeCurve(0, 0, agePer);
+    v_out.position = uProjectionMatrix * (uModelViewMatrix * vec4(cornerPos, 1));
+    v_out.textCord = corner + 0.5;
+    gl_Position = v_out.position;
+}
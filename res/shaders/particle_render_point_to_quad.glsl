@@ -19,6 +19,7 @@ out VertexData{
     vec3 velocity;
     float age;
     vec2 textCord;
+    vec4 color; // and alpha
 } g_out;
 
 
@@ -27,14 +28,22 @@ uniform mat4 uModelViewMatrix;
 uniform vec3 uColor;
 uniform vec3 uCameraPos;
 
-uniform float initBillboardSize = 1;
-uniform float endBillboardSize = 0.1;
 uniform float totalLifeTime;
+uniform sampler1DArray uCurves;
+
+const int CURVE_SAMPLES = 64; // ParticleCurves::SAMPLES
+
+// A ParticleCurveTexture row at agePer, group 0 is colour and alpha,
+// group 1 the billboard size (x).
+vec4 lifetimeCurve(float layer, int group, float agePer) {
+    float x = float(group * CURVE_SAMPLES) + 0.5 + clamp(agePer, 0, 1) * float(CURVE_SAMPLES - 1);
+    return texture(uCurves, vec2(x / float(2 * CURVE_SAMPLES), layer));
+}
 
 void main(){
 	float agePer = g_in[0].age / totalLifeTime; 
 
-    float billboardSize = mix(initBillboardSize, endBillboardSize, agePer); 
+    float billboardSize = lifetimeCurve(0, 1, agePer).x;
 
     vec3 pos = gl_in[0].gl_Position.xyz;
     vec3 camPos = uCameraPos;
@@ -45,6 +54,7 @@ void main(){
     g_out.type = g_in[0].type;
     g_out.velocity = g_in[0].velocity;
     g_out.age = g_in[0].age;
+    g_out.color = lifetimeCurve(0, 0, agePer);
 
     // top left
     vec3 topLeftPos = pos + camRight * -0.5 * billboardSize + camUp * 0.5 * billboardSize;
@@ -1,9 +1,17 @@
 #version 330 core
+#ifdef PACKED_RECORDS
+#extension GL_ARB_shading_language_packing : require
+
+layout (location = 1) in vec3 position;
+layout (location = 2) in uvec2 velocityType; // half x, y | half z, type
+layout (location = 3) in float age;
+#else
 
 layout (location = 0) in float type;
 layout (location = 1) in vec3 position;
 layout (location = 2) in vec3 velocity;
 layout (location = 3) in float age;
+#endif
 
 out VertexData{
     float type;
@@ -14,6 +22,10 @@ out VertexData{
 } v_out;
 
 void main() {
+#ifdef PACKED_RECORDS
+	float type = float(velocityType.y >> 16);
+	vec3 velocity = vec3(unpackHalf2x16(velocityType.x), unpackHalf2x16(velocityType.y).x);
+#endif
 	gl_Position = vec4(position, 1);
 	v_out.type = type;
 	v_out.position = position;
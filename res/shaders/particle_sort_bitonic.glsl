@@ -0,0 +1,79 @@
+#version 430 core
+
+// Bitonic sort passes for ParticleSort, ascending by key. Each thread
+// compares one pair.
+//  global pass: one compare distance j of the merge of size k
+//  local pass: a block in shared memory, every distance below the block
+//      size for merge k, or every merge up to the block size if presort
+// The last pass also writes the sorted records out as the index buffer.
+
+#define BLOCK 1024
+
+layout(local_size_x = 512) in;
+
+layout(std430, binding = 1) buffer Pairs { uvec2 pairs[]; };
+layout(std430, binding = 3) writeonly buffer Indices { uint indices[]; };
+
+uniform int k;
+uniform int j;
+uniform bool localPass;
+uniform bool presort;
+uniform bool writeIndices;
+
+shared uvec2 block[BLOCK];
+
+void globalPass(){
+    uint t = gl_GlobalInvocationID.x;
+    uint dist = uint(j);
+    uint i = 2u * dist * (t / dist) + t % dist;
+    uint l = i + dist;
+    bool ascending = (i & uint(k)) == 0u;
+
+    uvec2 a = pairs[i];
+    uvec2 b = pairs[l];
+    if((a.x > b.x) == ascending){
+        pairs[i] = b;
+        pairs[l] = a;
+    }
+}
+
+void localPasses(){
+    uint t = gl_LocalInvocationID.x;
+    uint base = gl_WorkGroupID.x * uint(BLOCK);
+    block[t] = pairs[base + t];
+    block[t + BLOCK / 2] = pairs[base + t + BLOCK / 2];
+    barrier();
+
+    uint kFirst = presort ? 2u : uint(k);
+    uint kLast = presort ? uint(BLOCK) : uint(k);
+    for(uint kk = kFirst; kk <= kLast; kk <<= 1){
+        for(uint dist = min(kk, uint(BLOCK)) >> 1; dist > 0u; dist >>= 1){
+            uint i = 2u * dist * (t / dist) + t % dist;
+            uint l = i + dist;
+            bool ascending = ((base + i) & kk) == 0u;
+
+            uvec2 a = block[i];
+            uvec2 b = block[l];
+            if((a.x > b.x) == ascending){
+                block[i] = b;
+                block[l] = a;
+            }
+            barrier();
+        }
+    }
+
+    pairs[base + t] = block[t];
+    pairs[base + t + BLOCK / 2] = block[t + BLOCK / 2];
+    if(writeIndices){
+        indices[base + t] = block[t].y;
+        indices[base + t + BLOCK / 2] = block[t + BLOCK / 2].y;
+    }
+}
+
+void main(){
+    if(localPass){
+        localPasses();
+    }else{
+        globalPass();
+    }
+}
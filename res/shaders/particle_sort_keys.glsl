@@ -0,0 +1,52 @@
+#version 430 core
+
+// First pass of ParticleSort's GPU path. Pairs every record slot with a key
+// that orders it farthest first, records that aren't drawn get the largest
+// key so they sort to the end, and counts the drawn ones into the indirect
+// draw command.
+
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer Records { float records[]; };
+layout(std430, binding = 1) writeonly buffer Pairs { uvec2 pairs[]; }; // key, record
+layout(std430, binding = 2) buffer DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+uniform int recordCount;
+uniform int paddedCount;
+uniform int stride; // in floats
+uniform int typeOffset;
+uniform int positionOffset;
+uniform float drawType;
+uniform bool packedType; // an integer in the word's top 16 bits
+uniform mat4 uModelViewMatrix;
+
+void main(){
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= uint(paddedCount)) return;
+
+    uint key = 0xffffffffu;
+    if(i < uint(recordCount)){
+        uint r = i * uint(stride);
+        float word = records[r + typeOffset];
+        int type = packedType ? int(floatBitsToUint(word) >> 16) : int(word);
+        if(type == int(drawType)){
+            uint p = r + uint(positionOffset);
+            vec3 pos = vec3(records[p], records[p + 1], records[p + 2]);
+            float depth = -(uModelViewMatrix * vec4(pos, 1)).z;
+
+            // flip the float's bits so they order as unsigned ints, then
+            // invert for descending depth
+            uint bits = floatBitsToUint(depth);
+            bits ^= (bits & 0x80000000u) != 0u ? 0xffffffffu : 0x80000000u;
+            key = ~bits;
+            atomicAdd(count, 1u);
+        }
+    }
+    pairs[i] = uvec2(key, i);
+}
@@ -0,0 +1,100 @@
+// The spawning, random number and collision helpers shared by
+// particle_update_geometry.glsl and particle_batch_update_geometry.glsl.
+// The including shader declares, as uniforms or per emitter globals:
+//  delta, randIteratorIn
+//  spawnShape, coneAngle, spawnRadius, initVelocity, velVariance
+//  spawnMesh, spawnMeshFirst, spawnMeshTriangles, spawnMeshBasis
+//  collision, restitution, colliderCount
+// the SPAWN_ and COLLIDE_ constants, and vec4 collider(int i), the i-th
+// sphere (centre, radius) to collide with.
+
+float offset = 1;
+
+float randNoise(vec2 co){
+    return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+// returns random float between 0 and 1
+float rand(){
+    offset += delta * 100 + randIteratorIn * 1000;
+    return randNoise(vec2(offset, offset / 2));
+}
+
+// returns random value between min and max range
+float randRange(float min, float max){
+    return mix(min, max, rand());
+}
+
+// uniform over the triangles of the MeshSurfaceSampler table, u picks
+// the column and whether to take its alias
+vec3 sampleSurface(float u, float s, float t){
+    float column = u * spawnMeshTriangles;
+    int tri = min(int(column), spawnMeshTriangles - 1);
+    if(fract(column) >= texelFetch(spawnMesh, (spawnMeshFirst + tri) * 3).w){
+        tri = int(texelFetch(spawnMesh, (spawnMeshFirst + tri) * 3 + 1).w);
+    }
+    int base = (spawnMeshFirst + tri) * 3;
+    vec3 a = texelFetch(spawnMesh, base).xyz;
+    vec3 b = texelFetch(spawnMesh, base + 1).xyz;
+    vec3 c = texelFetch(spawnMesh, base + 2).xyz;
+    float r = sqrt(s);
+    return a * (1 - r) + b * (r * (1 - t)) + c * (r * t);
+}
+
+// direction of a new particle, every shape draws three numbers
+vec3 spawnDirection(){
+    float x = rand();
+    float y = rand();
+    float z = rand();
+    if(spawnShape == SPAWN_CONE){
+        vec3 axis = normalize(initVelocity);
+        vec3 side = normalize(cross(axis, abs(axis.x) < 0.9 ? vec3(1, 0, 0) : vec3(0, 1, 0)));
+        vec3 up = cross(axis, side);
+        float cosTheta = mix(cos(coneAngle), 1.0, x);
+        float sinTheta = sqrt(1 - cosTheta * cosTheta);
+        float phi = y * 6.2831853;
+        return (side * cos(phi) + up * sin(phi)) * sinTheta + axis * cosTheta;
+    }
+    return normalize(initVelocity + mix(-velVariance, velVariance, vec3(x, y, z)));
+}
+
+// where a new particle spawns relative to the emitter, three more numbers
+vec3 spawnOffset(){
+    float x = rand();
+    float y = rand();
+    float z = rand();
+    if(spawnShape == SPAWN_SPHERE_SHELL){
+        float cz = x * 2 - 1;
+        float ring = sqrt(1 - cz * cz);
+        float phi = y * 6.2831853;
+        return vec3(ring * cos(phi), ring * sin(phi), cz) * spawnRadius;
+    }
+    if(spawnShape == SPAWN_CONE){
+        return vec3(0);
+    }
+    if(spawnShape == SPAWN_MESH_SURFACE && spawnMeshTriangles > 0){
+        return spawnMeshBasis * sampleSurface(x, y, z);
+    }
+    return mix(vec3(-1), vec3(1), vec3(x, y, z)) * spawnRadius;
+}
+
+// Moves a particle that ended its step inside a collider back onto the
+// surface, then bounces or stops it. False if it's killed instead.
+bool collide(inout vec3 position, inout vec3 vel){
+    for(int i = 0; i < colliderCount; i++){
+        vec4 sphere = collider(i);
+        vec3 d = position - sphere.xyz;
+        float d2 = dot(d, d);
+        if(d2 >= sphere.w * sphere.w) continue;
+        if(collision == COLLIDE_KILL) return false;
+
+        vec3 n = d2 > 0 ? d * inversesqrt(d2) : vec3(0, 1, 0);
+        position = sphere.xyz + n * sphere.w;
+        if(collision == COLLIDE_STICK){
+            vel = vec3(0);
+        }else{
+            vel -= (1 + restitution) * min(dot(vel, n), 0) * n;
+        }
+    }
+    return true;
+}
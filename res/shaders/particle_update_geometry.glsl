@@ -1,5 +1,8 @@
 #version 330 core
 #extension GL_ARB_geometry_shader4 : enable
+#ifdef PACKED_RECORDS
+#extension GL_ARB_shading_language_packing : require
+#endif
 
 layout(points) in;
 layout(points) out;
@@ -10,22 +13,50 @@ in vec3 position0[];
 in vec3 velocity0[];
 in float age0[];
 
+#ifdef PACKED_RECORDS
+// PackedParticle, velocity in half floats with the type in the top bits
+out vec3 position1;
+out float age1;
+flat out uint velXY1;
+flat out uint velZType1;
+#else
 out float type1;
 out vec3 position1;
 out vec3 velocity1;
 out float age1;
+#endif
 
 const float EMITTER_TYPE = 1;
 const float PARTICLE_TYPE = 2;
 
+// ParticleSpawnShape
+const int SPAWN_CUBE = 0;
+const int SPAWN_SPHERE_SHELL = 1;
+const int SPAWN_CONE = 2;
+const int SPAWN_MESH_SURFACE = 3;
+
+// ParticleCollision
+const int COLLIDE_NONE = 0;
+const int COLLIDE_BOUNCE = 1;
+const int COLLIDE_STICK = 2;
+const int COLLIDE_KILL = 3;
+// MAX_PARTICLE_COLLIDERS
+const int MAX_COLLIDERS = 16;
+
 uniform float randIteratorIn;
 
 uniform float delta;
 uniform vec3 emitterVelocity = vec3(0,0,0);
 uniform float emitterSpeed = 0;
-uniform float emitTime = 0.01;
-uniform int emitCount = 10;
+// particles to emit this pass, the emission rate is scheduled on the CPU
+uniform int emitCount = 0;
 uniform float spawnRadius = 1;
+uniform int spawnShape = SPAWN_CUBE;
+uniform float coneAngle = 0.3;
+uniform samplerBuffer spawnMesh;
+uniform int spawnMeshTriangles = 0;
+uniform mat3 spawnMeshBasis = mat3(1);
+const int spawnMeshFirst = 0;
 
 uniform bool shouldUpdatePosition = false;
 uniform vec3 updatePos = vec3(0,0,0);
@@ -36,9 +67,6 @@ uniform float lifeTime = 20;
 uniform float maxSpeed = 3;
 uniform float speedDropPercent = 0.5;
 
-uniform bool isOneOff = false;
-uniform bool shouldEmitOneOff = false;
-
 uniform float maxAccel = 100;
 uniform vec3 velVariance = vec3(0,0,0);
 uniform vec3 constForceDir = vec3(0,0,0);
@@ -46,29 +74,36 @@ uniform float constForceStrength = 0;
 
 uniform float dragStrength = 50;
 
-float offset = 1;
+// ForceField3D, 0 strength when there isn't one
+uniform sampler3D forceField;
+uniform mat4 forceFieldTransform;
+uniform float forceFieldStrength = 0;
 
-float randNoise(vec2 co){
-    return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
-}
+// spheres (centre, radius) near the emitter, see ParticleColliders
+uniform vec4 colliders[MAX_COLLIDERS];
+uniform int colliderCount = 0;
+uniform int collision = COLLIDE_NONE;
+uniform float restitution = 0.5;
 
-// returns random float between 0 and 1
-float rand(){
-    offset += delta * 100 + randIteratorIn * 1000;
-    return randNoise(vec2(offset, offset / 2));
+vec4 collider(int i){
+    return colliders[i];
 }
 
-// returns random value between min and max range
-float randRange(float min, float max){
-    return mix(min, max, rand());
-}
+#include "particle_update_common.glsl"
 
 // emits vertex with given parameters 
 void emit(float type, vec3 position, vec3 velocity, float age){
+#ifdef PACKED_RECORDS
+    position1 = position;
+    age1 = age;
+    velXY1 = packHalf2x16(velocity.xy);
+    velZType1 = packHalf2x16(vec2(velocity.z, 0)) | (uint(type) << 16);
+#else
     type1 = type;
     position1 = position;
     velocity1 = velocity;
     age1 = age;
+#endif
     EmitVertex();
     EndPrimitive(); 
 }
@@ -88,18 +123,12 @@ void handleEmitter(){
         emitterPosition = updatePos + (normalize(emitterVelocity) * emitterSpeed * delta);;
     }
 
-    bool needToEmitOneOff = isOneOff && shouldEmitOneOff;
-    bool isTimeToEmitForPassiveEmit = age >= emitTime && !isOneOff;
-    bool isTimeToEmit = isTimeToEmitForPassiveEmit || needToEmitOneOff; 
+    bool isTimeToEmit = emitCount > 0;
     if(isTimeToEmit){ 
         emit(emitterrType, emitterPosition, emitterVelocity, 0);
         for(int i = 0; i < emitCount; i++){
-            vec3 newPartVel = initVelocity;
-            newPartVel = vec3(newPartVel.x + randRange(-velVariance.x, velVariance.x),
-                            newPartVel.y + randRange(-velVariance.y, velVariance.y),
-                            newPartVel.z + randRange(-velVariance.z, velVariance.z));
-            newPartVel = normalize(newPartVel) * initSpeed;
-            vec3 spawnPos = position0[0] + vec3(randRange(-1, 1), randRange(-1, 1), randRange(-1, 1)) * spawnRadius;
+            vec3 newPartVel = spawnDirection() * initSpeed;
+            vec3 spawnPos = position0[0] + spawnOffset();
             emit(PARTICLE_TYPE, spawnPos, newPartVel, 0);
         }
     }else{
@@ -116,6 +145,9 @@ void handleParticle(){
 
     if(age < lifeTime){
         vec3 acceleration = (-velocity0[0] * dragStrength) + (constForceDir * constForceStrength);
+        if(forceFieldStrength > 0){
+            acceleration += texture(forceField, (forceFieldTransform * vec4(position0[0], 1)).xyz).xyz * forceFieldStrength;
+        }
         // acceleration = min(length(acceleration), maxAccel) * normalize(acceleration);
 
         // vec3 acceleration = vec3(0,1,0);
@@ -124,9 +156,11 @@ void handleParticle(){
         float sp = length(vel);
 
         // sp = clamp(sp, 0, maxSpeed);
-        vel = normalize(vel) * sp; 
+        if(sp > 0) vel = normalize(vel) * sp; 
         vec3 newPosition = position0[0] + (vel * delta);
-        emit(PARTICLE_TYPE, newPosition, vel, age);
+        if(collide(newPosition, vel)){
+            emit(PARTICLE_TYPE, newPosition, vel, age);
+        }
     }
 }
 
@@ -0,0 +1,20 @@
+#version 330 core
+
+in VertexData {
+    vec3 color;
+    float agePer;
+    float edge;
+} f_in;
+
+// framebuffer output
+out vec4 fb_color;
+
+void main() {
+	// faded out along the ribbon, like a particle over its life, and
+	// softened towards the edges
+	float alpha = (1 - f_in.agePer) * (1 - f_in.edge * f_in.edge);
+	if(alpha <= 0){
+		discard;
+	}
+	fb_color = vec4(f_in.color, alpha);
+}
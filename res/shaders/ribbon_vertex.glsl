@@ -0,0 +1,60 @@
+#version 330 core
+
+// RibbonRenderer: one instance per emitter, two vertices per history slot
+// (newest first), pushed out to either side across the view direction.
+
+uniform mat4 uProjectionMatrix;
+uniform mat4 uViewMatrix;
+uniform vec3 uCameraPos;
+
+// texel slot * capacity + emitter: position, time recorded
+uniform samplerBuffer uHistory;
+// per emitter: slots recorded since its ribbon started
+uniform samplerBuffer uTracks;
+uniform int slots;
+uniform int capacity;
+uniform int head;
+uniform float time;
+uniform float lifeTime;
+
+uniform float headWidth;
+uniform float tailWidth;
+uniform vec3 headColor;
+uniform vec3 tailColor;
+
+out VertexData {
+    vec3 color;
+    float agePer;
+    float edge; // -1 to 1 across the strip
+} v_out;
+
+// the i-th newest sample of this emitter
+vec4 history(int i){
+    int slot = (head - i + slots) % slots;
+    return texelFetch(uHistory, slot * capacity + gl_InstanceID);
+}
+
+void main(){
+    int valid = int(texelFetch(uTracks, gl_InstanceID).x);
+    int i = gl_VertexID / 2;
+    float side = (gl_VertexID & 1) == 0 ? -0.5 : 0.5;
+
+    // past the recorded history the strip folds onto its last sample
+    bool folded = i >= valid;
+    i = min(i, valid - 1);
+
+    vec4 s = history(i);
+    vec3 along = history(max(i - 1, 0)).xyz - history(min(i + 1, valid - 1)).xyz;
+    if(dot(along, along) < 1e-12) along = vec3(0, 1, 0);
+    vec3 across = cross(along, uCameraPos - s.xyz);
+    across = dot(across, across) > 1e-12 ? normalize(across) : vec3(1, 0, 0);
+
+    float agePer = clamp((time - s.w) / lifeTime, 0, 1);
+    float width = folded ? 0 : mix(headWidth, tailWidth, agePer);
+    vec3 position = s.xyz + across * side * width;
+
+    v_out.color = mix(headColor, tailColor, agePer);
+    v_out.agePer = agePer;
+    v_out.edge = side * 2;
+    gl_Position = uProjectionMatrix * uViewMatrix * vec4(position, 1);
+}
@@ -11,11 +11,16 @@
 
 // project
 #include "application.hpp"
+#include "cgra/cgra_assets.hpp"
 #include "cgra/cgra_geometry.hpp"
 #include "cgra/cgra_gui.hpp"
 #include "cgra/cgra_image.hpp"
+#include "cgra/cgra_isosurface.hpp"
+#include "cgra/cgra_noise.hpp"
+#include "cgra/cgra_sdf.hpp"
 #include "cgra/cgra_shader.hpp"
 #include "cgra/cgra_wavefront.hpp"
+#include "MeshSurfaceSampler.hpp"
 
 #include "PerlinNoise.hpp"
 
@@ -27,6 +32,34 @@ typedef struct {
     float cutoff;
     float edge_length;
     int num_verts;
+
+    // Animated mode: the field is sampled from 4D noise (x, y, z, t) and the
+    // mesh is re-extracted a few slabs at a time under a per-frame budget.
+    bool animate = false;
+    float morph_speed = 0.1;
+    int morph_chunks = 8;
+    float morph_budget_ms = 2.0;
+
+    // Ambient occlusion baked per vertex by ray-marching the sampled field.
+    bool bake_ao = true;
+    int ao_rays = 16;
+    float ao_distance = 6.0; // in grid cells
+
+    // Field source, 0: sphere-masked noise, 1: SDF CSG body (noise-displaced
+    // sphere with boulders unioned on and craters subtracted).
+    int field_mode = 0;
+    int crater_count = 40;
+    int boulder_count = 20;
+
+    // Draw only the meshlets that are in the frustum and facing the camera.
+    bool meshlet_culling = true;
+
+    // Shader variant: textured or flat coloured, and the QUALITY_TIER of
+    // oren_nayar.glsl (0 reference, 1 qualitative, 2 lookup table). The
+    // lookup table tier samples brdf_lut, an OrenNayarLut texture.
+    bool use_texture = true;
+    int shading_quality = 0;
+    GLuint brdf_lut = 0;
 } AsteroidMeshConfig;
 
 class Asteroid {
@@ -40,22 +73,117 @@ class Asteroid {
     glm::vec3 rotation_axis;
     double rotation_velocity;
     void regenerate_mesh(const siv::PerlinNoise::seed_type seed);
+    // Frees the meshes and surface table and releases the shader and
+    // texture. Copies share them, so only for the last one.
+    void destroy();
+
+    // Advances the morph time and spends up to morph_budget_ms re-extracting
+    // the mesh. Returns the time spent this frame in milliseconds.
+    double update_morph(const double dt);
+
+    // Time the last completed generation spent baking ambient occlusion.
+    double last_ao_bake_ms = 0.0;
+
+    // Indices submitted by the last draw, and in the whole mesh.
+    int last_drawn_indices = 0;
+    int index_count() const { return meshes[front_mesh].index_count; }
+
+    // Area weighted sampling of the current mesh's surface, rebuilt when a
+    // generation finishes. The basis takes it to world space, around
+    // position.
+    const MeshSurfaceSampler &surface() const { return surface_sampler; }
+    glm::mat3 surface_basis() const { return glm::mat3(modelTransform); }
+
+    // shader variants this asteroid has drawn with
+    int shader_variant_count() const { return shaders.size(); }
+
+    // Centre and radius of a sphere around the current mesh, in world
+    // space, for particles to collide with.
+    glm::vec4 bounding_sphere() const {
+        const float scale = glm::length(glm::vec3(modelTransform[0]));
+        return glm::vec4(position, bounding_radius * scale);
+    }
 
   private:
-    cgra::gl_mesh mesh;
+    // Double buffered so the front mesh keeps being drawn while the next
+    // one is extracted, swapped only once a generation is complete.
+    cgra::gl_mesh meshes[2];
+    int front_mesh = 0;
+    MeshSurfaceSampler surface_sampler;
+    float bounding_radius = 0; // in mesh space, around the origin
+
+    siv::PerlinNoise perlin;
+    cgra::perlin_noise_4d perlin4d;
+    double morph_time = 0.0;
+
+    // The asteroid's fields: octave noise (static or sliced through 4D
+    // noise at the morph time) faded out towards a sphere.
+    using asteroid_field_3d =
+        iso::sphere_mask<double, iso::noise3_field<double, siv::PerlinNoise>>;
+    using asteroid_field_4d = iso::sphere_mask<
+        double, iso::noise4_field<double, cgra::perlin_noise_4d>>;
+
+    // The CSG body used when field_mode is 1, rebuilt on regenerate_mesh.
+    sdf::csg_body<siv::PerlinNoise> body;
+
+    // A (possibly partial) mesh generation. The grid is split into slabs
+    // along x, every slab is sampled first (the center needs all of them)
+    // and then every slab is extracted, one slab per work item.
+    struct Generation {
+        int width = 0;
+        int chunks = 1;
+        int next_item = 0;
+        int total_items = 0;
+        double time = 0.0;
+        bool animated = false;
+        bool csg = false;
+        bool in_progress = false;
+
+        iso::dense_grid<double> point_cloud;
+        iso::dense_grid<vec3> point_cloud_grads;
+        vec3 center_sum = vec3(0);
+        int num_points = 0;
+        vec3 center = vec3(0);
+
+        mesh_builder mb;
+
+        vector<vec3> ao_dirs;
+        double ao_ms = 0.0;
+    } gen;
+
+    void begin_generation(const double time, const bool animated);
+    // Runs the next work item, returns true once the generation is finished.
+    bool step_generation();
+    void sample_slab(const int x_begin, const int x_end);
+    void extract_slab(const int x_begin, const int x_end);
+    void bake_ao_range(const int v_begin, const int v_end);
+    void finish_generation();
+
     glm::mat4 modelTransform;
     glm::vec3 color;
     double rotation_angle;
     AsteroidMeshConfig *asteroidMeshConfig;
 
-    // Load the shader program, if it hasn't been loaded already.
-    // The shader program is stored in a static variable, so it is shared
-    // between all instances.
-    static GLuint shader;
-    static void load_shader();
+    // handles into one shader variant, looked up as it's built
+    struct Uniforms {
+        program::uniform_handle uProjectionMatrix, uModelViewMatrix,
+            uViewMatrix, uColor, uTexture, uHeatLightDir, uRoughness, uE_0,
+            uBrdfLut;
+
+        Uniforms() {}
+        explicit Uniforms(const cgra::program &shader);
+    };
 
-    static GLuint texture;
-    static void load_texture();
+    // The shader's variants, picked per draw (bits in the order of the
+    // flags given in load_shader). The programs and texture are shared
+    // between all asteroids through cgra::asset_registry, each asteroid
+    // holds a reference to them until destroy().
+    enum shader_flag { shader_use_texture = 1, shader_heat_light = 2 };
+    cgra::shader_variants<Uniforms> shaders;
+    void load_shader();
+
+    GLuint texture = 0;
+    void load_texture();
 
     static vec2 xyzToUv(vec3 xyz) {
         vec3 n = normalize(xyz);
@@ -69,27 +197,4 @@ class Asteroid {
 
         return glm::vec2(u, v);
     }
-
-    // A helper function for finding when a the t value of when a linear
-    // interpolation crosses a cutoff value.
-    double inverse_lerp(const double a, const double b, const double x) {
-        return (a - x) / (a - b);
-    }
-
-    // Returns a vec3 containing the offsets from the origin to the vertex
-    // withing the given edge number
-    vec3 marching_cubes_edge(const int edge_num, const double *points,
-                             const double cutoff);
-
-    // Returns a vector of the vertices of the triangles that make up a
-    // single case for marching cubes. The returned array will list the
-    // verts in triplets, capped off with a -1.
-    int *marching_cubes_tris(const int case_num);
-
-    // Returns the calculated normal of a vertex lying on the edge of a
-    // marching cube for smooth shading.
-    vec3 marching_cubes_grad(const int i, const int j, const int k,
-                             const int edge_num, const double *points,
-                             const double cutoff,
-                             const vector<vector<vector<vec3>>> &grads);
 };
@@ -1,5 +1,7 @@
 #include "CenterBody.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 
 // glm
@@ -7,22 +9,33 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 // project
+#include "cgra/cgra_assets.hpp"
 #include "cgra/cgra_geometry.hpp"
 #include "cgra/cgra_gui.hpp"
+#include "cgra/cgra_isosurface.hpp"
+#include "cgra/cgra_sdf.hpp"
 #include "cgra/cgra_shader.hpp"
 
+#include "PerlinNoise.hpp"
+
 using namespace std;
 using namespace cgra;
 using namespace glm;
 
 CenterBody::CenterBody()
 {
-	shader_builder sb;
-    sb.set_shader(GL_VERTEX_SHADER, CGRA_SRCDIR + 
-		std::string("//res//shaders//color_vert_central.glsl"));
-	sb.set_shader(GL_FRAGMENT_SHADER, CGRA_SRCDIR + 
-		std::string("//res//shaders//color_frag_central.glsl"));
-	shader = sb.build();
+	asset_registry::program_desc desc;
+	desc.stages = {
+		{GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//color_vert_central.glsl")},
+		{GL_FRAGMENT_SHADER, CGRA_SRCDIR + std::string("//res//shaders//color_frag_central.glsl")}};
+	shader = asset_registry::shared().acquire_program(desc);
+
+	uProjectionMatrix = shader.uniform("uProjectionMatrix");
+	uModelViewMatrix = shader.uniform("uModelViewMatrix");
+	uColor = shader.uniform("uColor");
+	uIsDeformation = shader.uniform("uIsDeformation");
+	uDeformation = shader.uniform("uDeformation");
+	uCovDensity = shader.uniform("uCovDensity");
 }
 
 CenterBody::~CenterBody()
@@ -30,29 +43,83 @@ CenterBody::~CenterBody()
 
 }
 
+void CenterBody::destroy()
+{
+	asset_registry::shared().release_program(shader);
+	shader = program();
+	clear_surface();
+}
+
+void CenterBody::build_surface(unsigned seed, int craters, int boulders, int resolution) {
+	const auto start = chrono::steady_clock::now();
+
+	// unit radius in model space, the model transform scales it like the
+	// sphere. The grid leaves room for the displacement and boulders.
+	sdf::csg_body<siv::PerlinNoise> body;
+	body.noise.reseed(seed);
+	sdf::make_cratered_body(body, seed, 1.0f, craters, boulders);
+
+	const int n = std::max(resolution, 8);
+	const double extent = 1.4;
+	const double spacing = 2 * extent / (n - 1);
+	const dvec3 origin(-extent);
+	iso::dense_grid<double> grid = iso::dense_grid<double>(ivec3(n));
+	iso::dense_grid<vec3> grads = iso::dense_grid<vec3>(ivec3(n));
+	sdf::sample_bricks(grid, body, origin, spacing, 0, n, 0.0);
+	iso::compute_gradients(grid, grads, 0, n);
+
+	mesh_builder mb;
+	float furthest = 0;
+	iso::extract(grid, grads, 0.0, 0, n - 1, [&](const vec3(&pos)[3], const vec3(&grad)[3]) {
+		for (int v = 0; v < 3; v++) {
+			const vec3 p = vec3(origin) + float(spacing) * pos[v];
+			const vec3 d = normalize(p);
+			const vec2 uv(std::atan2(d.z, d.x) / (2 * pi<float>()) + 0.5f, std::acos(glm::clamp(d.y, -1.0f, 1.0f)) / pi<float>());
+			furthest = std::max(furthest, length(p));
+			// the field increases inwards, so the normal is the negated gradient
+			mb.push_index(mb.push_vertex(mesh_vertex{ p, -normalize(grad[v]), uv }));
+		}
+	});
+
+	clear_surface();
+	if (!mb.indices.empty()) {
+		surface = mb.build();
+		bound = furthest;
+	}
+	surface_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void CenterBody::clear_surface() {
+	surface.destroy();
+	surface = gl_mesh();
+	bound = 1.0;
+}
+
 void CenterBody::draw(const glm::mat4 &view, const glm::mat4 proj,
 	double deltaTime, double deformation, double covDensity) {
 
 	rotateAngle += deltaTime * rotateSpeed;
 	rotateAngle = fmod(rotateAngle, 2 * pi<float>());
-	modelTransform = translate(mat4(1), vec3(0, 0, 6)) *
-		rotate(mat4(1), rotateAngle, vec3(0, 1, 0));
+	modelTransform = translate(mat4(1), position) *
+		rotate(mat4(1), rotateAngle, vec3(0, 1, 0)) *
+		scale(mat4(1), vec3(radius));
 
 	mat4 modelview = view * modelTransform;
 	
-	glUseProgram(shader); // load shader and variables
-	glUniformMatrix4fv(glGetUniformLocation(shader, "uProjectionMatrix"), 1, false, value_ptr(proj));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "uModelViewMatrix"), 1, false, value_ptr(modelview));
-	glUniform3fv(glGetUniformLocation(shader, "uColor"), 1, value_ptr(color));
+	shader.use(); // load shader and variables
+	shader.set(uProjectionMatrix, proj);
+	shader.set(uModelViewMatrix, modelview);
+	shader.set(uColor, color);
 
 	// deformation or not
 	int is_deformation = fabs(deformation) > 1E-3 ? 1 : 0;
-	glUniform1i(glGetUniformLocation(shader, "uIsDeformation"), is_deformation);
-	glUniform1f(glGetUniformLocation(shader, "uDeformation"), deformation);
+	shader.set(uIsDeformation, is_deformation);
+	shader.set(uDeformation, float(deformation));
 
 	// cov-density
-	glUniform1f(glGetUniformLocation(shader, "uCovDensity"), covDensity);
+	shader.set(uCovDensity, float(covDensity));
 
 	// draw
-	drawSphere();
+	if (surface.vao) surface.draw();
+	else drawSphere();
 }
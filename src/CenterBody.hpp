@@ -4,6 +4,8 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "opengl.hpp"
+#include "cgra/cgra_mesh.hpp"
+#include "cgra/cgra_shader.hpp"
 
 class CenterBody
 {
@@ -13,9 +15,33 @@ public:
 
 	void draw(const glm::mat4& view, const glm::mat4 proj,
 		double deltaTime, double defomation, double covDensity);
+	// Releases the shader (shared through cgra::asset_registry) and the
+	// surface, needs the GL context so it isn't left to the destructor.
+	void destroy();
+
+	// Builds the surface from an SDF CSG body (see cgra_sdf.hpp), a
+	// noise-displaced sphere with craters subtracted and boulders unioned,
+	// sampled brick by brick on resolution^3 points and meshed by marching
+	// cubes like the asteroids. It's drawn instead of the UV sphere until
+	// clear_surface(). Takes a while, so call it on a change, not per frame.
+	void build_surface(unsigned seed, int craters, int boulders, int resolution = 64);
+	void clear_surface();
+	bool has_surface() const { return surface.vao != 0; }
+	double surface_milliseconds() const { return surface_ms; }
+
+	// Centre and radius in world space, for particles to collide with. The
+	// deformation only moves the shading, not the silhouette.
+	glm::vec4 bounding_sphere() const { return glm::vec4(position, radius * bound); }
 private:
-	GLuint shader = 0;
+	cgra::program shader;
+	cgra::gl_mesh surface;
+	float bound = 1.0; // furthest point of the surface, in model space
+	double surface_ms = 0;
+	cgra::program::uniform_handle uProjectionMatrix, uModelViewMatrix, uColor;
+	cgra::program::uniform_handle uIsDeformation, uDeformation, uCovDensity;
 	glm::vec3 color{ 0.7 };
+	glm::vec3 position{ 0, 0, 6 };
+	float radius = 1.0;
 	glm::mat4 modelTransform{ 1.0 };
 	float rotateAngle = 0.0;
 	float rotateSpeed = 0.5;
@@ -0,0 +1,409 @@
+#include "EmitterBatch.hpp"
+
+#include "cgra/cgra_assets.hpp"
+#include "cgra/cgra_image.hpp"
+#include "cgra/cgra_shader.hpp"
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace glm;
+using namespace cgra;
+using namespace std;
+
+// Texels (RGBA32F) of parameters per emitter, defined as PARAM_STRIDE in
+// the particle_batch_* shaders.
+//  0: emitterVelocity, emitterSpeed
+//  1: updatePos, shouldUpdatePosition
+//  2: initVelocity, initSpeed
+//  3: velVariance, spawnRadius
+//  4: constForceDir, constForceStrength
+//  5: emitCount, lifeTime, dragStrength, randIterator
+//  6: spawnShape, coneAngle, first mesh triangle, mesh triangles
+//  7-9: spawnMeshBasis columns
+//  10: collision, restitution, first collider texel, collider count
+// The collider spheres (centre, radius) of every emitter follow the last
+// emitter's parameters. Colours and sizes are in m_curves, layer per emitter.
+static const int paramStride = 11;
+
+// BatchParticle in floats: type, position, velocity, age, emitter
+static const ParticleRecordLayout batchLayout = {9, 0, 1, 2};
+
+EmitterBatch::EmitterBatch(int capacity) : m_capacity(capacity), m_sorter(batchLayout){}
+
+void EmitterBatch::init()
+{
+    initShaders();
+
+    texture = asset_registry::shared().acquire_texture(CGRA_SRCDIR + std::string("//res//textures//radGrad.png"));
+
+    glGenVertexArrays(2, updateVao);
+    glGenVertexArrays(2, renderVao);
+    glGenTransformFeedbacks(2, m_transformFeedback);
+    glGenQueries(1, &m_writtenQuery);
+    createBuffers();
+
+    glGenBuffers(1, &m_spawnBuffer);
+    glGenVertexArrays(1, &m_spawnVao);
+    setupAttributes(m_spawnVao, m_spawnBuffer);
+
+    glGenBuffers(1, &m_paramBuffer);
+    glGenTextures(1, &m_paramTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_paramBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, paramStride * sizeof(vec4), nullptr, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_paramTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_paramBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenBuffers(1, &m_meshBuffer);
+    glGenTextures(1, &m_meshTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_meshBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4), nullptr, GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_meshTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_meshBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void EmitterBatch::createBuffers()
+{
+    glGenBuffers(2, m_particleBuffer);
+
+    for(int i = 0; i < 2; i++){
+        glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[i]);
+        glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(BatchParticle), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        setupAttributes(updateVao[i], m_particleBuffer[i]);
+        setupAttributes(renderVao[i], m_particleBuffer[i]);
+
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_transformFeedback[i]);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_particleBuffer[i]);
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    }
+}
+
+void EmitterBatch::growBuffers(int capacity)
+{
+    GLuint old[2] = {m_particleBuffer[0], m_particleBuffer[1]};
+    const int oldCapacity = m_capacity;
+    m_capacity = capacity;
+    createBuffers();
+
+    // like ParticleEmitter, the transform feedback objects keep their
+    // vertex counts, only the contents need copying
+    for(int i = 0; i < 2; i++){
+        glBindBuffer(GL_COPY_READ_BUFFER, old[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_particleBuffer[i]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * sizeof(BatchParticle));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(2, old);
+}
+
+void EmitterBatch::recordWritten(int written, int emitters)
+{
+    m_liveParticles = std::max(written - emitters, 0);
+
+    // a full buffer means transform feedback has (probably) dropped records
+    if(written >= m_capacity){
+        m_overflowed = true;
+        if(autoGrow && m_capacity < maxCapacity){
+            growBuffers(std::min(m_capacity * 2, maxCapacity));
+        }
+    }
+}
+
+void EmitterBatch::setupAttributes(GLuint vao, GLuint buffer)
+{
+    glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            for(int i = 0; i < 5; i++) glEnableVertexAttribArray(i);
+            glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(BatchParticle), (void*)(offsetof(BatchParticle, type))); // type
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BatchParticle), (void*)(offsetof(BatchParticle, pos))); // position
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(BatchParticle), (void*)(offsetof(BatchParticle, vel))); // velocity
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(BatchParticle), (void*)(offsetof(BatchParticle, age))); // lifetime
+            glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(BatchParticle), (void*)(offsetof(BatchParticle, emitter))); // emitter index
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void EmitterBatch::initShaders()
+{
+    asset_registry& assets = asset_registry::shared();
+    asset_registry::program_desc updateDesc;
+    updateDesc.stages = {{GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_batch_update_vertex.glsl")},
+                         {GL_GEOMETRY_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_batch_update_geometry.glsl")}};
+    updateDesc.defines = {"PARAM_STRIDE " + std::to_string(paramStride)};
+    updateDesc.varyings = {"type1", "position1", "velocity1", "age1", "emitter1"};
+    updateShader = assets.acquire_program(updateDesc);
+
+    asset_registry::program_desc renderDesc;
+    renderDesc.stages = {{GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_batch_render_vertex.glsl")},
+                         {GL_GEOMETRY_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_batch_render_point_to_quad.glsl")},
+                         {GL_FRAGMENT_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_batch_render_fragment.glsl")}};
+    renderDesc.defines = {"PARAM_STRIDE " + std::to_string(paramStride)};
+    renderShader = assets.acquire_program(renderDesc);
+
+    m_updateDelta = updateShader.uniform("delta");
+    m_updateEmitterCount = updateShader.uniform("emitterCount");
+    m_updateFieldTransform = updateShader.uniform("forceFieldTransform");
+    m_updateFieldStrength = updateShader.uniform("forceFieldStrength");
+    m_renderProjection = renderShader.uniform("uProjectionMatrix");
+    m_renderModelView = renderShader.uniform("uModelViewMatrix");
+
+    // the samplers never change, so they are set once here
+    updateShader.use();
+    updateShader.set(updateShader.uniform("uEmitterParams"), 0);
+    updateShader.set(updateShader.uniform("spawnMesh"), 1);
+    updateShader.set(updateShader.uniform("forceField"), 2);
+    renderShader.use();
+    renderShader.set(renderShader.uniform("uEmitterParams"), 0);
+    renderShader.set(renderShader.uniform("uText"), 1);
+    renderShader.set(renderShader.uniform("uCurves"), 2);
+    glUseProgram(0);
+}
+
+void EmitterBatch::update(const std::vector<ParticleEmitter*>& emitters, double delta)
+{
+    pollWrittenQuery();
+
+    const int count = emitters.size();
+
+    // -- spawn meshes --
+    m_meshScratch.clear();
+    for(ParticleEmitter* pe : emitters){
+        const MeshSurfaceSampler* mesh = pe->spawnMesh;
+        if(pe->spawnShape == SpawnMeshSurface && mesh && mesh->triangles() > 0){
+            m_meshScratch.push_back(MeshSource{mesh->buffer(), mesh->version(), mesh->triangles()});
+        }
+    }
+    if(m_meshScratch != m_meshSources){
+        int total = 0;
+        for(const MeshSource& m : m_meshScratch) total += m.triangles;
+
+        // three texels a triangle, see MeshSurfaceSampler
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_meshBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, std::max(total * 3, 1) * sizeof(vec4), nullptr, GL_STATIC_DRAW);
+        int first = 0;
+        for(const MeshSource& m : m_meshScratch){
+            glBindBuffer(GL_COPY_READ_BUFFER, m.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, first * 3 * sizeof(vec4), m.triangles * 3 * sizeof(vec4));
+            first += m.triangles;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        std::swap(m_meshSources, m_meshScratch);
+    }
+
+    // -- pack every emitter's parameters --
+    m_params.resize(std::max(count, 1) * paramStride);
+    m_colliderTexels.clear();
+    int meshFirst = 0;
+    for(int i = 0; i < count; i++){
+        ParticleEmitter& pe = *emitters[i];
+        const ParticleSimParams p = pe.takeParams(delta);
+        vec4* t = &m_params[i * paramStride];
+        t[0] = vec4(p.emitterVelocity, p.emitterSpeed);
+        t[1] = vec4(p.updatePos, p.shouldUpdatePosition);
+        t[2] = vec4(p.initVelocity, p.initSpeed);
+        t[3] = vec4(p.velVariance, p.spawnRadius);
+        t[4] = vec4(p.constForceDir, p.constForceStrength);
+        t[5] = vec4(p.emitCount, p.lifeTime, p.dragStrength, p.randIterator);
+        // only uploaded when they change
+        m_curves.set(i, pe.lifetimeCurves());
+
+        // in the same order as the copies above
+        int meshTriangles = 0;
+        if(p.spawnShape == SpawnMeshSurface && p.spawnMesh){
+            meshTriangles = p.spawnMesh->triangles();
+        }
+        t[6] = vec4(p.spawnShape, p.coneAngle, meshFirst, meshTriangles);
+        t[7] = vec4(p.spawnMeshBasis[0], 0);
+        t[8] = vec4(p.spawnMeshBasis[1], 0);
+        t[9] = vec4(p.spawnMeshBasis[2], 0);
+        meshFirst += meshTriangles;
+
+        const int colliders = p.activeColliders();
+        t[10] = vec4(p.collision, p.restitution, m_params.size() + m_colliderTexels.size(), colliders);
+        m_colliderTexels.insert(m_colliderTexels.end(), p.colliders, p.colliders + colliders);
+    }
+    m_params.insert(m_params.end(), m_colliderTexels.begin(), m_colliderTexels.end());
+
+    // orphan and refill, the previous frame's draw may still be reading it
+    glBindBuffer(GL_TEXTURE_BUFFER, m_paramBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_params.size() * sizeof(vec4), m_params.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // -- emitter records for emitters new to the batch --
+    m_spawnRecords.clear();
+    for(int i = std::min(m_emitterCount, count); i < count; i++){
+        m_spawnRecords.push_back(BatchParticle{1, vec3(0), vec3(0), 0, GLfloat(i)});
+    }
+    if(!m_spawnRecords.empty()){
+        glBindBuffer(GL_ARRAY_BUFFER, m_spawnBuffer);
+        glBufferData(GL_ARRAY_BUFFER, m_spawnRecords.size() * sizeof(BatchParticle), m_spawnRecords.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    m_emitterCount = count;
+
+    // -- one transform feedback pass for everything --
+    glEnable(GL_RASTERIZER_DISCARD);
+    updateShader.use();
+    updateShader.set(m_updateDelta, float(delta));
+    updateShader.set(m_updateEmitterCount, count);
+    const ForceField3D* field = forceField && forceField->baked() ? forceField : nullptr;
+    updateShader.set(m_updateFieldStrength, field ? field->strength : 0.0f);
+    if(field){
+        updateShader.set(m_updateFieldTransform, field->worldToField());
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, field->texture());
+    }
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, m_meshTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_paramTexture);
+
+    if(sortMode == ParticleSort::Gpu && ParticleSort::gpuSupported()){
+        // the sort keys every slot, stale records past this pass's output
+        // mustn't look like particles
+        glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[m_currWriteBuff]);
+        glClearBufferData(GL_ARRAY_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    // sorting on the CPU reads the records back, so needs their count now,
+    // otherwise it's only for liveParticles() and can come in a frame late
+    const bool countRecords = sortMode == ParticleSort::Cpu;
+    const bool countLater = !countRecords && !m_queryPending;
+    if(countRecords || countLater){
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, m_writtenQuery);
+    }
+
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_transformFeedback[m_currWriteBuff]);
+    glBeginTransformFeedback(GL_POINTS);
+    if(m_hasRecords){
+        glBindVertexArray(updateVao[m_currReadBuff]);
+        glDrawTransformFeedback(GL_POINTS, m_transformFeedback[m_currReadBuff]);
+    }
+    if(!m_spawnRecords.empty()){
+        glBindVertexArray(m_spawnVao);
+        glDrawArrays(GL_POINTS, 0, m_spawnRecords.size());
+    }
+    glEndTransformFeedback();
+    m_hasRecords = true;
+
+    m_writtenRecords = -1;
+    if(countRecords){
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        GLuint written = 0;
+        glGetQueryObjectuiv(m_writtenQuery, GL_QUERY_RESULT, &written);
+        m_writtenRecords = written;
+        m_queryPending = false;
+        recordWritten(written, count);
+    }else if(countLater){
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        m_queryPending = true;
+        m_queryEmitters = count;
+    }
+
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void EmitterBatch::pollWrittenQuery()
+{
+    if(!m_queryPending) return;
+
+    GLuint available = 0;
+    glGetQueryObjectuiv(m_writtenQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available) return;
+
+    GLuint written = 0;
+    glGetQueryObjectuiv(m_writtenQuery, GL_QUERY_RESULT, &written);
+    m_queryPending = false;
+    recordWritten(written, m_queryEmitters);
+}
+
+void EmitterBatch::render(const mat4& view, const mat4 proj)
+{
+    if(!m_hasRecords) return;
+
+    // sorts before the render program is bound, they use their own
+    bool sorted = false;
+    if(sortMode == ParticleSort::Cpu && m_writtenRecords >= 0){
+        m_sortRecords.resize(m_writtenRecords * batchLayout.stride);
+        glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[m_currWriteBuff]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, m_sortRecords.size() * sizeof(float), m_sortRecords.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_sorter.sortCpu(m_sortRecords.data(), m_writtenRecords, view);
+        sorted = true;
+    }else if(sortMode == ParticleSort::Gpu && ParticleSort::gpuSupported()){
+        m_sorter.sortGpu(m_particleBuffer[m_currWriteBuff], m_capacity, view);
+        sorted = true;
+    }
+
+    glBindVertexArray(renderVao[m_currWriteBuff]);
+    renderShader.use();
+    glEnable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    // same blending as ParticleEmitter
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    renderShader.set(m_renderProjection, proj);
+    renderShader.set(m_renderModelView, view);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_paramTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D_ARRAY, m_curves.texture());
+
+    if(sorted){
+        m_sorter.draw();
+    }else{
+        glDrawTransformFeedback(GL_POINTS, m_transformFeedback[m_currWriteBuff]);
+    }
+
+    glBindTexture(GL_TEXTURE_1D_ARRAY, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(0);
+    glBindVertexArray(0);
+
+    m_currReadBuff = m_currWriteBuff;
+    m_currWriteBuff = (m_currWriteBuff + 1) & 0x1;
+}
+
+void EmitterBatch::destroy()
+{
+    glDeleteVertexArrays(2, renderVao);
+    glDeleteVertexArrays(2, updateVao);
+    glDeleteVertexArrays(1, &m_spawnVao);
+    glDeleteBuffers(2, m_particleBuffer);
+    glDeleteBuffers(1, &m_spawnBuffer);
+    glDeleteBuffers(1, &m_paramBuffer);
+    glDeleteTextures(1, &m_paramTexture);
+    glDeleteBuffers(1, &m_meshBuffer);
+    glDeleteTextures(1, &m_meshTexture);
+    m_curves.destroy();
+    asset_registry::shared().release_texture(texture);
+    asset_registry::shared().release_program(updateShader);
+    asset_registry::shared().release_program(renderShader);
+    updateShader = renderShader = program();
+    glDeleteTransformFeedbacks(2, m_transformFeedback);
+    glDeleteQueries(1, &m_writtenQuery);
+    m_sorter.destroy();
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+// std
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "cgra/cgra_shader.hpp"
+#include "ParticleCurves.hpp"
+#include "ParticleEmitter.hpp"
+#include "ParticleSort.hpp"
+
+
+// Simulates and draws the particles of many emitters together. Every
+// emitter's records live in one pair of shared transform feedback buffers,
+// tagged with the emitter's index, and the per emitter parameters go into a
+// texture buffer. So all of them update in a single pass and render in a
+// single draw, instead of a pass, a draw and a round of uniforms each.
+//
+// The emitters only provide parameters, their own buffers are unused.
+// Emitters are identified by their index in the list passed to update(),
+// so it must stay stable between frames. Emitters added to the end get a
+// new emitter record, and any dropped off the end are removed.
+class EmitterBatch
+{
+private:
+    struct BatchParticle {
+        GLfloat type;
+        glm::vec3 pos;
+        glm::vec3 vel;
+        GLfloat age;
+        GLfloat emitter;
+    };
+
+    int m_capacity;
+
+    bool m_hasRecords = false;
+    unsigned int m_currReadBuff = 0;
+    unsigned int m_currWriteBuff = 1;
+
+    GLuint m_particleBuffer[2];
+    GLuint m_transformFeedback[2];
+    GLuint updateVao[2];
+    GLuint renderVao[2];
+
+    // records for emitters joining the batch, drawn in the same pass
+    GLuint m_spawnBuffer;
+    GLuint m_spawnVao;
+    std::vector<BatchParticle> m_spawnRecords;
+    int m_emitterCount = 0; // emitters that have a record in the buffers
+
+    GLuint m_paramBuffer;
+    GLuint m_paramTexture;
+    std::vector<glm::vec4> m_params;
+    std::vector<glm::vec4> m_colliderTexels;
+
+    // the spawn meshes' alias tables copied end to end, recopied whenever
+    // one of them changes (buffer name, version and size, in emitter order)
+    struct MeshSource {
+        GLuint buffer;
+        int version;
+        int triangles;
+        bool operator==(const MeshSource& o) const {
+            return buffer == o.buffer && version == o.version && triangles == o.triangles;
+        }
+    };
+    GLuint m_meshBuffer;
+    GLuint m_meshTexture;
+    std::vector<MeshSource> m_meshSources;
+    std::vector<MeshSource> m_meshScratch;
+
+    // every emitter's lifetime curves, a layer each in emitter order
+    ParticleCurveTexture m_curves;
+
+    cgra::program updateShader;
+    cgra::program renderShader;
+    cgra::program::uniform_handle m_updateDelta;
+    cgra::program::uniform_handle m_updateEmitterCount;
+    cgra::program::uniform_handle m_updateFieldTransform;
+    cgra::program::uniform_handle m_updateFieldStrength;
+    cgra::program::uniform_handle m_renderProjection;
+    cgra::program::uniform_handle m_renderModelView;
+
+    GLuint texture;
+
+    ParticleSort m_sorter;
+    std::vector<float> m_sortRecords;
+    GLuint m_writtenQuery;
+    int m_writtenRecords = -1; // only counted when sorting on the CPU
+    bool m_queryPending = false;
+    int m_queryEmitters = 0; // emitter records in the pending count
+    int m_liveParticles = 0;
+    bool m_overflowed = false;
+
+    void initShaders();
+    void createBuffers();
+    // reallocates both buffers at the new capacity, keeping their records
+    void growBuffers(int capacity);
+    // the count from a written query, the emitters' own records included
+    void recordWritten(int written, int emitters);
+    static void setupAttributes(GLuint vao, GLuint buffer);
+    void pollWrittenQuery();
+
+public:
+    // Draw back to front across all the emitters, see ParticleSort.
+    ParticleSort::Mode sortMode = ParticleSort::None;
+    // one field for every emitter in the batch, theirs are ignored
+    const ForceField3D* forceField = nullptr;
+    // grow the shared buffers when they fill up, doubling up to maxCapacity
+    // records
+    bool autoGrow = true;
+    int maxCapacity = 1 << 22;
+
+    EmitterBatch(int capacity = 1 << 16);
+
+    void init();
+    void update(const std::vector<ParticleEmitter*>& emitters, double delta);
+    void render(const glm::mat4& view, const glm::mat4 proj);
+    void destroy();
+
+    int emitterCount() const { return m_emitterCount; }
+    int capacity() const { return m_capacity; }
+    // The buffers have been full at some point, so records were dropped.
+    // The dropped ones can include emitter records, which stops those
+    // emitters for good.
+    bool hasOverflowed() const { return m_overflowed; }
+    // particles across all the emitters, from a recent update
+    int liveParticles() const { return m_liveParticles; }
+    // curve rows uploaded so far, they only go up when a curve changes
+    int curveUploads() const { return m_curves.uploads(); }
+};
@@ -0,0 +1,128 @@
+#include "ForceField3D.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// glm
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PerlinNoise.hpp"
+
+using namespace glm;
+using namespace std;
+
+
+void ForceField3D::bake(int resolution, float frequency, int octaves, std::uint32_t seed)
+{
+    const auto start = chrono::steady_clock::now();
+    const int n = std::max(resolution, 2);
+    const siv::PerlinNoise perlin(seed);
+
+    // the potential, one noise per component, offset so they're unrelated
+    auto potential = [&](vec3 p){
+        p *= frequency;
+        return vec3(
+            perlin.octave3D(p.x, p.y, p.z, octaves),
+            perlin.octave3D(p.x + 31.7, p.y - 11.3, p.z + 53.1, octaves),
+            perlin.octave3D(p.x - 47.9, p.y + 23.5, p.z - 17.3, octaves));
+    };
+
+    // -- tiling potential --
+    // every axis fades from the noise at p to the noise a tile back, so the
+    // value at 1 is the value at 0
+    vector<vec3> psi(size_t(n) * n * n);
+#pragma omp parallel for schedule(static)
+    for(int z = 0; z < n; z++){
+        for(int y = 0; y < n; y++){
+            for(int x = 0; x < n; x++){
+                const vec3 p = vec3(x, y, z) / float(n);
+                vec3 sum(0);
+                for(int c = 0; c < 8; c++){
+                    const vec3 corner((c & 1), (c >> 1) & 1, (c >> 2) & 1);
+                    const vec3 w = mix(1.0f - p, p, corner);
+                    sum += w.x * w.y * w.z * potential(p - corner);
+                }
+                psi[(size_t(z) * n + y) * n + x] = sum;
+            }
+        }
+    }
+
+    // -- curl, central differences wrapping around the tile --
+    m_field.assign(psi.size(), vec3(0));
+    auto at = [&](int x, int y, int z) -> const vec3& {
+        x = (x + n) % n;
+        y = (y + n) % n;
+        z = (z + n) % n;
+        return psi[(size_t(z) * n + y) * n + x];
+    };
+    float maxLength = 0;
+#pragma omp parallel for schedule(static) reduction(max : maxLength)
+    for(int z = 0; z < n; z++){
+        for(int y = 0; y < n; y++){
+            for(int x = 0; x < n; x++){
+                const vec3 dx = at(x + 1, y, z) - at(x - 1, y, z);
+                const vec3 dy = at(x, y + 1, z) - at(x, y - 1, z);
+                const vec3 dz = at(x, y, z + 1) - at(x, y, z - 1);
+                const vec3 v(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+                m_field[(size_t(z) * n + y) * n + x] = v;
+                maxLength = std::max(maxLength, length(v));
+            }
+        }
+    }
+    if(maxLength > 0){
+        for(vec3& v : m_field) v /= maxLength;
+    }
+    m_resolution = n;
+
+    if(m_texture == 0) glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, n, n, n, 0, GL_RGB, GL_FLOAT, m_field.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    m_bakeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void ForceField3D::update(double delta)
+{
+    // kept within a tile, it repeats anyway and floats lose precision
+    m_scroll = fract(m_scroll + scrollVelocity * float(delta));
+}
+
+mat4 ForceField3D::worldToField() const
+{
+    return translate(mat4(1), m_scroll) * inverse(transform);
+}
+
+vec3 ForceField3D::sample(const vec3& world) const
+{
+    if(m_resolution == 0) return vec3(0);
+    const int n = m_resolution;
+
+    // texel centres are at (i + 0.5) / n, like GL_LINEAR
+    const vec3 t = vec3(worldToField() * vec4(world, 1)) * float(n) - 0.5f;
+    const vec3 base = floor(t);
+    const vec3 f = t - base;
+    const ivec3 i0 = ivec3(base);
+
+    vec3 sum(0);
+    for(int c = 0; c < 8; c++){
+        const ivec3 corner((c & 1), (c >> 1) & 1, (c >> 2) & 1);
+        const ivec3 i = ((i0 + corner) % n + n) % n;
+        const vec3 w = mix(1.0f - f, f, vec3(corner));
+        sum += w.x * w.y * w.z * m_field[(size_t(i.z) * n + i.y) * n + i.x];
+    }
+    return sum * strength;
+}
+
+void ForceField3D::destroy()
+{
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+
+
+// A turbulent velocity field for particles to be pushed around by, baked
+// once into a 3D texture so the update shaders pay a single filtered fetch
+// per particle instead of evaluating noise.
+//
+// The field is the curl of a vector potential made of three octave Perlin
+// noises, so it is divergence free: particles swirl around rather than
+// bunching up in sinks. The potential is cross faded with its copies one
+// tile over on every axis, so the field tiles (GL_REPEAT) and can be
+// scrolled or stretched over any area without seams.
+class ForceField3D
+{
+private:
+    int m_resolution = 0;
+    std::vector<glm::vec3> m_field; // x fastest, max length 1
+    glm::vec3 m_scroll = glm::vec3(0);
+    double m_bakeMs = 0;
+
+    GLuint m_texture = 0;
+
+public:
+    // one tile of the field ([0, 1] texture space) to world space
+    glm::mat4 transform = glm::mat4(1);
+    // acceleration at the field's strongest point
+    float strength = 1;
+    // texture space units per second the field moves through the tile
+    glm::vec3 scrollVelocity = glm::vec3(0);
+
+    // Rebakes at resolution^3 texels. frequency is in noise cells per tile.
+    void bake(int resolution = 32, float frequency = 4, int octaves = 2,
+              std::uint32_t seed = 0);
+    // advances the scroll
+    void update(double delta);
+
+    // world space to texture coordinates, scroll included
+    glm::mat4 worldToField() const;
+    // The trilinear, repeating lookup the shaders do, in world space and
+    // scaled by strength.
+    glm::vec3 sample(const glm::vec3& world) const;
+
+    bool baked() const { return m_texture != 0; }
+    GLuint texture() const { return m_texture; }
+    int resolution() const { return m_resolution; }
+    double bakeMilliseconds() const { return m_bakeMs; }
+
+    void destroy();
+};
@@ -0,0 +1,106 @@
+#include "MeshSurfaceSampler.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+using namespace glm;
+using namespace std;
+
+
+void MeshSurfaceSampler::build(const cgra::mesh_builder& mb)
+{
+    const auto& vertices = mb.vertices;
+    const auto& indices = mb.indices;
+    const int meshTriangles = indices.size() / 3;
+
+    // stay within the texture buffer, spread over the whole mesh
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    const int maxTriangles = std::max(maxTexels / 3, 1);
+    const int stride = (meshTriangles + maxTriangles - 1) / maxTriangles;
+    const int n = stride > 0 ? meshTriangles / stride : 0;
+
+    vector<float> area(n);
+    m_texels.assign(n * 3, vec4(0));
+    double total = 0;
+    for(int i = 0; i < n; i++){
+        const unsigned int* tri = &indices[i * stride * 3];
+        const vec3 a = vertices[tri[0]].pos;
+        const vec3 b = vertices[tri[1]].pos;
+        const vec3 c = vertices[tri[2]].pos;
+        area[i] = 0.5f * length(cross(b - a, c - a));
+        total += area[i];
+        m_texels[i * 3 + 0] = vec4(a, 1);
+        m_texels[i * 3 + 1] = vec4(b, float(i));
+        m_texels[i * 3 + 2] = vec4(c, 0);
+    }
+
+    // -- alias table (Vose) --
+    // every column holds its triangle's share scaled so the average is 1,
+    // columns under 1 are topped up from one over 1, its alias
+    vector<float> prob(n);
+    vector<int> small, large;
+    for(int i = 0; i < n; i++){
+        prob[i] = total > 0 ? float(area[i] * n / total) : 1;
+        (prob[i] < 1 ? small : large).push_back(i);
+    }
+    while(!small.empty() && !large.empty()){
+        const int s = small.back();
+        small.pop_back();
+        const int l = large.back();
+        m_texels[s * 3 + 1].w = float(l);
+        prob[l] -= 1 - prob[s];
+        if(prob[l] < 1){
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // whatever is left is 1 up to rounding
+    for(int i : small) prob[i] = 1;
+    for(int i : large) prob[i] = 1;
+    for(int i = 0; i < n; i++){
+        m_texels[i * 3].w = prob[i];
+    }
+
+    m_triangles = n;
+    m_area = total;
+    m_version++;
+
+    if(m_buffer == 0){
+        glGenBuffers(1, &m_buffer);
+        glGenTextures(1, &m_texture);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(m_texels.size(), 1) * sizeof(vec4), m_texels.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+vec3 MeshSurfaceSampler::sample(float u, float s, float t) const
+{
+    if(m_triangles == 0) return vec3(0);
+
+    // the same steps as sampleSurface() in the update shaders
+    const float column = u * m_triangles;
+    int tri = std::min(int(column), m_triangles - 1);
+    if(column - std::floor(column) >= m_texels[tri * 3].w){
+        tri = int(m_texels[tri * 3 + 1].w);
+    }
+    const vec3 a = vec3(m_texels[tri * 3 + 0]);
+    const vec3 b = vec3(m_texels[tri * 3 + 1]);
+    const vec3 c = vec3(m_texels[tri * 3 + 2]);
+
+    // square root, or points bunch up at a
+    const float r = std::sqrt(s);
+    return a * (1 - r) + b * (r * (1 - t)) + c * (r * t);
+}
+
+void MeshSurfaceSampler::destroy()
+{
+    glDeleteTextures(1, &m_texture);
+    glDeleteBuffers(1, &m_buffer);
+    m_texture = m_buffer = 0;
+}
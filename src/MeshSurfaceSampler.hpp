@@ -0,0 +1,53 @@
+#pragma once
+
+// std
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "cgra/cgra_mesh.hpp"
+
+
+// Picks points uniformly over the surface of a triangle mesh, for particles
+// spawning off it. Triangles are chosen in proportion to their area with a
+// Walker alias table, so a sample costs the same whatever the mesh: one
+// random number picks a column and whether to take the column's triangle
+// or its alias, two more place the point inside the triangle.
+//
+// The table is also uploaded as a texture buffer (RGBA32F) for the update
+// shaders, three texels per triangle:
+//  0: corner a, probability of keeping this triangle
+//  1: corner b, index of the alias triangle
+//  2: corner c, unused
+class MeshSurfaceSampler
+{
+private:
+    std::vector<glm::vec4> m_texels;
+    int m_triangles = 0;
+    float m_area = 0;
+    int m_version = 0;
+
+    GLuint m_buffer = 0;
+    GLuint m_texture = 0;
+
+public:
+    // Rebuilds the table from the triangles of mb (GL_TRIANGLES) and uploads
+    // it. Too big a mesh for a texture buffer keeps every n-th triangle.
+    void build(const cgra::mesh_builder& mb);
+
+    // The point the shaders pick for random numbers u, s and t in [0, 1),
+    // in the mesh's space.
+    glm::vec3 sample(float u, float s, float t) const;
+
+    int triangles() const { return m_triangles; }
+    float area() const { return m_area; }
+    // bumped by every build, for copies of the table to notice
+    int version() const { return m_version; }
+    GLuint buffer() const { return m_buffer; }
+    GLuint texture() const { return m_texture; }
+
+    // Copies share the GL objects, so only for the last one.
+    void destroy();
+};
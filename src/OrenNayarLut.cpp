@@ -0,0 +1,65 @@
+#include "OrenNayarLut.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace glm;
+using namespace std;
+
+
+vec4 OrenNayarLut::terms(float nl, float nv)
+{
+    const double PI = 3.14159265358979323846;
+    const double cosI = glm::clamp(double(nl), 0.0, 1.0);
+    const double cosR = glm::clamp(double(nv), 0.0, 1.0);
+    // no light arrives, the shader skips these fragments as well
+    if(cosI == 0) return vec4(0);
+
+    const double thetaI = acos(cosI);
+    const double thetaR = acos(cosR);
+    const double alpha = std::max(thetaI, thetaR);
+    const double beta = std::min(thetaI, thetaR);
+
+    const double tanBeta = tan(beta);
+    const double sinAlpha = sin(alpha);
+    const double beta2 = 2 * beta / PI;
+    const double ab = 4 * alpha * beta / (PI * PI);
+    return vec4(
+        cosI * sinAlpha * tanBeta,
+        cosI * (sinAlpha - beta2 * beta2 * beta2) * tanBeta,
+        cosI * ab * ab * tan((alpha + beta) / 2),
+        cosI * beta2 * beta2);
+}
+
+void OrenNayarLut::bake(int resolution)
+{
+    const auto start = chrono::steady_clock::now();
+    const int n = std::max(resolution, 2);
+
+    m_texels.resize(size_t(n) * n);
+    for(int y = 0; y < n; y++){
+        for(int x = 0; x < n; x++){
+            m_texels[size_t(y) * n + x] = terms(float(x) / (n - 1), float(y) / (n - 1));
+        }
+    }
+    m_resolution = n;
+
+    if(!m_texture) glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, n, n, 0, GL_RGBA, GL_FLOAT, m_texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_bakeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void OrenNayarLut::destroy()
+{
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+}
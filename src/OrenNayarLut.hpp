@@ -0,0 +1,52 @@
+#pragma once
+
+// std
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+
+
+// The angular part of the Oren-Nayar model (see res/shaders/oren_nayar.glsl)
+// baked into a 2D texture over (N.L, N.V), for the shader's lookup table
+// tier. Every term of the model is a function of the two polar angles, times
+// a factor of the roughness alone, times 1, cos(phi) or |cos(phi)| of the
+// azimuth between the light and the viewer. The polar functions go in the
+// table, the roughness factors and cos(phi) (a dot product) are worked out
+// per fragment, so one fetch replaces the acos, atan, tan and pow calls and
+// the table holds for any roughness.
+//
+// Per texel, with theta_i = acos(N.L), theta_r = acos(N.V), alpha the larger
+// and beta the smaller, all multiplied by N.L so they stay bounded at
+// grazing angles:
+//  r  sin(alpha) tan(beta)                    C_2 term, cos(phi) >= 0
+//  g  (sin(alpha) - (2 beta / pi)^3) tan(beta)  C_2 term, cos(phi) < 0
+//  b  (4 alpha beta / pi^2)^2 tan((alpha + beta) / 2)  C_3 term
+//  a  (2 beta / pi)^2                          interreflection (L_2)
+class OrenNayarLut
+{
+private:
+    int m_resolution = 0;
+    std::vector<glm::vec4> m_texels; // N.L fastest
+    double m_bakeMs = 0;
+
+    GLuint m_texture = 0;
+
+public:
+    // the texel at (N.L, N.V), both clamped to [0, 1]
+    static glm::vec4 terms(float nl, float nv);
+
+    // Rebakes at resolution^2 texels, the first and last of each axis at
+    // exactly 0 and 1.
+    void bake(int resolution = 64);
+
+    bool baked() const { return m_texture != 0; }
+    // RGBA16F, linear filtered and clamped
+    GLuint texture() const { return m_texture; }
+    int resolution() const { return m_resolution; }
+    double bakeMilliseconds() const { return m_bakeMs; }
+
+    void destroy();
+};
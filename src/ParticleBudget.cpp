@@ -0,0 +1,110 @@
+#include "ParticleBudget.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+// glm
+#include <glm/gtc/constants.hpp>
+
+using namespace glm;
+
+
+void ParticleBudget::apportion(const std::vector<Entry>& entries, int measuredLive,
+    const mat4& view, const mat4& proj, float viewportHeight)
+{
+    const int count = entries.size();
+    m_weights.assign(count, 0);
+    m_demand.assign(count, 0);
+    m_measured = measuredLive;
+
+    // -- feedback --
+    // only while the budget is what limits the emitters, otherwise the
+    // count is under the limit because nothing asks for more
+    const float target = std::max(maxLiveParticles, 1);
+    if(enabled && m_allocated < m_demanded){
+        m_correction *= 1 + feedbackGain * (target - measuredLive) / target;
+        m_correction = clamp(m_correction, 0.25f, 4.0f);
+    }
+
+    // -- weight and demand of every emitter --
+    const float sx = proj[0][0];
+    const float sy = proj[1][1];
+    const float screenArea = viewportHeight * viewportHeight * sy / sx;
+    float demanded = 0;
+    for(int i = 0; i < count; i++){
+        const ParticleEmitter& pe = *entries[i].emitter;
+        // one-off bursts aren't on a rate, scaling can't touch them
+        if(pe.isOneOff || pe.emitTime <= 0) continue;
+
+        m_demand[i] = float(pe.emitCount) / pe.emitTime * pe.lifeTime;
+        demanded += m_demand[i];
+
+        // a sphere around the emitter as big as its spawn area plus a
+        // billboard, roughly tested against the frustum
+        const vec3 p = vec3(view * vec4(entries[i].position, 1));
+        const float radius = pe.spawnRadius + pe.initBillboardSize;
+        const float depth = -p.z;
+        if(depth < -radius) continue;
+        const float d = std::max(depth, 0.1f);
+        if(std::abs(p.x) * sx > d + radius * sx || std::abs(p.y) * sy > d + radius * sy) continue;
+
+        const float pixels = radius * sy * 0.5f * viewportHeight / d;
+        const float coverage = std::min(pi<float>() * pixels * pixels, screenArea);
+        m_weights[i] = std::max(coverage, minCoverage);
+    }
+    m_demanded = demanded;
+
+    if(!enabled){
+        release(entries);
+        m_allocated = demanded;
+        return;
+    }
+
+    // -- water fill --
+    // every emitter gets budget in proportion to its weight, but no more
+    // than it asks for, and what it doesn't use goes to the rest. Going
+    // through them by demand per weight, the cheap ones fill up first.
+    std::vector<int> order;
+    order.reserve(count);
+    float weight = 0;
+    for(int i = 0; i < count; i++){
+        if(m_demand[i] > 0 && m_weights[i] > 0){
+            order.push_back(i);
+            weight += m_weights[i];
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](int a, int b){
+        return m_demand[a] * m_weights[b] < m_demand[b] * m_weights[a];
+    });
+
+    float remaining = target * m_correction;
+    for(int i : order){
+        if(m_demand[i] * weight > remaining * m_weights[i]) break;
+        remaining -= m_demand[i];
+        weight -= m_weights[i];
+        m_weights[i] = -1; // full rate
+    }
+
+    float allocated = 0;
+    const float perWeight = weight > 0 ? std::max(remaining, 0.0f) / weight : 0;
+    for(int i = 0; i < count; i++){
+        ParticleEmitter& pe = *entries[i].emitter;
+        float scale = 0;
+        if(m_demand[i] <= 0 || m_weights[i] < 0){
+            scale = 1;
+        }else if(m_weights[i] > 0){
+            scale = std::min(perWeight * m_weights[i] / m_demand[i], 1.0f);
+        }
+        pe.emissionScale = scale;
+        allocated += scale * m_demand[i];
+    }
+    m_allocated = allocated;
+}
+
+void ParticleBudget::release(const std::vector<Entry>& entries)
+{
+    for(const Entry& e : entries){
+        e.emitter->emissionScale = 1;
+    }
+}
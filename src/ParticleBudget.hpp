@@ -0,0 +1,62 @@
+#pragma once
+
+// std
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "ParticleEmitter.hpp"
+
+
+// Keeps the particles of many emitters under one global limit. Every frame
+// the budget is shared out by how much of the screen each emitter's
+// particles cover, so near emitters keep their full rate and far or off
+// screen ones are thinned out, by setting each emitter's emissionScale.
+//
+// An emitter's share is turned into a rate through the live count it would
+// settle at (rate times lifetime), which is only an estimate: particles
+// age by a random step, and get dropped when buffers fill. So the measured
+// live total is fed back, and the budget handed out is corrected until the
+// measured count sits at maxLiveParticles.
+class ParticleBudget
+{
+public:
+    struct Entry {
+        ParticleEmitter* emitter;
+        glm::vec3 position; // where its particles are, in world space
+    };
+
+private:
+    std::vector<float> m_weights;
+    std::vector<float> m_demand;
+
+    float m_correction = 1;
+    int m_measured = 0;
+    float m_allocated = 0;
+    float m_demanded = 0;
+
+public:
+    bool enabled = true;
+    int maxLiveParticles = 40000;
+    // how fast the feedback corrects the estimate, per frame
+    float feedbackGain = 0.05;
+    // emitters covering less than this many pixels count as this many, so
+    // nothing on screen is starved completely
+    float minCoverage = 4;
+
+    // Sets emissionScale on every entry's emitter. measuredLive is the live
+    // particle total of the previous update, viewportHeight is in pixels.
+    void apportion(const std::vector<Entry>& entries, int measuredLive,
+        const glm::mat4& view, const glm::mat4& proj, float viewportHeight);
+
+    // every emitter's emissionScale back to 1
+    static void release(const std::vector<Entry>& entries);
+
+    int measuredLive() const { return m_measured; }
+    // particles handed out, after the feedback correction
+    float allocated() const { return m_allocated; }
+    // what the emitters would keep alive unscaled
+    float demanded() const { return m_demanded; }
+    float correction() const { return m_correction; }
+};
@@ -0,0 +1,32 @@
+#include "ParticleColliders.hpp"
+
+// std
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+
+void ParticleColliders::add(const vec3& centre, float radius)
+{
+    m_spheres.push_back(vec4(centre, radius));
+}
+
+void ParticleColliders::cull(const vec3& centre, float reach, vector<vec4>& out, int maxCount)
+{
+    m_candidates.clear();
+    for(int i = 0; i < int(m_spheres.size()); i++){
+        const float d = distance(centre, vec3(m_spheres[i]));
+        const float surface = d - m_spheres[i].w;
+        if(surface >= 0 && surface < reach){
+            m_candidates.emplace_back(surface, i);
+        }
+    }
+
+    const int n = std::min<int>(m_candidates.size(), std::max(maxCount, 0));
+    partial_sort(m_candidates.begin(), m_candidates.begin() + n, m_candidates.end());
+    out.clear();
+    for(int i = 0; i < n; i++){
+        out.push_back(m_spheres[m_candidates[i].second]);
+    }
+}
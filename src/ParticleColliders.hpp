@@ -0,0 +1,38 @@
+#pragma once
+
+// std
+#include <utility>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "ParticleSimCPU.hpp"
+
+
+// The spheres in the scene particles can collide with, gathered every frame
+// (the CenterBody and every asteroid's bounding sphere), and culled per
+// emitter down to the few its particles can reach. The update shaders test
+// every particle against every sphere they get, so the cull keeps that
+// cost at MAX_PARTICLE_COLLIDERS tests however many asteroids there are.
+class ParticleColliders
+{
+private:
+    std::vector<glm::vec4> m_spheres;
+    // surface distance and index, reused between culls
+    std::vector<std::pair<float, int>> m_candidates;
+
+public:
+    void clear() { m_spheres.clear(); }
+    void add(const glm::vec3& centre, float radius);
+
+    // Fills out with the spheres whose surface is within reach of centre,
+    // nearest first, at most maxCount of them. Spheres around centre are
+    // skipped, they're the emitter's own body and every particle would
+    // spawn inside it.
+    void cull(const glm::vec3& centre, float reach, std::vector<glm::vec4>& out,
+              int maxCount = MAX_PARTICLE_COLLIDERS);
+
+    int size() const { return m_spheres.size(); }
+    const std::vector<glm::vec4>& spheres() const { return m_spheres; }
+};
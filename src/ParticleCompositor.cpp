@@ -0,0 +1,202 @@
+#include "ParticleCompositor.hpp"
+#include "cgra/cgra_assets.hpp"
+
+// std
+#include <algorithm>
+
+using namespace glm;
+using namespace cgra;
+using namespace std;
+
+void ParticleCompositor::init()
+{
+    asset_registry& assets = asset_registry::shared();
+    asset_registry::program_desc depthDesc;
+    depthDesc.stages = {{GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_composite_vertex.glsl")},
+                        {GL_FRAGMENT_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_composite_depth_fragment.glsl")}};
+    depthShader = assets.acquire_program(depthDesc);
+
+    asset_registry::program_desc compositeDesc;
+    compositeDesc.stages = {{GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_composite_vertex.glsl")},
+                            {GL_FRAGMENT_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_composite_fragment.glsl")}};
+    compositeShader = assets.acquire_program(compositeDesc);
+
+    m_depthUniforms.scale = depthShader.uniform("scale");
+    m_compositeUniforms.depthParams = compositeShader.uniform("depthParams");
+    m_compositeUniforms.lowSize = compositeShader.uniform("lowSize");
+
+    // the samplers never change, so they are set once here
+    depthShader.use();
+    depthShader.set(depthShader.uniform("uFullDepth"), 0);
+    compositeShader.use();
+    compositeShader.set(compositeShader.uniform("uLowColor"), 0);
+    compositeShader.set(compositeShader.uniform("uLowDepth"), 1);
+    compositeShader.set(compositeShader.uniform("uFullDepth"), 2);
+    glUseProgram(0);
+
+    glGenFramebuffers(1, &m_fullDepthFbo);
+    glGenFramebuffers(1, &m_lowFbo);
+    glGenTextures(1, &m_fullDepth);
+    glGenTextures(1, &m_lowColor);
+    glGenTextures(1, &m_lowDepth);
+    glGenVertexArrays(1, &m_vao);
+    glGenQueries(2, m_timerQueries);
+}
+
+static void setupTexture(GLuint texture, GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    // everything is fetched with texelFetch, or filtered by hand
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ParticleCompositor::resize(int width, int height, int scale)
+{
+    if(width == m_width && height == m_height && scale == m_scale) return;
+    m_width = width;
+    m_height = height;
+    m_scale = scale;
+    const int lowWidth = std::max(width / scale, 1);
+    const int lowHeight = std::max(height / scale, 1);
+
+    // depth blits need matching formats, and GLFW's default framebuffer
+    // has 24 bits of depth and 8 of stencil
+    setupTexture(m_fullDepth, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fullDepthFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_fullDepth, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    // half floats, particles add up well past 8 bits of precision
+    setupTexture(m_lowColor, GL_RGBA16F, GL_RGBA, GL_FLOAT, lowWidth, lowHeight);
+    setupTexture(m_lowDepth, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, lowWidth, lowHeight);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_lowFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_lowColor, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_lowDepth, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ParticleCompositor::pollTimers()
+{
+    for(int i = 0; i < 2; i++){
+        if(!m_timerPending[i]) continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) continue;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(m_timerQueries[i], GL_QUERY_RESULT, &ns);
+        m_timerPending[i] = false;
+        double& ms = m_ms[m_timerMode[i]];
+        ms = ms == 0 ? ns / 1e6 : mix(ms, ns / 1e6, 0.1);
+    }
+}
+
+void ParticleCompositor::begin(int width, int height, const mat4& proj)
+{
+    if(!m_vao) init();
+    pollTimers();
+
+    // skip timing this frame if the query is still waiting on an old one
+    if(!m_timerPending[m_timer]){
+        glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[m_timer]);
+        m_timerMode[m_timer] = mode;
+        m_timerPending[m_timer] = true;
+        m_active = true;
+    }
+
+    if(mode == Full) return;
+
+    const int scale = mode == Half ? 2 : 4;
+    resize(width, height, scale);
+    // view depth = B / (A + ndc depth)
+    m_depthParams = vec2(proj[2][2], proj[3][2]);
+
+    // -- opaque depth --
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fullDepthFbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_lowFbo);
+    glViewport(0, 0, std::max(width / scale, 1), std::max(height / scale, 1));
+
+    // reduce it to the target, the shader writes depth for every pixel
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_ALWAYS);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    depthShader.use();
+    depthShader.set(m_depthUniforms.scale, scale);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_fullDepth);
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_LESS);
+
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void ParticleCompositor::end()
+{
+    if(mode != Full && m_width > 0){
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, m_width, m_height);
+
+        // the target holds premultiplied colour and coverage
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        compositeShader.use();
+        compositeShader.set(m_compositeUniforms.depthParams, m_depthParams);
+        compositeShader.set(m_compositeUniforms.lowSize, vec2(std::max(m_width / m_scale, 1), std::max(m_height / m_scale, 1)));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_lowColor);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_lowDepth);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, m_fullDepth);
+        glBindVertexArray(m_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+
+        for(int i = 2; i >= 0; i--){
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glUseProgram(0);
+        glDisable(GL_BLEND);
+    }
+
+    if(m_active){
+        glEndQuery(GL_TIME_ELAPSED);
+        m_timer = 1 - m_timer;
+        m_active = false;
+    }
+}
+
+void ParticleCompositor::destroy()
+{
+    if(!m_vao) return;
+    glDeleteFramebuffers(1, &m_fullDepthFbo);
+    glDeleteFramebuffers(1, &m_lowFbo);
+    glDeleteTextures(1, &m_fullDepth);
+    glDeleteTextures(1, &m_lowColor);
+    glDeleteTextures(1, &m_lowDepth);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteQueries(2, m_timerQueries);
+    asset_registry::shared().release_program(depthShader);
+    asset_registry::shared().release_program(compositeShader);
+    depthShader = compositeShader = program();
+    m_vao = 0;
+    m_width = m_height = 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "cgra/cgra_shader.hpp"
+
+
+// Renders particles into a reduced resolution target and composites them
+// back over the frame. Billboards are big, overlapping and blended, so fill
+// rate is what they cost, and a half resolution target has a quarter of
+// the pixels.
+//
+// begin() copies the opaque depth out of the default framebuffer, reduces
+// it to the target's size to depth test the particles against, and binds
+// the target. Everything drawn until end() lands in it, and end() blends
+// it over the default framebuffer with a depth aware (bilateral) upsample,
+// so particles don't bleed across the edges of the geometry in front.
+//
+// The time from begin() to end() is measured on the GPU for every mode, so
+// they can be compared on the same scene.
+class ParticleCompositor
+{
+public:
+    enum Mode { Full, Half, Quarter, ModeCount };
+
+private:
+    int m_width = 0, m_height = 0; // of the frame
+    int m_scale = 1;
+    bool m_active = false;
+
+    GLuint m_fullDepthFbo = 0;
+    GLuint m_fullDepth = 0;
+    GLuint m_lowFbo = 0;
+    GLuint m_lowColor = 0;
+    GLuint m_lowDepth = 0;
+    GLuint m_vao = 0;
+
+    cgra::program depthShader;
+    cgra::program compositeShader;
+    struct {
+        cgra::program::uniform_handle scale;
+    } m_depthUniforms;
+    struct {
+        cgra::program::uniform_handle depthParams, lowSize;
+    } m_compositeUniforms;
+    glm::vec2 m_depthParams; // to linearise depth, from the projection
+
+    // two queries in flight, so reading one never waits on the frame
+    // that's still being drawn
+    GLuint m_timerQueries[2] = {0, 0};
+    Mode m_timerMode[2];
+    bool m_timerPending[2] = {false, false};
+    int m_timer = 0;
+    double m_ms[ModeCount] = {0, 0, 0};
+
+    void init();
+    void resize(int width, int height, int scale);
+    void pollTimers();
+
+public:
+    Mode mode = Full;
+
+    // Redirects drawing to the particle target, proj is the frame's
+    // projection. Does nothing but start the timer in Full mode.
+    void begin(int width, int height, const glm::mat4& proj);
+    // Composites the particles over the default framebuffer.
+    void end();
+    void destroy();
+
+    // GPU time between begin() and end() the last time mode was used,
+    // smoothed over a few frames. 0 if it hasn't been measured yet.
+    double milliseconds(Mode m) const { return m_ms[m]; }
+};
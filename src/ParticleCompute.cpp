@@ -0,0 +1,249 @@
+#include "ParticleCompute.hpp"
+#include "ForceField3D.hpp"
+#include "MeshSurfaceSampler.hpp"
+#include "cgra/cgra_assets.hpp"
+
+// std
+#include <algorithm>
+#include <vector>
+
+using namespace glm;
+using namespace cgra;
+using namespace std;
+
+// Must match local_size_x in the shaders.
+static const int updateGroupSize = 256;
+static const int emitGroupSize = 64;
+
+// DrawArraysIndirectCommand
+struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+bool ParticleCompute::supported()
+{
+    return GLEW_VERSION_4_3;
+}
+
+void ParticleCompute::initShaders()
+{
+    // shared by every emitter simulating with compute shaders
+    asset_registry& assets = asset_registry::shared();
+    asset_registry::program_desc updateDesc;
+    updateDesc.stages = {{GL_COMPUTE_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_compute_update.glsl")}};
+    updateShader = assets.acquire_program(updateDesc);
+
+    asset_registry::program_desc emitDesc;
+    emitDesc.stages = {{GL_COMPUTE_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_compute_emit.glsl")}};
+    emitShader = assets.acquire_program(emitDesc);
+
+    auto& u = m_updateUniforms;
+    u.capacity = updateShader.uniform("capacity");
+    u.delta = updateShader.uniform("delta");
+    u.lifeTime = updateShader.uniform("lifeTime");
+    u.dragStrength = updateShader.uniform("dragStrength");
+    u.constForceDir = updateShader.uniform("constForceDir");
+    u.constForceStrength = updateShader.uniform("constForceStrength");
+    u.randIteratorIn = updateShader.uniform("randIteratorIn");
+    u.forceFieldTransform = updateShader.uniform("forceFieldTransform");
+    u.forceFieldStrength = updateShader.uniform("forceFieldStrength");
+    u.colliders = updateShader.uniform("colliders");
+    u.colliderCount = updateShader.uniform("colliderCount");
+    u.collision = updateShader.uniform("collision");
+    u.restitution = updateShader.uniform("restitution");
+    updateShader.use();
+    updateShader.set(updateShader.uniform("forceField"), 0);
+
+    auto& e = m_emitUniforms;
+    e.spawnCount = emitShader.uniform("spawnCount");
+    e.delta = emitShader.uniform("delta");
+    e.randIteratorIn = emitShader.uniform("randIteratorIn");
+    e.emitterPosition = emitShader.uniform("emitterPosition");
+    e.initVelocity = emitShader.uniform("initVelocity");
+    e.initSpeed = emitShader.uniform("initSpeed");
+    e.velVariance = emitShader.uniform("velVariance");
+    e.spawnRadius = emitShader.uniform("spawnRadius");
+    e.spawnShape = emitShader.uniform("spawnShape");
+    e.coneAngle = emitShader.uniform("coneAngle");
+    e.spawnMeshTriangles = emitShader.uniform("spawnMeshTriangles");
+    e.spawnMeshBasis = emitShader.uniform("spawnMeshBasis");
+    emitShader.use();
+    emitShader.set(emitShader.uniform("spawnMesh"), 0);
+    glUseProgram(0);
+}
+
+void ParticleCompute::reset(int capacity, const Particle& emitter)
+{
+    if(!m_initialised){
+        initShaders();
+        glGenBuffers(1, &m_poolBuffer);
+        glGenBuffers(1, &m_deadBuffer);
+        glGenBuffers(1, &m_aliveBuffer);
+        glGenBuffers(1, &m_drawBuffer);
+        glGenBuffers(1, &m_countBuffer);
+        glGenVertexArrays(1, &m_vao);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_countBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_initialised = true;
+    }
+    if(m_countFence){
+        glDeleteSync(m_countFence);
+        m_countFence = 0;
+    }
+
+    m_capacity = std::max(capacity, 1);
+    m_emitter = emitter;
+    m_liveParticles = 0;
+
+    // every slot dead, and all of them on the dead list
+    vector<GpuParticle> pool(m_capacity, GpuParticle{vec4(0), vec4(0)});
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_poolBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, pool.size() * sizeof(GpuParticle), pool.data(), GL_DYNAMIC_COPY);
+
+    vector<GLint> dead(m_capacity + 1);
+    dead[0] = m_capacity;
+    for(int i = 0; i < m_capacity; i++) dead[i + 1] = i;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_deadBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, dead.size() * sizeof(GLint), dead.data(), GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_aliveBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_capacity * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+    const DrawCommand command{0, 1, 0, 0};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawCommand), &command, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ParticleCompute::pollCount()
+{
+    if(!m_countFence) return;
+
+    // never wait, the count is only for display and budgeting
+    GLenum state = glClientWaitSync(m_countFence, 0, 0);
+    if(state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) return;
+    glDeleteSync(m_countFence);
+    m_countFence = 0;
+
+    GLuint count = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, m_countBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    m_liveParticles = count;
+}
+
+void ParticleCompute::update(const ParticleSimParams& params)
+{
+    pollCount();
+
+    const vec3 oldPosition = m_emitter.pos;
+    const int spawnCount = ParticleSimCPU::stepEmitter(m_emitter, params) ? std::min(params.emitCount, m_capacity) : 0;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_poolBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_deadBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_aliveBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_drawBuffer);
+
+    // the alive list is rebuilt from scratch every step
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(DrawCommand, count), sizeof(GLuint), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    updateShader.use();
+    updateShader.set(m_updateUniforms.capacity, m_capacity);
+    updateShader.set(m_updateUniforms.delta, params.delta);
+    updateShader.set(m_updateUniforms.lifeTime, params.lifeTime);
+    updateShader.set(m_updateUniforms.dragStrength, params.dragStrength);
+    updateShader.set(m_updateUniforms.constForceDir, params.constForceDir);
+    updateShader.set(m_updateUniforms.constForceStrength, params.constForceStrength);
+    updateShader.set(m_updateUniforms.randIteratorIn, params.randIterator);
+    const ForceField3D* field = params.forceField && params.forceField->baked() ? params.forceField : nullptr;
+    updateShader.set(m_updateUniforms.forceFieldStrength, field ? field->strength : 0.0f);
+    if(field){
+        updateShader.set(m_updateUniforms.forceFieldTransform, field->worldToField());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, field->texture());
+    }
+    const int colliders = params.activeColliders();
+    updateShader.set(m_updateUniforms.colliderCount, colliders);
+    updateShader.set(m_updateUniforms.collision, int(params.collision));
+    updateShader.set(m_updateUniforms.restitution, params.restitution);
+    updateShader.set(m_updateUniforms.colliders, params.colliders, colliders);
+    glDispatchCompute((m_capacity + updateGroupSize - 1) / updateGroupSize, 1, 1);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    if(spawnCount > 0){
+        // spawns need the slots freed by the update
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        emitShader.use();
+        emitShader.set(m_emitUniforms.spawnCount, spawnCount);
+        emitShader.set(m_emitUniforms.delta, params.delta);
+        emitShader.set(m_emitUniforms.randIteratorIn, params.randIterator);
+        emitShader.set(m_emitUniforms.emitterPosition, oldPosition);
+        emitShader.set(m_emitUniforms.initVelocity, params.initVelocity);
+        emitShader.set(m_emitUniforms.initSpeed, params.initSpeed);
+        emitShader.set(m_emitUniforms.velVariance, params.velVariance);
+        emitShader.set(m_emitUniforms.spawnRadius, params.spawnRadius);
+        emitShader.set(m_emitUniforms.spawnShape, int(params.spawnShape));
+        emitShader.set(m_emitUniforms.coneAngle, params.coneAngle);
+        emitShader.set(m_emitUniforms.spawnMeshTriangles, params.spawnMesh ? params.spawnMesh->triangles() : 0);
+        emitShader.set(m_emitUniforms.spawnMeshBasis, params.spawnMeshBasis);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, params.spawnMesh ? params.spawnMesh->texture() : 0);
+        glDispatchCompute((spawnCount + emitGroupSize - 1) / emitGroupSize, 1, 1);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    glUseProgram(0);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    if(!m_countFence){
+        glBindBuffer(GL_COPY_READ_BUFFER, m_drawBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_countBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(DrawCommand, count), 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_countFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    for(int i = 0; i < 4; i++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+}
+
+void ParticleCompute::draw()
+{
+    glBindVertexArray(m_vao);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_poolBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_aliveBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawBuffer);
+
+    glDrawArraysIndirect(GL_POINTS, nullptr);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, 0);
+    glBindVertexArray(0);
+}
+
+void ParticleCompute::destroy()
+{
+    if(!m_initialised) return;
+    if(m_countFence) glDeleteSync(m_countFence);
+    m_countFence = 0;
+    glDeleteBuffers(1, &m_poolBuffer);
+    glDeleteBuffers(1, &m_deadBuffer);
+    glDeleteBuffers(1, &m_aliveBuffer);
+    glDeleteBuffers(1, &m_drawBuffer);
+    glDeleteBuffers(1, &m_countBuffer);
+    glDeleteVertexArrays(1, &m_vao);
+    asset_registry::shared().release_program(updateShader);
+    asset_registry::shared().release_program(emitShader);
+    updateShader = emitShader = program();
+    m_initialised = false;
+}
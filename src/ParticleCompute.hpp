@@ -0,0 +1,82 @@
+#pragma once
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "cgra/cgra_shader.hpp"
+
+#include "ParticleSimCPU.hpp"
+
+
+// GL 4.3 backend for ParticleEmitter. Particles live in a fixed pool of
+// shader storage slots that are never compacted. Free slots are kept on a
+// dead list stack that spawns pop from and dying particles push to, both
+// with atomics, and the update pass appends the slot of every live particle
+// to an alive list whose length is the vertex count of an indirect draw. So
+// nothing about the particles is ever read back to issue the next frame.
+//
+// The emitter record stays on the CPU and is stepped with
+// ParticleSimCPU::stepEmitter, the shaders only see how many to spawn.
+class ParticleCompute
+{
+private:
+    struct GpuParticle {
+        glm::vec4 posAge;
+        glm::vec4 velAlive;
+    };
+
+    int m_capacity = 0; // particles, the emitter isn't in the pool
+    bool m_initialised = false;
+    Particle m_emitter;
+
+    GLuint m_poolBuffer;
+    GLuint m_deadBuffer;
+    GLuint m_aliveBuffer;
+    GLuint m_drawBuffer;
+    GLuint m_vao; // no attributes, core profile just needs one bound
+
+    // the alive count, copied out after each update and read back once a
+    // later frame finds the copy finished
+    GLuint m_countBuffer;
+    GLsync m_countFence = 0;
+    int m_liveParticles = 0;
+
+    cgra::program updateShader;
+    cgra::program emitShader;
+
+    using Uniform = cgra::program::uniform_handle;
+    struct {
+        Uniform capacity, delta, lifeTime, dragStrength;
+        Uniform constForceDir, constForceStrength, randIteratorIn;
+        Uniform forceFieldTransform, forceFieldStrength;
+        Uniform colliders, colliderCount, collision, restitution;
+    } m_updateUniforms;
+    struct {
+        Uniform spawnCount, delta, randIteratorIn, emitterPosition;
+        Uniform initVelocity, initSpeed, velVariance, spawnRadius;
+        Uniform spawnShape, coneAngle, spawnMeshTriangles, spawnMeshBasis;
+    } m_emitUniforms;
+
+    void initShaders();
+    void pollCount();
+
+public:
+    // Compute shaders and shader storage need GL 4.3.
+    static bool supported();
+
+    // Creates the buffers on first use and empties the pool.
+    void reset(int capacity, const Particle& emitter);
+
+    void update(const ParticleSimParams& params);
+    // Draws every live particle as a point with whatever program is bound,
+    // see particle_compute_render_vertex.glsl.
+    void draw();
+    void destroy();
+
+    bool initialised() const { return m_initialised; }
+    const Particle& emitter() const { return m_emitter; }
+    int capacity() const { return m_capacity; }
+    // as of a frame or two ago
+    int liveParticles() const { return m_liveParticles; }
+};
@@ -0,0 +1,69 @@
+#include "ParticleCurves.hpp"
+
+using namespace glm;
+using namespace std;
+
+
+void ParticleCurves::bake(vec4* row) const
+{
+    for(int i = 0; i < SAMPLES; i++){
+        const float t = float(i) / (SAMPLES - 1);
+        row[i] = vec4(color.evaluate(t), alpha.evaluate(t));
+        row[SAMPLES + i] = vec4(size.evaluate(t), 0, 0, 0);
+    }
+}
+
+ParticleCurves ParticleCurves::linear(const vec3& initColor, const vec3& endColor, float initSize, float endSize)
+{
+    ParticleCurves c;
+    c.color.keys = {{0, initColor}, {1, endColor}};
+    c.size.keys = {{0, initSize}, {1, endSize}};
+    c.alpha.keys = {{0, 1}, {1, 0}};
+    return c;
+}
+
+void ParticleCurveTexture::set(int layer, const ParticleCurves& curves)
+{
+    if(layer >= m_layers){
+        int layers = std::max(m_layers, 4);
+        while(layers <= layer) layers *= 2;
+
+        if(m_texture == 0) glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_1D_ARRAY, m_texture);
+        glTexImage2D(GL_TEXTURE_1D_ARRAY, 0, GL_RGBA16F, 2 * ParticleCurves::SAMPLES, layers, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_1D_ARRAY, 0);
+
+        // reallocating lost the rows already there
+        m_layers = layers;
+        m_rows.resize(layers);
+        for(int i = 0; i < layers; i++){
+            if(i != layer && !m_rows[i].color.keys.empty()) upload(i);
+        }
+    }
+
+    if(m_rows[layer] != curves){
+        m_rows[layer] = curves;
+        upload(layer);
+    }
+}
+
+void ParticleCurveTexture::upload(int layer)
+{
+    m_texels.resize(2 * ParticleCurves::SAMPLES);
+    m_rows[layer].bake(m_texels.data());
+    glBindTexture(GL_TEXTURE_1D_ARRAY, m_texture);
+    glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, layer, m_texels.size(), 1, GL_RGBA, GL_FLOAT, m_texels.data());
+    glBindTexture(GL_TEXTURE_1D_ARRAY, 0);
+    m_uploads++;
+}
+
+void ParticleCurveTexture::destroy()
+{
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+    m_layers = 0;
+    m_rows.clear();
+}
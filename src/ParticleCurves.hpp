@@ -0,0 +1,100 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+
+
+// One channel of a particle's appearance over its life, keyed at normalized
+// ages (0 at birth, 1 at death). Linear between keys, held before the
+// first and after the last.
+template<typename T>
+struct ParticleCurve {
+    struct Key {
+        float t;
+        T value;
+        bool operator==(const Key& o) const { return t == o.t && value == o.value; }
+    };
+    std::vector<Key> keys; // sorted by t
+
+    T evaluate(float t) const {
+        if(keys.empty()) return T(0);
+        if(t <= keys.front().t) return keys.front().value;
+        for(size_t i = 1; i < keys.size(); i++){
+            const Key& a = keys[i - 1];
+            const Key& b = keys[i];
+            if(t <= b.t){
+                return b.t > a.t ? glm::mix(a.value, b.value, (t - a.t) / (b.t - a.t)) : b.value;
+            }
+        }
+        return keys.back().value;
+    }
+
+    // puts the keys back in order after their ages are edited
+    void sort() {
+        std::stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b){ return a.t < b.t; });
+    }
+
+    bool operator==(const ParticleCurve& o) const { return keys == o.keys; }
+    bool operator!=(const ParticleCurve& o) const { return !(*this == o); }
+};
+
+// Colour, billboard size and alpha (multiplying the sprite's) over a
+// particle's life.
+struct ParticleCurves {
+    ParticleCurve<glm::vec3> color;
+    ParticleCurve<float> size;
+    ParticleCurve<float> alpha;
+
+    // texels per channel group in a baked row
+    static const int SAMPLES = 64;
+
+    // Fills a row of 2 * SAMPLES texels, colour and alpha at evenly spaced
+    // ages from 0 to 1, then the size in x at the same ages.
+    void bake(glm::vec4* row) const;
+
+    // The straight lines the particles used to be mixed along, fading out
+    // over their life.
+    static ParticleCurves linear(const glm::vec3& initColor, const glm::vec3& endColor,
+                                 float initSize, float endSize);
+
+    bool operator==(const ParticleCurves& o) const {
+        return color == o.color && size == o.size && alpha == o.alpha;
+    }
+    bool operator!=(const ParticleCurves& o) const { return !(*this == o); }
+};
+
+
+// Baked ParticleCurves rows, one layer of an RGBA16F GL_TEXTURE_1D_ARRAY
+// each, linear filtered, so the render shaders get a channel group for any
+// age with one fetch. A row is rebaked and uploaded only when the curves
+// set on its layer differ from what it holds, so steady emitters cost a
+// comparison a frame and no uploads.
+class ParticleCurveTexture
+{
+private:
+    GLuint m_texture = 0;
+    int m_layers = 0;
+    // what each layer holds, no keys at all for layers never set
+    std::vector<ParticleCurves> m_rows;
+    std::vector<glm::vec4> m_texels;
+    int m_uploads = 0;
+
+    void upload(int layer);
+
+public:
+    // Makes layer hold curves, growing the texture (doubling) to fit.
+    void set(int layer, const ParticleCurves& curves);
+
+    GLuint texture() const { return m_texture; }
+    int layers() const { return m_layers; }
+    // rows uploaded since creation
+    int uploads() const { return m_uploads; }
+
+    void destroy();
+};
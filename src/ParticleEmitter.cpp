@@ -1,6 +1,10 @@
 
 #include "ParticleEmitter.hpp"
 #include <algorithm> 
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
 
 #include "cgra/cgra_geometry.hpp"
 #include "cgra/cgra_gui.hpp"
@@ -14,89 +18,249 @@ using namespace glm;
 using namespace cgra;
 using namespace std;
 
-struct Particle{
-    GLfloat type;
-    glm::vec3 pos; 
-    glm::vec3 vel; 
-    GLfloat age;
-};
+// PackedParticle in floats: position, age, velocity xy, velocity z and type
+static const ParticleRecordLayout packedLayout = {6, 5, 0, 2, true};
 
-ParticleEmitter::ParticleEmitter(){}
+ParticleEmitter::ParticleEmitter(int capacity) : m_capacity(std::max(capacity, 2)), m_cpuSim(m_capacity){}
 ParticleEmitter::~ParticleEmitter(){}
 
 void ParticleEmitter::InitParticleSystem(const vec3 &pos)
 {
-    m_isFirst = true;
+    m_recordCount[0] = m_recordCount[1] = 1;
     initShaders();
 
-    texture = rgba_image(CGRA_SRCDIR + std::string("//res//textures//radGrad.png")).uploadTexture();
+    // the emitter's own vertex plus whatever it emits, in records of up to
+    // 9 floats (EmitterBatch's are the largest)
+    GLint maxVertices = 0, maxComponents = 0;
+    glGetIntegerv(GL_MAX_GEOMETRY_OUTPUT_VERTICES, &maxVertices);
+    glGetIntegerv(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS, &maxComponents);
+    maxEmitOutput = std::min<int>({maxVertices, maxComponents / 9, 100}) - 1;
 
-    Particle data[5000];
-    data[0].type = 1;
-    data[0].pos = pos;
-    data[0].vel = vec3(0,0,0);
-    data[0].age = 0;
+    texture = asset_registry::shared().acquire_texture(CGRA_SRCDIR + std::string("//res//textures//radGrad.png"));
 
     glGenVertexArrays(2, updateVao);
     glGenVertexArrays(2, renderVao);
-    glGenBuffers(2, m_particleBuffer);
+    glGenVertexArrays(2, instancedVao);
     glGenTransformFeedbacks(2, m_transformFeedback);
-
+    glGenQueries(1, &m_writtenQuery);
+
+    // triangle strip in the order particle_render_point_to_quad.glsl emits
+    const vec2 corners[] = {vec2(-0.5, 0.5), vec2(-0.5, -0.5), vec2(0.5, 0.5), vec2(0.5, -0.5)};
+    glGenBuffers(1, &m_quadBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_quadBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    createBuffers();
+
+    Particle emitter;
+    emitter.type = 1;
+    emitter.pos = pos;
+    emitter.vel = vec3(0,0,0);
+    emitter.age = 0;
     for(int i = 0; i < 2; i++){
-        glBindVertexArray(updateVao[i]);
-            glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[i]);
-                glEnableVertexAttribArray(0);
-                glEnableVertexAttribArray(1);
-                glEnableVertexAttribArray(2);
-                glEnableVertexAttribArray(3);
-                glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, type))); // type
-                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, pos))); // position
-                glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, vel))); // velocity
-                glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, age))); // lifetime
-                glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        writeRecords(i, &emitter, 1);
+    }
 
-        glBindVertexArray(renderVao[i]);
-            glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[i]);
-                glEnableVertexAttribArray(0);
-                glEnableVertexAttribArray(1);
-                glEnableVertexAttribArray(2);
-                glEnableVertexAttribArray(3);
-                glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, type))); // type
-                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, pos))); // position
-                glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, vel))); // velocity
-                glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(offsetof(Particle, age))); // lifetime
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
+    srand(time(0));
+}
+
+void ParticleEmitter::createBuffers()
+{
+    glGenBuffers(2, m_particleBuffer);
+
+    for(int i = 0; i < 2; i++){
+        glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[i]);
+        glBufferData(GL_ARRAY_BUFFER, m_capacity * recordSize(), nullptr, GL_DYNAMIC_DRAW);
+
+        setupRecordAttributes(updateVao[i], 0, 0);
+        setupRecordAttributes(renderVao[i], 0, 0);
+        // skips the emitter
+        setupRecordAttributes(instancedVao[i], recordSize(), 1);
+
+        glBindVertexArray(instancedVao[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, m_quadBuffer);
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), (void*)0); // quad corner
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_transformFeedback[i]);
             glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_particleBuffer[i]);
         glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
     }
+}
 
-    srand(time(0));
+// Points attributes 0-3 at the records of the bound array buffer, from
+// the given byte offset.
+void ParticleEmitter::setupRecordAttributes(GLuint vao, size_t first, GLuint divisor)
+{
+    glBindVertexArray(vao);
+        for(GLuint a = 0; a < 4; a++){
+            glEnableVertexAttribArray(a);
+            glVertexAttribDivisor(a, divisor);
+        }
+        if(m_packed){
+            const GLsizei stride = sizeof(PackedParticle);
+            glDisableVertexAttribArray(0); // the type is in attribute 2
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(first + offsetof(PackedParticle, pos))); // position
+            glVertexAttribIPointer(2, 2, GL_UNSIGNED_INT, stride, (void*)(first + offsetof(PackedParticle, velXY))); // velocity, type
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(first + offsetof(PackedParticle, age))); // lifetime
+        }else{
+            const GLsizei stride = sizeof(Particle);
+            glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, stride, (void*)(first + offsetof(Particle, type))); // type
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(first + offsetof(Particle, pos))); // position
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(first + offsetof(Particle, vel))); // velocity
+            glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(first + offsetof(Particle, age))); // lifetime
+        }
+    glBindVertexArray(0);
+}
+
+void ParticleEmitter::growBuffers(int capacity)
+{
+    GLuint old[2] = {m_particleBuffer[0], m_particleBuffer[1]};
+    const int oldCapacity = m_capacity;
+    m_capacity = capacity;
+    createBuffers();
+
+    // the transform feedback objects keep their vertex counts when the
+    // buffers are swapped under them, so only the contents need copying
+    for(int i = 0; i < 2; i++){
+        glBindBuffer(GL_COPY_READ_BUFFER, old[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_particleBuffer[i]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * recordSize());
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(2, old);
+
+    // re-seeded from the GPU at the next update
+    m_cpuSim = ParticleSimCPU(m_capacity);
+    m_cpuActive = false;
+}
+
+void ParticleEmitter::recordWritten(int written)
+{
+    m_liveParticles = std::max(written - 1, 0);
+    m_peakParticles = std::max(m_peakParticles, m_liveParticles);
+
+    // a full buffer means transform feedback has (probably) dropped particles
+    if(written >= m_capacity){
+        m_overflowed = true;
+        if(autoGrow && m_capacity < maxCapacity){
+            growBuffers(std::min(m_capacity * 2, maxCapacity));
+        }
+    }
+}
+
+void ParticleEmitter::pollWrittenQuery()
+{
+    if(!m_queryPending) return;
+
+    // never wait on the query, it's picked up on a later frame instead
+    GLuint available = 0;
+    glGetQueryObjectuiv(m_writtenQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available) return;
+
+    GLuint written = 0;
+    glGetQueryObjectuiv(m_writtenQuery, GL_QUERY_RESULT, &written);
+    m_queryPending = false;
+    recordWritten(written);
+}
+
+static std::string shaderPath(const std::string& file)
+{
+    return CGRA_SRCDIR + std::string("//res//shaders//") + file;
+}
+
+// Defines for the shaders that read or write particle records.
+// PACKED_RECORDS selects the packed format.
+std::vector<std::string> ParticleEmitter::recordDefines() const
+{
+    if(m_packed) return {"PACKED_RECORDS"};
+    return {};
 }
 
 void ParticleEmitter::initShaders(){
-    shader_builder geoShaderBuild;
-    geoShaderBuild.set_shader(GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_update_vertex.glsl"));
-    geoShaderBuild.set_shader(GL_GEOMETRY_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_update_geometry.glsl"));
-    geoShader = geoShaderBuild.build();
-
-    shader_builder renderShaderBuild;
-    renderShaderBuild.set_shader(GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_render_vertex.glsl"));
-    renderShaderBuild.set_shader(GL_GEOMETRY_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_render_point_to_quad.glsl"));
-	renderShaderBuild.set_shader(GL_FRAGMENT_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_render_fragment.glsl"));
-    renderShader = renderShaderBuild.build();
-
-    const GLchar* varyings[4];
-    varyings[0] = "type1";
-    varyings[1] = "position1";
-    varyings[2] = "velocity1";
-    varyings[3] = "age1";
-    glTransformFeedbackVaryings(geoShader, sizeof(varyings) / sizeof(GLchar*), varyings, GL_INTERLEAVED_ATTRIBS);
-    glLinkProgram(geoShader);
+    // shared with every other emitter using the same record format
+    asset_registry& assets = asset_registry::shared();
+    asset_registry::program_desc geoDesc;
+    geoDesc.stages = {{GL_VERTEX_SHADER, shaderPath("particle_update_vertex.glsl")},
+                      {GL_GEOMETRY_SHADER, shaderPath("particle_update_geometry.glsl")}};
+    geoDesc.defines = recordDefines();
+    if(m_packed){
+        geoDesc.varyings = {"position1", "age1", "velXY1", "velZType1"};
+    }else{
+        geoDesc.varyings = {"type1", "position1", "velocity1", "age1"};
+    }
+    geoShader = assets.acquire_program(geoDesc);
+
+    asset_registry::program_desc renderDesc;
+    renderDesc.stages = {{GL_VERTEX_SHADER, shaderPath("particle_render_vertex.glsl")},
+                         {GL_GEOMETRY_SHADER, shaderPath("particle_render_point_to_quad.glsl")},
+                         {GL_FRAGMENT_SHADER, shaderPath("particle_render_fragment.glsl")}};
+    renderDesc.defines = recordDefines();
+    renderShader = assets.acquire_program(renderDesc);
+
+    UpdateUniforms& u = m_updateUniforms;
+    u.delta = geoShader.uniform("delta");
+    u.emitterVelocity = geoShader.uniform("emitterVelocity");
+    u.emitterSpeed = geoShader.uniform("emitterSpeed");
+    u.emitCount = geoShader.uniform("emitCount");
+    u.lifeTime = geoShader.uniform("lifeTime");
+    u.initSpeed = geoShader.uniform("initSpeed");
+    u.maxSpeed = geoShader.uniform("maxSpeed");
+    u.dragStrength = geoShader.uniform("dragStrength");
+    u.randIteratorIn = geoShader.uniform("randIteratorIn");
+    u.spawnRadius = geoShader.uniform("spawnRadius");
+    u.initVelocity = geoShader.uniform("initVelocity");
+    u.velVariance = geoShader.uniform("velVariance");
+    u.constForceDir = geoShader.uniform("constForceDir");
+    u.constForceStrength = geoShader.uniform("constForceStrength");
+    u.shouldUpdatePosition = geoShader.uniform("shouldUpdatePosition");
+    u.updatePos = geoShader.uniform("updatePos");
+    u.spawnShape = geoShader.uniform("spawnShape");
+    u.coneAngle = geoShader.uniform("coneAngle");
+    u.spawnMeshTriangles = geoShader.uniform("spawnMeshTriangles");
+    u.spawnMeshBasis = geoShader.uniform("spawnMeshBasis");
+    u.forceFieldTransform = geoShader.uniform("forceFieldTransform");
+    u.forceFieldStrength = geoShader.uniform("forceFieldStrength");
+    u.colliders = geoShader.uniform("colliders");
+    u.colliderCount = geoShader.uniform("colliderCount");
+    u.collision = geoShader.uniform("collision");
+    u.restitution = geoShader.uniform("restitution");
+    geoShader.use();
+    geoShader.set(geoShader.uniform("spawnMesh"), 0);
+    geoShader.set(geoShader.uniform("forceField"), 1);
+    glUseProgram(0);
+
+    m_renderUniforms = renderUniforms(renderShader);
+
+    asset_registry::program_desc instancedDesc;
+    instancedDesc.stages = {{GL_VERTEX_SHADER, shaderPath("particle_render_instanced_vertex.glsl")},
+                            {GL_FRAGMENT_SHADER, shaderPath("particle_render_fragment.glsl")}};
+    instancedDesc.defines = recordDefines();
+    instancedShader = assets.acquire_program(instancedDesc);
+    m_instancedRenderUniforms = renderUniforms(instancedShader);
+}
+
+void ParticleEmitter::releaseShaders(){
+    asset_registry& assets = asset_registry::shared();
+    assets.release_program(geoShader);
+    assets.release_program(renderShader);
+    assets.release_program(instancedShader);
+}
+
+ParticleEmitter::RenderUniforms ParticleEmitter::renderUniforms(const program& shader)
+{
+    RenderUniforms r;
+    r.uProjectionMatrix = shader.uniform("uProjectionMatrix");
+    r.uModelViewMatrix = shader.uniform("uModelViewMatrix");
+    r.uColor = shader.uniform("uColor");
+    r.uCameraPos = shader.uniform("uCameraPos");
+    r.totalLifeTime = shader.uniform("totalLifeTime");
+    r.curves = shader.uniform("uCurves");
+    return r;
 }
 
 // void ParticleEmitter::draw(double delta, const mat4 &view, const mat4 proj)
@@ -105,111 +269,642 @@ void ParticleEmitter::initShaders(){
 //     render(view, proj);
 // }
 
+ParticleSimParams ParticleEmitter::simParams(double delta) const
+{
+    ParticleSimParams p;
+    p.delta = delta;
+    p.emitterVelocity = emitterVelocity;
+    p.emitterSpeed = emitterSpeed;
+    p.emitCount = 0;
+    p.spawnRadius = spawnRadius;
+    p.spawnShape = spawnShape;
+    p.coneAngle = coneAngle;
+    p.spawnMesh = spawnMesh;
+    p.spawnMeshBasis = spawnMeshBasis;
+    p.shouldUpdatePosition = shouldUpdatePosition;
+    p.updatePos = updatePos;
+    p.initVelocity = initVelocity;
+    p.initSpeed = initSpeed;
+    p.lifeTime = lifeTime;
+    p.velVariance = velVariance;
+    p.constForceDir = constForceDir;
+    p.constForceStrength = constForceStrength;
+    p.dragStrength = dragStrength;
+    p.forceField = forceField;
+    p.collision = collision;
+    p.restitution = restitution;
+    p.colliderCount = std::min<int>(colliders.size(), MAX_PARTICLE_COLLIDERS);
+    std::copy(colliders.begin(), colliders.begin() + p.colliderCount, p.colliders);
+    p.randIterator = m_randIterator;
+    return p;
+}
+
 void ParticleEmitter::updateParticles(double delta)
+{
+    pollWrittenQuery();
+
+    const ParticleSimParams params = takeParams(delta);
+
+    if(useCompute && computeSupported()){
+        if(!m_computeActive) enterCompute();
+
+        // not limited by the geometry shader's output
+        ParticleSimParams computeParams = params;
+        computeParams.emitCount += m_emission.take(std::numeric_limits<int>::max());
+        m_compute.update(computeParams);
+        m_liveParticles = m_compute.liveParticles();
+        m_peakParticles = std::max(m_peakParticles, m_liveParticles);
+        return;
+    }
+    if(m_computeActive) leaveCompute();
+
+    if(sortMode == ParticleSort::Gpu && ParticleSort::gpuSupported()){
+        // the sort keys every slot, stale records past this step's output
+        // mustn't look like particles
+        glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[m_currWriteBuff]);
+        glClearBufferData(GL_ARRAY_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if(useCpuSim && m_cpuActive){
+        ParticleSimParams cpuParams = params;
+        cpuParams.emitCount += m_emission.take(std::numeric_limits<int>::max());
+        m_cpuSim.step(cpuParams);
+        m_cpuRecords.resize(m_cpuSim.count());
+        m_cpuSim.store(m_cpuRecords.data());
+
+        writeRecords(m_currWriteBuff, m_cpuRecords.data(), m_cpuRecords.size());
+        m_recordCount[m_currWriteBuff] = m_cpuRecords.size();
+        recordWritten(m_cpuRecords.size());
+    }else if(useCpuSim){
+        // hand over from the GPU state, this step still runs there
+        int count = gpuUpdate(params, true);
+        readRecords(m_currWriteBuff, count, m_cpuRecords);
+        m_cpuSim.load(m_cpuRecords.data(), count);
+        m_cpuActive = true;
+    }else{
+        // sorting on the CPU needs the count to read the records back
+        gpuStep(params, sortMode == ParticleSort::Cpu);
+        m_cpuActive = false;
+    }
+}
+
+int ParticleEmitter::gpuStep(const ParticleSimParams& params, bool countRecords)
+{
+    // only the last pass's records are current, so that's the one queried
+    auto lastPass = [&](int pass){ return pass + 1 >= maxEmitPasses || m_emission.owed < 1; };
+    int written = gpuUpdate(params, countRecords, lastPass(0));
+
+    // particles still owed after a full pass get passes of their own,
+    // with no time step so the rest of the records stay as they are
+    for(int pass = 1; pass < maxEmitPasses && m_emission.owed >= 1; pass++){
+        ParticleSimParams extra = params;
+        extra.delta = 0;
+        extra.emitCount = m_emission.take(maxEmitOutput);
+        extra.shouldUpdatePosition = false;
+        // rand() advances with delta, without it only this changes the
+        // sequence between passes
+        extra.randIterator = float(rand()) / RAND_MAX;
+
+        swapBuffers();
+        if(sortMode == ParticleSort::Gpu && ParticleSort::gpuSupported()){
+            glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[m_currWriteBuff]);
+            glClearBufferData(GL_ARRAY_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        written = gpuUpdate(extra, countRecords, lastPass(pass));
+    }
+    return written;
+}
+
+ParticleSimParams ParticleEmitter::takeParams(double delta)
+{
+    m_randIterator = float(rand()) / RAND_MAX;
+    ParticleSimParams params = simParams(delta);
+
+    // a backlog that can never be emitted would only come out in bursts
+    if(isOneOff){
+        if(shouldEmitOneOff) m_emission.accrue(emitCount, m_capacity);
+    }else{
+        m_emission.accrue(emissionRate() * delta, m_capacity);
+    }
+    params.emitCount = m_emission.take(maxEmitOutput);
+
+    shouldEmitOneOff = false;
+    shouldUpdatePosition = false;
+    return params;
+}
+
+float ParticleEmitter::emissionRate() const
+{
+    if(isOneOff || emitTime <= 0) return 0;
+    return emitCount / emitTime * emissionScale;
+}
+
+float ParticleEmitter::particleReach() const
+{
+    // launched at initSpeed and pushed the whole way by the constant force
+    // and the field at full strength
+    float push = constForceStrength;
+    if(forceField) push += forceField->strength;
+    return spawnRadius + (initSpeed + emitterSpeed) * lifeTime + 0.5f * push * lifeTime * lifeTime;
+}
+
+ParticleEmissionCheck ParticleEmitter::checkEmissionRate(double frameRate, double seconds) const
+{
+    ParticleEmissionCheck check;
+    check.target = emissionRate();
+    const int frames = int(seconds * frameRate);
+    if(frames <= 0 || check.target <= 0) return check;
+    const double delta = 1.0 / frameRate;
+
+    // the schedule alone, as takeParams and gpuStep take from it
+    EmissionSchedule schedule;
+    long long scheduled = 0;
+    for(int f = 0; f < frames; f++){
+        schedule.accrue(check.target * delta, m_capacity);
+        scheduled += schedule.take(maxEmitOutput);
+        for(int pass = 1; pass < maxEmitPasses && schedule.owed >= 1; pass++){
+            scheduled += schedule.take(maxEmitOutput);
+        }
+    }
+    check.scheduled = scheduled * frameRate / frames;
+
+    // Nothing dies before the end and the buffers fit everything, so the
+    // last pass's records less the emitter are every particle emitted.
+    ParticleEmitter pe(int(std::ceil(check.target * seconds * 1.1)) + maxEmitOutput + 1);
+    pe.emitCount = emitCount;
+    pe.emitTime = emitTime;
+    pe.emissionScale = emissionScale;
+    pe.maxEmitPasses = maxEmitPasses;
+    pe.lifeTime = float(seconds) + 1;
+    pe.autoGrow = false;
+    pe.InitParticleSystem(vec3(0));
+    int written = 1;
+    for(int f = 0; f < frames; f++){
+        written = pe.gpuStep(pe.takeParams(delta), true);
+        pe.swapBuffers();
+    }
+    check.measured = pe.hasOverflowed() ? -1 : float((written - 1) * frameRate / frames);
+    pe.destroy();
+    return check;
+}
+
+int ParticleEmitter::gpuUpdate(const ParticleSimParams& params, bool countRecords, bool queryWritten)
 {
     glEnable(GL_RASTERIZER_DISCARD); 
     glBindVertexArray(updateVao[m_currReadBuff]); 
     glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_transformFeedback[m_currWriteBuff]);
-    glUseProgram(geoShader);
-    glUniform1f(glGetUniformLocation(geoShader, "delta"), delta);
-    glUniform3fv(glGetUniformLocation(geoShader, "emitterVelocity"), 1, value_ptr(emitterVelocity));
-    glUniform1f(glGetUniformLocation(geoShader, "emitterSpeed"), emitterSpeed);
+    geoShader.use();
+    geoShader.set(m_updateUniforms.delta, params.delta);
+    geoShader.set(m_updateUniforms.emitterVelocity, params.emitterVelocity);
+    geoShader.set(m_updateUniforms.emitterSpeed, params.emitterSpeed);
 
-    glUniform1f(glGetUniformLocation(geoShader, "emitTime"), emitTime);
-    glUniform1i(glGetUniformLocation(geoShader, "emitCount"), emitCount);
-    glUniform1f(glGetUniformLocation(geoShader, "lifeTime"), lifeTime);
-    glUniform1f(glGetUniformLocation(geoShader, "initSpeed"), initSpeed);
-    glUniform1f(glGetUniformLocation(geoShader, "maxSpeed"), maxSpeed);
+    geoShader.set(m_updateUniforms.emitCount, params.emitCount);
+    geoShader.set(m_updateUniforms.lifeTime, params.lifeTime);
+    geoShader.set(m_updateUniforms.initSpeed, params.initSpeed);
+    geoShader.set(m_updateUniforms.maxSpeed, maxSpeed);
 
     // glUniform1f(glGetUniformLocation(geoShader, "speedDropPercent"), speedDropPercent);
-    glUniform1f(glGetUniformLocation(geoShader, "dragStrength"), dragStrength);
+    geoShader.set(m_updateUniforms.dragStrength, params.dragStrength);
 
 
-    float randIterator = (rand() / RAND_MAX);
-    glUniform1f(glGetUniformLocation(geoShader, "randIteratorIn"), randIterator);
-    glUniform1f(glGetUniformLocation(geoShader, "spawnRadius"), spawnRadius);
-    glUniform3fv(glGetUniformLocation(geoShader, "initVelocity"), 1, value_ptr(initVelocity));
-    glUniform3fv(glGetUniformLocation(geoShader, "velVariance"), 1, value_ptr(velVariance));
-    glUniform3fv(glGetUniformLocation(geoShader, "constForceDir"), 1, value_ptr(constForceDir));
-    glUniform1f(glGetUniformLocation(geoShader, "constForceStrength"), constForceStrength);
+    geoShader.set(m_updateUniforms.randIteratorIn, params.randIterator);
+    geoShader.set(m_updateUniforms.spawnRadius, params.spawnRadius);
+    geoShader.set(m_updateUniforms.initVelocity, params.initVelocity);
+    geoShader.set(m_updateUniforms.velVariance, params.velVariance);
+    geoShader.set(m_updateUniforms.constForceDir, params.constForceDir);
+    geoShader.set(m_updateUniforms.constForceStrength, params.constForceStrength);
 
 
 
 
-    glUniform1i(glGetUniformLocation(geoShader, "shouldUpdatePosition"), shouldUpdatePosition);
-    glUniform3fv(glGetUniformLocation(geoShader, "updatePos"), 1, value_ptr(updatePos));
+    geoShader.set(m_updateUniforms.shouldUpdatePosition, params.shouldUpdatePosition);
+    geoShader.set(m_updateUniforms.updatePos, params.updatePos);
 
-    glUniform1i(glGetUniformLocation(geoShader, "isOneOff"), isOneOff);
-    glUniform1i(glGetUniformLocation(geoShader, "shouldEmitOneOff"), shouldEmitOneOff);
+    const int meshTriangles = params.spawnMesh ? params.spawnMesh->triangles() : 0;
+    geoShader.set(m_updateUniforms.spawnShape, int(params.spawnShape));
+    geoShader.set(m_updateUniforms.coneAngle, params.coneAngle);
+    geoShader.set(m_updateUniforms.spawnMeshTriangles, meshTriangles);
+    geoShader.set(m_updateUniforms.spawnMeshBasis, params.spawnMeshBasis);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, meshTriangles > 0 ? params.spawnMesh->texture() : 0);
 
+    const ForceField3D* field = params.forceField && params.forceField->baked() ? params.forceField : nullptr;
+    geoShader.set(m_updateUniforms.forceFieldStrength, field ? field->strength : 0.0f);
+    if(field){
+        geoShader.set(m_updateUniforms.forceFieldTransform, field->worldToField());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, field->texture());
+        glActiveTexture(GL_TEXTURE0);
+    }
 
-    glBeginTransformFeedback(GL_POINTS);
-    if(!m_isFirst){
-        glDrawTransformFeedback(GL_POINTS, m_transformFeedback[m_currReadBuff]);
-    }else{
-        glDrawArrays(GL_POINTS, 0, 1);
-        m_isFirst = false;
+    const int colliderCount = params.activeColliders();
+    geoShader.set(m_updateUniforms.colliderCount, colliderCount);
+    geoShader.set(m_updateUniforms.collision, int(params.collision));
+    geoShader.set(m_updateUniforms.restitution, params.restitution);
+    geoShader.set(m_updateUniforms.colliders, params.colliders, colliderCount);
+
+    // counted passes wait on their own query, otherwise the shared one is
+    // issued whenever the last result has been collected
+    GLuint query = 0;
+    const bool asyncQuery = !countRecords && queryWritten && !m_queryPending;
+    if(countRecords){
+        glGenQueries(1, &query);
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+    }else if(asyncQuery){
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, m_writtenQuery);
     }
+
+    glBeginTransformFeedback(GL_POINTS);
+    drawRecords(m_currReadBuff);
     glEndTransformFeedback();
 
-    // Particle ret[5];
-    // glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sizeof(ret), ret);
-    // for(int i = 0; i < 5; i++){
-    //     cout << i << ": ";
-    //     cout << ret[i].type << " "; 
-    //     cout << "(" << ret[i].pos.x << ", " << ret[i].pos.y << ", "<< ret[i].pos.z << ") ";
-    //     cout << "(" << ret[i].vel.x << ", " << ret[i].vel.y << ", "<< ret[i].vel.z << ") ";
-    //     cout << ret[i].age << " ";
-    //     cout << endl;
-    // }
-    // cout << endl;
+    int written = -1;
+    if(countRecords){
+        // stalls until the pass is done, only used for read backs
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        GLuint primitives = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
+        glDeleteQueries(1, &query);
+        written = primitives;
+    }else if(asyncQuery){
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        m_queryPending = true;
+    }
 
     glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
     glBindVertexArray(0); 
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE0);
     glDisable(GL_RASTERIZER_DISCARD);    
 
-    shouldEmitOneOff = false;
-    shouldUpdatePosition = false;
+    m_recordCount[m_currWriteBuff] = written;
+    if(countRecords){
+        recordWritten(written);
+    }
+    return written;
 }
 
-void ParticleEmitter::render(const mat4& view, const mat4 proj){
-    glBindVertexArray(renderVao[m_currWriteBuff]);
-    glUseProgram(renderShader);
-    glEnable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
-    // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDepthMask(GL_FALSE);  
-    glUniformMatrix4fv(glGetUniformLocation(renderShader, "uProjectionMatrix"), 1, false, value_ptr(proj));
-	glUniformMatrix4fv(glGetUniformLocation(renderShader, "uModelViewMatrix"), 1, false, value_ptr(view));
-	glUniform3fv(glGetUniformLocation(renderShader, "uColor"), 1, value_ptr(vec3(0, 1, 0)));
-    vec3 camPos = (vec4(0, 0, -1, 0) * inverse(view));
-    glUniform3fv(glGetUniformLocation(renderShader, "uCameraPos"), 1, value_ptr(camPos));
-    glUniform1f(glGetUniformLocation(renderShader, "initBillboardSize"), initBillboardSize);
-    glUniform1f(glGetUniformLocation(renderShader, "endBillboardSize"), endBillboardSize);
+void ParticleEmitter::drawRecords(int buffer)
+{
+    if(m_recordCount[buffer] < 0){
+        glDrawTransformFeedback(GL_POINTS, m_transformFeedback[buffer]);
+    }else{
+        glDrawArrays(GL_POINTS, 0, m_recordCount[buffer]);
+    }
+}
+
+void ParticleEmitter::readRecords(int buffer, int count, std::vector<Particle>& out)
+{
+    out.resize(count);
+    glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[buffer]);
+    if(m_packed){
+        m_packedRecords.resize(count);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(PackedParticle), m_packedRecords.data());
+        std::transform(m_packedRecords.begin(), m_packedRecords.end(), out.begin(), unpackParticle);
+    }else{
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Particle), out.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleEmitter::writeRecords(int buffer, const Particle* records, int count)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_particleBuffer[buffer]);
+    if(m_packed){
+        m_packedRecords.resize(count);
+        std::transform(records, records + count, m_packedRecords.begin(), packParticle);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(PackedParticle), m_packedRecords.data());
+    }else{
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Particle), records);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool ParticleEmitter::packedSupported()
+{
+    return GLEW_VERSION_4_2 || GLEW_ARB_shading_language_packing;
+}
+
+ParticleFormatBenchmark ParticleEmitter::benchmarkRecordFormats(int particles)
+{
+    ParticleFormatBenchmark result;
+    result.particles = particles;
+    const int steps = 10;
+
+    vector<Particle> records(particles + 1);
+    records[0] = Particle{1, vec3(0), vec3(0), 0};
+    for(int i = 1; i <= particles; i++){
+        const float f = float(i) / particles;
+        records[i] = Particle{2, vec3(f, 0, -f), vec3(0.5f + f, 1, f), 0};
+    }
+
+    for(bool packed : {false, true}){
+        if(packed && !packedSupported()) continue;
+
+        // nothing dies or gets emitted, so every pass moves the full buffer
+        ParticleEmitter pe(particles + 1);
+        pe.isOneOff = true;
+        pe.lifeTime = 1e9;
+        pe.autoGrow = false;
+        pe.setPackedRecords(packed);
+        pe.InitParticleSystem(vec3(0));
+        pe.writeRecords(pe.m_currReadBuff, records.data(), records.size());
+        pe.m_recordCount[pe.m_currReadBuff] = records.size();
+
+        // the first pass isn't timed, drivers allocate on first use
+        pe.gpuUpdate(pe.takeParams(1.0 / 60), false);
+        pe.swapBuffers();
+
+        GLuint query;
+        glGenQueries(1, &query);
+        glFinish();
+        const ParticleSimParams params = pe.takeParams(1.0 / 60);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for(int s = 0; s < steps; s++){
+            pe.gpuUpdate(params, false);
+            pe.swapBuffers();
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        glDeleteQueries(1, &query);
+        pe.destroy();
+
+        (packed ? result.packedMs : result.fullMs) = ns / 1e6 / steps;
+    }
+    return result;
+}
+
+ParticleColliderBenchmark ParticleEmitter::benchmarkColliders(int particles)
+{
+    ParticleColliderBenchmark result;
+    result.particles = particles;
+    const int steps = 10;
+
+    vector<Particle> records(particles + 1);
+    records[0] = Particle{1, vec3(0), vec3(0), 0};
+    for(int i = 1; i <= particles; i++){
+        const float f = float(i) / particles;
+        records[i] = Particle{2, vec3(f, 0, -f), vec3(0.5f + f, 1, f), 0};
+    }
+
+    // nothing dies, gets emitted or hits anything, so every pass tests the
+    // full buffer against every sphere
+    ParticleEmitter pe(particles + 1);
+    pe.isOneOff = true;
+    pe.lifeTime = 1e9;
+    pe.autoGrow = false;
+    pe.collision = CollideBounce;
+    pe.InitParticleSystem(vec3(0));
+    pe.writeRecords(pe.m_currReadBuff, records.data(), records.size());
+    pe.m_recordCount[pe.m_currReadBuff] = records.size();
+    pe.gpuUpdate(pe.takeParams(1.0 / 60), false);
+    pe.swapBuffers();
+
+    GLuint query;
+    glGenQueries(1, &query);
+    for(int n = 0; n <= MAX_PARTICLE_COLLIDERS; n = std::max(n * 2, 1)){
+        pe.colliders.clear();
+        for(int c = 0; c < n; c++){
+            pe.colliders.push_back(vec4(1000 + 10 * c, 0, 0, 1));
+        }
+        const ParticleSimParams params = pe.takeParams(1.0 / 60);
+
+        glFinish();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for(int s = 0; s < steps; s++){
+            pe.gpuUpdate(params, false);
+            pe.swapBuffers();
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+
+        result.colliders.push_back(n);
+        result.gpuNs.push_back(double(ns) / steps / particles);
+        const double rate = ParticleSimCPU::benchmark(particles, steps, ParticleSimCPU::maxThreads(), n);
+        result.cpuNs.push_back(rate > 0 ? 1e9 / rate : 0);
+    }
+    glDeleteQueries(1, &query);
+    pe.destroy();
+    return result;
+}
 
-    glUniform1f(glGetUniformLocation(renderShader, "totalLifeTime"), lifeTime);
-    glUniform3fv(glGetUniformLocation(renderShader, "initColor"), 1, value_ptr(initColor));
-    glUniform3fv(glGetUniformLocation(renderShader, "endColor"), 1, value_ptr(endColor));
+void ParticleEmitter::setPackedRecords(bool packed)
+{
+    if(packed == m_packed || (packed && !packedSupported())) return;
+    if(!geoShader){
+        // not initialised yet
+        m_packed = packed;
+        return;
+    }
+
+    // only the emitter carries over, like switching backends
+    vector<Particle> emitter;
+    readRecords(m_currReadBuff, 1, emitter);
+
+    glDeleteBuffers(2, m_particleBuffer);
+    releaseShaders();
+    m_packed = packed;
+    initShaders();
+    createBuffers();
+
+    for(int i = 0; i < 2; i++){
+        writeRecords(i, emitter.data(), 1);
+        m_recordCount[i] = 1;
+    }
+    m_cpuActive = false;
+}
+
+void ParticleEmitter::enterCompute()
+{
+    if(!computeRenderShader){
+        asset_registry::program_desc desc;
+        desc.stages = {{GL_VERTEX_SHADER, shaderPath("particle_compute_render_vertex.glsl")},
+                       {GL_GEOMETRY_SHADER, shaderPath("particle_render_point_to_quad.glsl")},
+                       {GL_FRAGMENT_SHADER, shaderPath("particle_render_fragment.glsl")}};
+        computeRenderShader = asset_registry::shared().acquire_program(desc);
+        m_computeRenderUniforms = renderUniforms(computeRenderShader);
+    }
+
+    // the emitter is always the first record
+    vector<Particle> emitter;
+    readRecords(m_currReadBuff, 1, emitter);
+    m_compute.reset(m_capacity - 1, emitter[0]);
+    m_computeActive = true;
+}
+
+void ParticleEmitter::leaveCompute()
+{
+    const Particle emitter = m_compute.emitter();
+    writeRecords(m_currReadBuff, &emitter, 1);
+    m_recordCount[m_currReadBuff] = 1;
+    m_computeActive = false;
+    m_cpuActive = false;
+}
+
+void ParticleEmitter::swapBuffers()
+{
+    m_currReadBuff = m_currWriteBuff;
+    m_currWriteBuff = (m_currWriteBuff + 1) & 0x1; 
+}
 
+void ParticleEmitter::checkCpuParity(double delta)
+{
+    // compares against the transform feedback pass only
+    if(m_computeActive) return;
+
+    int before = gpuUpdate(takeParams(delta), true);
+    vector<Particle> start;
+    readRecords(m_currWriteBuff, before, start);
+    swapBuffers();
+
+    const ParticleSimParams params = takeParams(delta);
+    int after = gpuUpdate(params, true);
+    vector<Particle> gpu;
+    readRecords(m_currWriteBuff, after, gpu);
+    swapBuffers();
+
+    ParticleSimCPU sim(m_capacity);
+    sim.load(start.data(), before);
+    sim.step(params);
+    vector<Particle> cpu(sim.count());
+    sim.store(cpu.data());
+
+    // re-seed from the GPU state if the CPU simulation is in use
+    m_cpuActive = false;
+
+    ParticleParityReport r;
+    r.valid = true;
+    r.gpuRecords = gpu.size();
+    r.cpuRecords = cpu.size();
+    for(size_t i = 0; i < std::min(gpu.size(), cpu.size()); i++){
+        const Particle& g = gpu[i];
+        const Particle& c = cpu[i];
+        if(int(g.type) != int(c.type)){
+            r.typeMismatches++;
+        }else if(i > 0 && g.age == 0 && c.age == 0){
+            // new particle, positions and directions come from the shader's rand()
+            r.maxSpawnSpeedError = std::max(r.maxSpawnSpeedError, std::abs(length(g.vel) - length(c.vel)));
+        }else{
+            r.maxPosError = std::max(r.maxPosError, length(g.pos - c.pos));
+            r.maxVelError = std::max(r.maxVelError, length(g.vel - c.vel));
+            r.maxAgeError = std::max(r.maxAgeError, std::abs(g.age - c.age));
+        }
+    }
+    lastParity = r;
+}
+
+void ParticleEmitter::render(const mat4& view, const mat4 proj){
+    if(m_computeActive){
+        setRenderUniforms(computeRenderShader, m_computeRenderUniforms, view, proj);
+        m_compute.draw();
+    }else{
+        // sorts before the render program is bound, they use their own
+        const int count = m_recordCount[m_currWriteBuff];
+        bool sorted = false;
+        if(sortMode == ParticleSort::Cpu && count >= 0){
+            const Particle* records = m_cpuRecords.data();
+            if(!useCpuSim || int(m_cpuRecords.size()) != count){
+                // not already on the CPU
+                readRecords(m_currWriteBuff, count, m_sortRecords);
+                records = m_sortRecords.data();
+            }
+            m_sorter.setLayout(ParticleRecordLayout());
+            m_sorter.sortCpu(reinterpret_cast<const float*>(records), count, view);
+            sorted = true;
+        }else if(sortMode == ParticleSort::Gpu && ParticleSort::gpuSupported()){
+            m_sorter.setLayout(m_packed ? packedLayout : ParticleRecordLayout());
+            m_sorter.sortGpu(m_particleBuffer[m_currWriteBuff], count >= 0 ? count : m_capacity, view);
+            sorted = true;
+        }
+
+        if(instancedQuads && !sorted){
+            // The emitter isn't an instance, it's skipped by the VAO. If this
+            // frame's pass wasn't counted, the last count pollWrittenQuery
+            // collected (a frame or two old) stands in rather than waiting.
+            const int instances = count >= 0 ? count - 1 : std::min(m_liveParticles, m_capacity - 1);
+            glBindVertexArray(instancedVao[m_currWriteBuff]);
+            setRenderUniforms(instancedShader, m_instancedRenderUniforms, view, proj);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, std::max(instances, 0));
+        }else{
+            glBindVertexArray(renderVao[m_currWriteBuff]);
+            setRenderUniforms(renderShader, m_renderUniforms, view, proj);
+            if(sorted){
+                m_sorter.draw();
+            }else{
+                drawRecords(m_currWriteBuff);
+            }
+        }
+        swapBuffers();
+    }
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D_ARRAY, 0);
+    glActiveTexture(GL_TEXTURE0);
 
-    glDrawTransformFeedback(GL_POINTS, m_transformFeedback[m_currWriteBuff]);
     glDisable(GL_BLEND);
     glDepthMask(GL_TRUE);  
     glDisable(GL_DEPTH_TEST);
 
     glUseProgram(0);
     glBindVertexArray(0);
-    
-    m_currReadBuff = m_currWriteBuff;
-    m_currWriteBuff = (m_currWriteBuff + 1) & 0x1; 
+}
+
+void ParticleEmitter::setRenderUniforms(program& shader, const RenderUniforms& r, const mat4& view, const mat4& proj){
+    shader.use();
+    glEnable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  
+    // coverage accumulates in alpha, so a ParticleCompositor target ends up
+    // premultiplied
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);  
+    shader.set(r.uProjectionMatrix, proj);
+	shader.set(r.uModelViewMatrix, view);
+	shader.set(r.uColor, vec3(0, 1, 0));
+    vec3 camPos = (vec4(0, 0, -1, 0) * inverse(view));
+    shader.set(r.uCameraPos, camPos);
+    shader.set(r.totalLifeTime, lifeTime);
+
+    // only uploaded when the curves change
+    m_curveTexture.set(0, lifetimeCurves());
+    shader.set(r.curves, 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D_ARRAY, m_curveTexture.texture());
+    glActiveTexture(GL_TEXTURE0);
+}
+
+ParticleCurves ParticleEmitter::lifetimeCurves() const
+{
+    ParticleCurves c = ParticleCurves::linear(initColor, endColor, initBillboardSize, endBillboardSize);
+    if(!curves.color.keys.empty()) c.color = curves.color;
+    if(!curves.size.keys.empty()) c.size = curves.size;
+    if(!curves.alpha.keys.empty()) c.alpha = curves.alpha;
+    return c;
 }
 
 void ParticleEmitter::destroy(){
     glDeleteVertexArrays(2, renderVao);
     glDeleteVertexArrays(2, updateVao);
+    glDeleteVertexArrays(2, instancedVao);
     glDeleteBuffers(2, m_particleBuffer);
+    glDeleteBuffers(1, &m_quadBuffer);
     glDeleteTransformFeedbacks(2, m_transformFeedback);
+    glDeleteQueries(1, &m_writtenQuery);
+    asset_registry::shared().release_texture(texture);
+    m_curveTexture.destroy();
+    releaseShaders();
+    if(computeRenderShader){
+        asset_registry::shared().release_program(computeRenderShader);
+        computeRenderShader = program();
+    }
+    m_compute.destroy();
+    m_sorter.destroy();
 }
 
 void ParticleEmitter::updatePosition(const glm::vec3& pos){
@@ -1,23 +1,92 @@
 #pragma once
 
+// std
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 // glm
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp> // Add this line
 
 #include "opengl.hpp"
+#include "cgra/cgra_assets.hpp"
 #include "cgra/cgra_geometry.hpp"
 #include "cgra/cgra_gui.hpp"
 #include "cgra/cgra_shader.hpp"
 #include "cgra/cgra_wavefront.hpp"
 
+#include "ForceField3D.hpp"
+#include "MeshSurfaceSampler.hpp"
+#include "ParticleCompute.hpp"
+#include "ParticleCurves.hpp"
+#include "ParticleSimCPU.hpp"
+#include "ParticleSort.hpp"
+
+// Result of comparing one CPU step against the GPU pass from the same state.
+struct ParticleParityReport {
+    bool valid = false;
+    int gpuRecords = 0;
+    int cpuRecords = 0;
+    int typeMismatches = 0;
+    // over the particles that existed before the step (deterministic)
+    float maxPosError = 0;
+    float maxVelError = 0;
+    float maxAgeError = 0;
+    // over newly emitted particles, which depend on the shader's sin() precision
+    float maxSpawnSpeedError = 0;
+};
+
+// GPU time of one update pass over a full buffer, in each record format.
+struct ParticleFormatBenchmark {
+    int particles = 0;
+    double fullMs = 0;
+    double packedMs = 0; // 0 if packed records aren't supported
+};
+
+// Update cost per particle against the number of collider spheres tested,
+// on the GPU (transform feedback) and the CPU (all threads).
+struct ParticleColliderBenchmark {
+    int particles = 0;
+    std::vector<int> colliders;
+    std::vector<double> gpuNs; // per particle per pass
+    std::vector<double> cpuNs;
+};
+
+// The particles an emission rate owes, fractions carried over between steps
+// so the rate doesn't depend on the frame rate. Kept apart from the emitter
+// so a schedule can be replayed on its own.
+struct EmissionSchedule {
+    double owed = 0;
+
+    // adds rate * delta (or a burst), a backlog past cap is dropped
+    void accrue(double particles, double cap) { owed = std::min(owed + particles, cap); }
+    // takes up to limit whole particles
+    int take(int limit) {
+        const int n = int(std::min<double>(std::floor(owed), limit));
+        owed -= n;
+        return n;
+    }
+};
+
+// Emission rates delivered at a fixed frame rate, against the configured one.
+struct ParticleEmissionCheck {
+    float target = 0;
+    float scheduled = 0; // the schedule replayed, what the passes are asked for
+    float measured = 0;  // records the passes wrote, -1 if the buffers filled
+};
 
 
 class ParticleEmitter
 {
 private:
-    int maxEmitOutput = GL_MAX_GEOMETRY_OUTPUT_VERTICES; 
+    // particles the update shader can emit per pass, from the queried output
+    // limits and its max_vertices, less the emitter's own record
+    int maxEmitOutput = 99;
 
-    bool m_isFirst;
+    // Records in each buffer, or -1 if it was written by transform feedback
+    // and the feedback object knows.
+    int m_recordCount[2] = {1, 1};
     unsigned int m_currReadBuff = 0;
     unsigned int m_currWriteBuff = 1;
 
@@ -25,18 +94,104 @@ private:
     GLuint m_transformFeedback[2];
     GLuint updateVao[2];
     GLuint renderVao[2];
+    // particle records as per instance attributes, starting after the
+    // emitter record, and the quad corners per vertex
+    GLuint instancedVao[2];
+    GLuint m_quadBuffer;
 
-    GLuint geoShader;
-    GLuint renderShader;
+    cgra::program geoShader;
+    cgra::program renderShader;
+    cgra::program instancedShader;
+
+    // uniform handles, looked up once in initShaders
+    using Uniform = cgra::program::uniform_handle;
+    struct UpdateUniforms {
+        Uniform delta, emitterVelocity, emitterSpeed, emitCount;
+        Uniform lifeTime, initSpeed, maxSpeed, dragStrength, randIteratorIn;
+        Uniform spawnRadius, initVelocity, velVariance, constForceDir;
+        Uniform constForceStrength, shouldUpdatePosition, updatePos;
+        Uniform spawnShape, coneAngle, spawnMeshTriangles, spawnMeshBasis;
+        Uniform forceFieldTransform, forceFieldStrength;
+        Uniform colliders, colliderCount, collision, restitution;
+    } m_updateUniforms;
+    struct RenderUniforms {
+        Uniform uProjectionMatrix, uModelViewMatrix, uColor, uCameraPos;
+        Uniform totalLifeTime, curves;
+    } m_renderUniforms;
+    RenderUniforms m_instancedRenderUniforms;
     
-    int maxParticles = 1000;
+    // records per buffer, including the emitter
+    int m_capacity;
+
+    // transform feedback output is counted with a query that is only read
+    // once its result is available, so it never stalls the pipeline
+    GLuint m_writtenQuery = 0;
+    bool m_queryPending = false;
+    int m_liveParticles = 0;
+    int m_peakParticles = 0;
+    bool m_overflowed = false;
+
+    ParticleSimCPU m_cpuSim;
+    std::vector<Particle> m_cpuRecords;
+    bool m_cpuActive = false;
+    float m_randIterator = 0;
+
+    // particles owed by the emission rate that haven't been emitted yet
+    EmissionSchedule m_emission;
+
+    ParticleCompute m_compute;
+    bool m_computeActive = false;
+    cgra::program computeRenderShader;
+    RenderUniforms m_computeRenderUniforms;
+
+    ParticleSort m_sorter;
+    std::vector<Particle> m_sortRecords;
 
     GLuint texture;
+    // lifetimeCurves() in its only layer
+    ParticleCurveTexture m_curveTexture;
 
     bool shouldUpdatePosition = false;
     glm::vec3 updatePos = glm::vec3(0);
 
+    // records are PackedParticle rather than Particle
+    bool m_packed = false;
+    std::vector<PackedParticle> m_packedRecords;
+    size_t recordSize() const { return m_packed ? sizeof(PackedParticle) : sizeof(Particle); }
+    std::vector<std::string> recordDefines() const;
+    void setupRecordAttributes(GLuint vao, size_t first, GLuint divisor);
+
+    // the programs come from cgra::asset_registry, shared between emitters
     void initShaders();
+    void releaseShaders();
+    static RenderUniforms renderUniforms(const cgra::program& shader);
+    void setRenderUniforms(cgra::program& shader, const RenderUniforms& r, const glm::mat4& view, const glm::mat4& proj);
+    // (re)creates both particle buffers at m_capacity and points the VAOs and
+    // transform feedback objects at them
+    void createBuffers();
+    void growBuffers(int capacity);
+    void pollWrittenQuery();
+    void recordWritten(int written);
+
+    ParticleSimParams simParams(double delta) const;
+    // Runs the update shader from the read buffer into the write buffer.
+    // If countRecords, waits for and returns the number of records written.
+    // Otherwise the pass is counted by the shared asynchronous query if
+    // queryWritten and the query is free.
+    int gpuUpdate(const ParticleSimParams &params, bool countRecords, bool queryWritten = true);
+    // A step's first pass and the extra emission passes for what it still
+    // owes. Returns the last pass's count if countRecords.
+    int gpuStep(const ParticleSimParams &params, bool countRecords);
+    void drawRecords(int buffer);
+    // read and write records in either format
+    void readRecords(int buffer, int count, std::vector<Particle> &out);
+    void writeRecords(int buffer, const Particle* records, int count);
+    void swapBuffers();
+
+    // Hands the emitter record over between the transform feedback buffers
+    // and the compute backend. Particles in flight aren't carried over.
+    void enterCompute();
+    void leaveCompute();
 
 public:
     // emitter propertys
@@ -45,6 +200,18 @@ public:
     glm::vec3 emitterVelocity = glm::vec3(0, 0, 0);
     float emitterSpeed = 0;
     float spawnRadius = 1;
+    ParticleSpawnShape spawnShape = SpawnCube;
+    float coneAngle = 0.3;
+    // Surface for SpawnMeshSurface, placed by spawnMeshBasis around the
+    // emitter. Not owned, whoever sets it keeps it current (falls back to
+    // the cube while unset or empty).
+    const MeshSurfaceSampler* spawnMesh = nullptr;
+    glm::mat3 spawnMeshBasis = glm::mat3(1);
+    // Multiplies the emission rate, set by ParticleBudget. 0 stops emitting.
+    float emissionScale = 1;
+    // A geometry shader pass emits under 100 particles, anything owed past
+    // that gets extra passes that don't advance time, up to this many in all.
+    int maxEmitPasses = 4;
 
     // particle props
     float initBillboardSize = 1;
@@ -56,28 +223,112 @@ public:
     glm::vec3 initVelocity = glm::vec3(0, 1, 0);
     glm::vec3 endColor = glm::vec3(1, 1, 1); 
     glm::vec3 initColor = glm::vec3(1, 1, 1);
+    // Keyed colour, size and alpha over the particles' life. A channel
+    // without keys is a straight line between the init and end values
+    // above (alpha fades from 1 to 0).
+    ParticleCurves curves;
     float dragStrength = 0;
 
     glm::vec3 velVariance = glm::vec3(0);
     glm::vec3 constForceDir = glm::vec3(0);
     float constForceStrength = 0;
+    // turbulence, not owned (see ForceField3D)
+    const ForceField3D* forceField = nullptr;
+
+    // Spheres (centre, radius, world space) the particles collide with,
+    // usually the few nearest from ParticleColliders::cull. Only the first
+    // MAX_PARTICLE_COLLIDERS are tested.
+    std::vector<glm::vec4> colliders;
+    ParticleCollision collision = CollideNone;
+    // normal speed kept by a bounce
+    float restitution = 0.5;
     
 
     bool isOneOff = false;
     bool shouldEmitOneOff = false;
 
-    ParticleEmitter();
+    // Simulate on the CPU with ParticleSimCPU and upload the records each
+    // frame, instead of the transform feedback pass.
+    bool useCpuSim = false;
+    ParticleParityReport lastParity;
+
+    // Simulate with compute shaders (ParticleCompute) when the context is
+    // GL 4.3, otherwise this is ignored and transform feedback is used.
+    bool useCompute = false;
+
+    // Draw back to front, see ParticleSort. Sorting on the CPU reads the
+    // records back every frame, on the GPU it needs GL 4.3. Not applied to
+    // the compute backend.
+    ParticleSort::Mode sortMode = ParticleSort::None;
+
+    // Draw a static quad per particle with glDrawArraysInstanced instead of
+    // expanding points in a geometry shader. Instancing needs the record
+    // count on the CPU, which is taken from the written query once it's
+    // available, so the instance count trails the simulation by a frame or
+    // two instead of stalling on it. Sorted drawing still goes through the
+    // geometry shader.
+    bool instancedQuads = false;
+    static bool computeSupported() { return ParticleCompute::supported(); }
+
+    // grow buffers when they fill up, doubling up to maxCapacity records
+    bool autoGrow = true;
+    int maxCapacity = 1 << 20;
+
+    ParticleEmitter(int capacity = 5000);
     ~ParticleEmitter();
 
     void InitParticleSystem(const glm::vec3& pos); 
     // void draw(double delta, const glm::mat4& veiw, const glm::mat4 proj); 
 
     void updateParticles(double delta);
+    // The parameters for one update step. Clears the one-shot flags
+    // (emitOneOff, updatePosition), so whoever calls this owns the step.
+    // The emission rate (emitCount every emitTime seconds) is accumulated
+    // over delta, and as much of what's owed as a geometry shader pass can
+    // emit goes into emitCount, the rest stays owed.
+    ParticleSimParams takeParams(double delta);
+    // particles per second, with emissionScale
+    float emissionRate() const;
+    // How far from the emitter a particle could be by the end of its life,
+    // drag ignored. Counts the emitter moving away from where it was
+    // emitted. For culling colliders.
+    float particleReach() const;
+    // what the particles are drawn with, curves with its empty channels
+    // filled in
+    ParticleCurves lifetimeCurves() const;
+    // The rate the scheduler delivers at a fixed frame rate, replaying the
+    // schedule on its own, and the rate the transform feedback passes really
+    // emit, counted on a fresh emitter with the same emission settings.
+    ParticleEmissionCheck checkEmissionRate(double frameRate, double seconds) const;
     void render(const glm::mat4& view, const glm::mat4 proj); 
     void updatePosition(const glm::vec3& pos);
 
     void emitOneOff();
 
+    int capacity() const { return m_capacity; }
+    int liveParticles() const { return m_liveParticles; }
+    int peakParticles() const { return m_peakParticles; }
+    // curve rows uploaded, they only go up when the curves change
+    int curveUploads() const { return m_curveTexture.uploads(); }
+    // the buffers have been full at some point, so particles were dropped
+    bool hasOverflowed() const { return m_overflowed; }
+
+    // Steps the GPU and then the CPU simulation from the same read back
+    // state and compares the two (advances the particles by two steps).
+    void checkCpuParity(double delta);
+
+    // Switches the buffers between Particle (32 bytes) and PackedParticle
+    // (24 bytes) records, which needs GL 4.2 or ARB_shading_language_packing.
+    // Only the emitter is kept.
+    void setPackedRecords(bool packed);
+    bool packedRecords() const { return m_packed; }
+    static bool packedSupported();
+    // Times update passes over a buffer of long lived particles.
+    static ParticleFormatBenchmark benchmarkRecordFormats(int particles);
+    // Times update passes at 0 up to MAX_PARTICLE_COLLIDERS colliders, none
+    // of which the particles reach, so only the tests are measured.
+    static ParticleColliderBenchmark benchmarkColliders(int particles);
+
     void destroy();
 };
 
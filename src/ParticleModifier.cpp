@@ -11,17 +11,137 @@ ParticleModifier::ParticleModifier(ParticleEmitter& pEmit) : pe(pEmit)
 
 ParticleModifier::~ParticleModifier(){}
 
+static void keyValueUi(float& value, float maxValue){
+    ImGui::SliderFloat("value", &value, 0, maxValue);
+}
+
+static void keyValueUi(glm::vec3& value, float){
+    ImGui::ColorEdit3("value", value_ptr(value));
+}
+
+// Key list for one channel. A channel without keys stands for line, adding
+// keys starts from it. Ages are kept between the neighbouring keys' so the
+// keys stay sorted while dragging.
+template<typename T>
+static void curveUi(const char* name, ParticleCurve<T>& curve, const ParticleCurve<T>& line, float maxValue){
+    if(!ImGui::TreeNode(name)) return;
+    if(curve.keys.empty()){
+        ImGui::TextDisabled("no keys, init to end values");
+        if(ImGui::Button("add keys")){
+            curve = line;
+        }
+        ImGui::TreePop();
+        return;
+    }
+
+    int remove = -1;
+    const int count = curve.keys.size();
+    for(int i = 0; i < count; i++){
+        typename ParticleCurve<T>::Key& key = curve.keys[i];
+        ImGui::PushID(i);
+        const float lo = i > 0 ? curve.keys[i - 1].t : 0;
+        const float hi = i < count - 1 ? curve.keys[i + 1].t : 1;
+        ImGui::SliderFloat("age", &key.t, lo, hi);
+        keyValueUi(key.value, maxValue);
+        if(count > 1 && ImGui::SmallButton("remove key")){
+            remove = i;
+        }
+        ImGui::PopID();
+    }
+    if(remove >= 0){
+        curve.keys.erase(curve.keys.begin() + remove);
+    }
+
+    if(ImGui::Button("add key")){
+        // in the middle of the widest gap, on the curve
+        float gapStart = 0, gapEnd = curve.keys.front().t;
+        for(size_t i = 0; i <= curve.keys.size(); i++){
+            const float a = i > 0 ? curve.keys[i - 1].t : 0;
+            const float b = i < curve.keys.size() ? curve.keys[i].t : 1;
+            if(b - a > gapEnd - gapStart){
+                gapStart = a;
+                gapEnd = b;
+            }
+        }
+        const float t = (gapStart + gapEnd) / 2;
+        curve.keys.push_back({t, curve.evaluate(t)});
+        curve.sort();
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("clear keys")){
+        curve.keys.clear();
+    }
+    ImGui::TreePop();
+}
+
+void ParticleModifier::curvesUi(){
+    const ParticleCurves line = ParticleCurves::linear(pe.initColor, pe.endColor, pe.initBillboardSize, pe.endBillboardSize);
+    curveUi("color curve", pe.curves.color, line.color, 1);
+    curveUi("size curve", pe.curves.size, line.size, 10);
+    curveUi("alpha curve", pe.curves.alpha, line.alpha, 1);
+
+    // what the texture row holds
+    const ParticleCurves c = pe.lifetimeCurves();
+    const int samples = 32;
+    float sizes[samples], alphas[samples];
+    for(int i = 0; i < samples; i++){
+        const float t = float(i) / (samples - 1);
+        sizes[i] = c.size.evaluate(t);
+        alphas[i] = c.alpha.evaluate(t);
+    }
+    ImGui::PlotLines("size", sizes, samples, 0, nullptr, 0, FLT_MAX);
+    ImGui::PlotLines("alpha", alphas, samples, 0, nullptr, 0, 1);
+    for(int i = 0; i < 8; i++){
+        const glm::vec3 col = c.color.evaluate(i / 7.0f);
+        if(i > 0) ImGui::SameLine();
+        ImGui::ColorButton(ImVec4(col.x, col.y, col.z, 1), true);
+    }
+    ImGui::SameLine();
+    ImGui::Text("color, %d uploads", pe.curveUploads());
+}
+
 void ParticleModifier::drawUi(){
     std::stringstream ss;
     ss << "particle emitter " << &pe;
     if(ImGui::CollapsingHeader(ss.str().c_str())){
 
+        ImGui::Text("particles %d (peak %d), capacity %d%s", pe.liveParticles(), pe.peakParticles(), pe.capacity(), pe.hasOverflowed() ? ", overflowed" : "");
+        ImGui::Checkbox("grow buffers when full", &pe.autoGrow);
+        ImGui::Separator();
+
         ImGui::SliderFloat3("emitter velocity", value_ptr(pe.emitterVelocity), -1, 1);
         ImGui::SliderFloat("emitter speed", &pe.emitterSpeed, 0, 10);
         ImGui::Separator();
 
         ImGui::SliderFloat("emitTime", &pe.emitTime, 0, 10);
         ImGui::SliderInt("emitCount", &pe.emitCount, 1, 100);
+        ImGui::Text("emission rate %.1f/s", pe.emissionRate());
+
+        // what the scheduler asks for and the passes emit over 10 seconds
+        // at each frame rate
+        static const ParticleEmitter* checked = nullptr;
+        static const double frameRates[] = {30, 60, 144, 240};
+        static ParticleEmissionCheck checks[4];
+        if(ImGui::Button("check rate at 30-240 fps")){
+            checked = &pe;
+            for(int i = 0; i < 4; i++){
+                checks[i] = pe.checkEmissionRate(frameRates[i], 10);
+            }
+        }
+        if(checked == &pe && pe.emissionRate() > 0){
+            for(int i = 0; i < 4; i++){
+                const ParticleEmissionCheck& c = checks[i];
+                if(c.target <= 0) continue;
+                if(c.measured < 0){
+                    ImGui::Text("%3.0f fps: scheduled %+.2f%%, measured: buffers filled", frameRates[i],
+                        100.0 * (c.scheduled / c.target - 1));
+                }else{
+                    ImGui::Text("%3.0f fps: scheduled %+.2f%%, measured %.1f/s (%+.2f%%)", frameRates[i],
+                        100.0 * (c.scheduled / c.target - 1), c.measured,
+                        100.0 * (c.measured / c.target - 1));
+                }
+            }
+        }
 
         ImGui::Checkbox("one off", &pe.isOneOff);
         if(pe.isOneOff){
@@ -44,6 +164,21 @@ void ParticleModifier::drawUi(){
         ImGui::SliderFloat("max speed", &pe.maxSpeed, 0, 1000);
         // ImGui::SliderFloat("speed drop to percent", &pe.speedDropPercent, 0, 10);
 
+        const char* shapes[] = {"cube", "sphere shell", "cone", "mesh surface"};
+        int shape = pe.spawnShape;
+        if(ImGui::Combo("spawn shape", &shape, shapes, sizeof(shapes) / sizeof(const char*))){
+            pe.spawnShape = ParticleSpawnShape(shape);
+        }
+        if(pe.spawnShape == SpawnCone){
+            ImGui::SliderFloat("cone angle", &pe.coneAngle, 0, 3.14159f);
+        }
+        if(pe.spawnShape == SpawnMeshSurface){
+            if(pe.spawnMesh){
+                ImGui::Text("%d triangles, area %.1f", pe.spawnMesh->triangles(), pe.spawnMesh->area());
+            }else{
+                ImGui::TextDisabled("no mesh, spawning in the cube");
+            }
+        }
         ImGui::SliderFloat("spawn radius", &pe.spawnRadius, 0, 10);
         ImGui::SliderFloat("init billboard size", &pe.initBillboardSize, 0, 10);
         ImGui::SliderFloat("end billboard size", &pe.endBillboardSize, 0, 10);
@@ -51,14 +186,128 @@ void ParticleModifier::drawUi(){
 
         ImGui::SliderFloat3("inital color", value_ptr(pe.initColor), 0, 1);
         ImGui::SliderFloat3("end color", value_ptr(pe.endColor), 0, 1);
+        if(ImGui::TreeNode("lifetime curves")){
+            curvesUi();
+            ImGui::TreePop();
+        }
+
+        ImGui::Separator();
+        collisionUi(pe.collision, pe.restitution);
+        if(pe.collision != CollideNone){
+            ImGui::Text("%d colliders in reach (%.0f)", int(pe.colliders.size()), pe.particleReach());
+        }
 
 
         if(ImGui::Button("example 1")){
             example1();
         }
+
+        ImGui::Separator();
+        sortUi(pe.sortMode);
+        if(ParticleEmitter::packedSupported()){
+            bool packed = pe.packedRecords();
+            if(ImGui::Checkbox("packed records (24 bytes)", &packed)){
+                pe.setPackedRecords(packed);
+            }
+        }
+        ImGui::Checkbox("instanced quads (no geometry shader)", &pe.instancedQuads);
+        if(ParticleEmitter::computeSupported()){
+            ImGui::Checkbox("compute shader simulation", &pe.useCompute);
+        }else{
+            ImGui::TextDisabled("compute shader simulation needs GL 4.3");
+        }
+        ImGui::Checkbox("CPU simulation", &pe.useCpuSim);
+
+        if(ImGui::Button("check CPU parity")){
+            pe.checkCpuParity(1.0 / 60);
+        }
+        const ParticleParityReport& r = pe.lastParity;
+        if(r.valid){
+            ImGui::Text("records gpu %d cpu %d, type mismatches %d", r.gpuRecords, r.cpuRecords, r.typeMismatches);
+            ImGui::Text("max error pos %g vel %g age %g", r.maxPosError, r.maxVelError, r.maxAgeError);
+            ImGui::Text("max spawn speed error %g", r.maxSpawnSpeedError);
+        }
+
+        // shared between emitters, it doesn't depend on them
+        static double benchRate[2] = {0, 0};
+        static int benchThreads = 1;
+        if(ImGui::Button("benchmark CPU simulation")){
+            benchThreads = ParticleSimCPU::maxThreads();
+            benchRate[0] = ParticleSimCPU::benchmark(1000000, 20, 1);
+            benchRate[1] = ParticleSimCPU::benchmark(1000000, 20, benchThreads);
+        }
+        if(benchRate[0] > 0){
+            ImGui::Text("1 thread: %.1f M particles/s", benchRate[0] / 1e6);
+            ImGui::Text("%d threads: %.1f M particles/s (%.1f M/s per core)", benchThreads, benchRate[1] / 1e6, benchRate[1] / 1e6 / benchThreads);
+        }
+    }
+}
+
+
+void ParticleModifier::sortUi(ParticleSort::Mode& mode){
+    const char* modes[] = {"unsorted", "sorted (CPU radix)", "sorted (GPU bitonic)"};
+    int m = mode;
+    if(ImGui::Combo("draw order", &m, modes, sizeof(modes) / sizeof(const char*))){
+        mode = ParticleSort::Mode(m);
+    }
+    if(mode == ParticleSort::Gpu && !ParticleSort::gpuSupported()){
+        ImGui::TextDisabled("GPU sorting needs GL 4.3, drawing unsorted");
     }
 }
 
+void ParticleModifier::formatBenchmarkUi(){
+    static ParticleFormatBenchmark results[4];
+    if(ImGui::Button("benchmark particle record formats")){
+        const int sizes[] = {1 << 14, 1 << 16, 1 << 18, 1 << 20};
+        for(int i = 0; i < 4; i++){
+            results[i] = ParticleEmitter::benchmarkRecordFormats(sizes[i]);
+        }
+    }
+    for(const ParticleFormatBenchmark& r : results){
+        if(r.particles == 0) continue;
+        // particles per second through one update pass
+        ImGui::Text("%7d particles: 32 B %.1f M/s, 24 B %.1f M/s", r.particles,
+            r.fullMs > 0 ? r.particles / r.fullMs / 1e3 : 0.0,
+            r.packedMs > 0 ? r.particles / r.packedMs / 1e3 : 0.0);
+    }
+}
+
+void ParticleModifier::collisionUi(ParticleCollision& collision, float& restitution){
+    const char* responses[] = {"no collisions", "bounce", "stick", "kill"};
+    int c = collision;
+    if(ImGui::Combo("collision", &c, responses, sizeof(responses) / sizeof(const char*))){
+        collision = ParticleCollision(c);
+    }
+    if(collision == CollideBounce){
+        ImGui::SliderFloat("restitution", &restitution, 0, 1);
+    }
+}
+
+void ParticleModifier::colliderBenchmarkUi(){
+    static ParticleColliderBenchmark result;
+    if(ImGui::Button("benchmark collider count")){
+        result = ParticleEmitter::benchmarkColliders(1 << 18);
+    }
+    for(size_t i = 0; i < result.colliders.size(); i++){
+        ImGui::Text("%2d colliders: GPU %.3f ns, CPU %.3f ns per particle", result.colliders[i], result.gpuNs[i], result.cpuNs[i]);
+    }
+}
+
+void ParticleModifier::sortBenchmarkUi(){
+    static ParticleSort::BenchmarkResult results[2];
+    if(ImGui::Button("benchmark particle sorting")){
+        results[0] = ParticleSort::benchmark(100000);
+        results[1] = ParticleSort::benchmark(1000000);
+    }
+    for(const ParticleSort::BenchmarkResult& r : results){
+        if(r.particles == 0) continue;
+        if(r.gpuMs > 0){
+            ImGui::Text("%d particles: CPU %.2f ms, GPU %.2f ms", r.particles, r.cpuMs, r.gpuMs);
+        }else{
+            ImGui::Text("%d particles: CPU %.2f ms", r.particles, r.cpuMs);
+        }
+    }
+}
 
 void ParticleModifier::example1(){
     pe.emitTime = 0.1;
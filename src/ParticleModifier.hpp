@@ -10,11 +10,24 @@ class ParticleModifier
 {
 private:
     ParticleEmitter& pe;
+    // keys of the emitter's colour, size and alpha curves, and a preview
+    void curvesUi();
 public:
     
     ParticleModifier(ParticleEmitter& pEmit);
     ~ParticleModifier();
     void example1();
     void drawUi();
+
+    // draw order combo, also used for the trail batch
+    static void sortUi(ParticleSort::Mode& mode);
+    // times ParticleSort at 100k and 1M particles
+    static void sortBenchmarkUi();
+    // times the update pass with both record formats over buffer sizes
+    static void formatBenchmarkUi();
+    // collision response combo, also used for the trail batch
+    static void collisionUi(ParticleCollision& collision, float& restitution);
+    // times the update pass against 0 to 16 colliders
+    static void colliderBenchmarkUi();
 };
 
@@ -0,0 +1,413 @@
+#include "ParticleSimCPU.hpp"
+#include "ForceField3D.hpp"
+#include "MeshSurfaceSampler.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef CGRA_HAVE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace glm;
+using namespace std;
+
+namespace {
+const float EMITTER_TYPE = 1;
+const float PARTICLE_TYPE = 2;
+
+// Particles integrated per task.
+const int batchSize = 4096;
+
+// The shader's random number generator. offset is a global in the shader,
+// so it starts over at 1 for every input primitive.
+struct ShaderRand {
+    float delta;
+    float randIterator;
+    float offset = 1;
+
+    float randNoise(vec2 co) const {
+        return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453f);
+    }
+
+    float rand() {
+        offset += delta * 100 + randIterator * 1000;
+        return randNoise(vec2(offset, offset / 2));
+    }
+
+    float randRange(float min, float max) { return mix(min, max, rand()); }
+};
+} // namespace
+
+void ParticleSimCPU::Particles::resize(size_t n) {
+    for (auto *v : {&px, &py, &pz, &vx, &vy, &vz, &age}) {
+        v->resize(n);
+    }
+}
+
+ParticleSimCPU::ParticleSimCPU(int capacity)
+    : m_capacity(std::max(capacity, 1)) {
+    m_particles[0].resize(m_capacity - 1);
+    m_particles[1].resize(m_capacity - 1);
+    reset(vec3(0));
+}
+
+void ParticleSimCPU::reset(const vec3 &pos) {
+    m_emitter = Particle{EMITTER_TYPE, pos, vec3(0), 0};
+    m_hasEmitter = true;
+    m_count = 0;
+}
+
+void ParticleSimCPU::load(const Particle *records, int count) {
+    count = std::min(count, m_capacity);
+    m_hasEmitter = false;
+    m_count = 0;
+
+    Particles &p = m_particles[m_current];
+    for (int i = 0; i < count; i++) {
+        const Particle &r = records[i];
+        if (int(r.type) == int(EMITTER_TYPE)) {
+            m_emitter = r;
+            m_hasEmitter = true;
+        } else if (int(r.type) == int(PARTICLE_TYPE) &&
+                   m_count < m_capacity - 1) {
+            // one record is kept for the emitter, whether or not it's here
+            p.px[m_count] = r.pos.x;
+            p.py[m_count] = r.pos.y;
+            p.pz[m_count] = r.pos.z;
+            p.vx[m_count] = r.vel.x;
+            p.vy[m_count] = r.vel.y;
+            p.vz[m_count] = r.vel.z;
+            p.age[m_count] = r.age;
+            m_count++;
+        }
+    }
+}
+
+bool ParticleSimCPU::stepEmitter(Particle &emitter,
+                                 const ParticleSimParams &params) {
+    const float delta = params.delta;
+    const float age = emitter.age + delta;
+    vec3 emitterPosition = emitter.pos;
+    if (length(params.emitterVelocity) > 0) {
+        emitterPosition = emitter.pos + (normalize(params.emitterVelocity) *
+                                         params.emitterSpeed * delta);
+    }
+    if (params.shouldUpdatePosition) {
+        emitterPosition = params.updatePos + (normalize(params.emitterVelocity) *
+                                              params.emitterSpeed * delta);
+    }
+
+    const bool isTimeToEmit = params.emitCount > 0;
+
+    // The shader writes the emitter's velocity uniform, not the
+    // normalised one it computes.
+    emitter.pos = emitterPosition;
+    emitter.vel = params.emitterVelocity;
+    emitter.age = isTimeToEmit ? 0 : age;
+    return isTimeToEmit;
+}
+
+vec3 ParticleSimCPU::spawnDirection(const ParticleSimParams &params,
+                                    const vec3 &r) {
+    if (params.spawnShape == SpawnCone) {
+        const vec3 axis = normalize(params.initVelocity);
+        const vec3 side = normalize(cross(
+            axis, std::abs(axis.x) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0)));
+        const vec3 up = cross(axis, side);
+        const float cosTheta = mix(std::cos(params.coneAngle), 1.0f, r.x);
+        const float sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+        const float phi = r.y * 6.2831853f;
+        return (side * std::cos(phi) + up * std::sin(phi)) * sinTheta +
+               axis * cosTheta;
+    }
+    return normalize(params.initVelocity +
+                     mix(-params.velVariance, params.velVariance, r));
+}
+
+vec3 ParticleSimCPU::spawnOffset(const ParticleSimParams &params,
+                                 const vec3 &r) {
+    switch (params.spawnShape) {
+    case SpawnSphereShell: {
+        const float z = r.x * 2 - 1;
+        const float ring = std::sqrt(1 - z * z);
+        const float phi = r.y * 6.2831853f;
+        return vec3(ring * std::cos(phi), ring * std::sin(phi), z) *
+               params.spawnRadius;
+    }
+    case SpawnCone:
+        return vec3(0);
+    case SpawnMeshSurface:
+        if (params.spawnMesh && params.spawnMesh->triangles() > 0) {
+            return params.spawnMeshBasis *
+                   params.spawnMesh->sample(r.x, r.y, r.z);
+        }
+        break;
+    default:
+        break;
+    }
+    return mix(vec3(-1), vec3(1), r) * params.spawnRadius;
+}
+
+void ParticleSimCPU::step(const ParticleSimParams &params) {
+    const float delta = params.delta;
+    Particles &src = m_particles[m_current];
+    Particles &dst = m_particles[1 - m_current];
+    const int maxParticles = m_capacity - 1;
+    int written = 0;
+
+    // -- handleEmitter --
+    if (m_hasEmitter) {
+        const vec3 oldPosition = m_emitter.pos;
+        if (stepEmitter(m_emitter, params)) {
+            ShaderRand rng{delta, params.randIterator};
+            for (int i = 0; i < params.emitCount; i++) {
+                // Drawn in the same order as the shader's statements.
+                float x = rng.rand();
+                float y = rng.rand();
+                float z = rng.rand();
+                const vec3 newPartVel =
+                    spawnDirection(params, vec3(x, y, z)) * params.initSpeed;
+
+                x = rng.rand();
+                y = rng.rand();
+                z = rng.rand();
+                const vec3 spawnPos =
+                    oldPosition + spawnOffset(params, vec3(x, y, z));
+
+                // Transform feedback drops whatever doesn't fit.
+                if (written < maxParticles) {
+                    dst.px[written] = spawnPos.x;
+                    dst.py[written] = spawnPos.y;
+                    dst.pz[written] = spawnPos.z;
+                    dst.vx[written] = newPartVel.x;
+                    dst.vy[written] = newPartVel.y;
+                    dst.vz[written] = newPartVel.z;
+                    dst.age[written] = 0;
+                    written++;
+                }
+            }
+        }
+    }
+
+    // -- handleParticle --
+    const float ageStep = delta * ShaderRand{delta, params.randIterator}.rand();
+    const float lifeTime = params.lifeTime;
+    const float drag = params.dragStrength;
+    const vec3 force = params.constForceDir * params.constForceStrength;
+
+    const int count = m_count;
+    const int batches = (count + batchSize - 1) / batchSize;
+    m_batchAlive.assign(batches + 1, 0);
+    int *batchAlive = m_batchAlive.data();
+
+    float *px = src.px.data(), *py = src.py.data(), *pz = src.pz.data();
+    float *vx = src.vx.data(), *vy = src.vy.data(), *vz = src.vz.data();
+    float *age = src.age.data();
+
+    // The acceleration per particle up front, constant force plus the field
+    // lookup, as arrays so the integration loop only reads them.
+    const ForceField3D *field =
+        params.forceField && params.forceField->baked() ? params.forceField
+                                                        : nullptr;
+    m_accelX.resize(count);
+    m_accelY.resize(count);
+    m_accelZ.resize(count);
+    float *ax = m_accelX.data(), *ay = m_accelY.data(), *az = m_accelZ.data();
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        const vec3 f =
+            field ? force + field->sample(vec3(px[i], py[i], pz[i])) : force;
+        ax[i] = f.x;
+        ay[i] = f.y;
+        az[i] = f.z;
+    }
+
+    const ParticleCollision collision = params.collision;
+    const int colliderCount = params.activeColliders();
+    const vec4 *colliders = params.colliders;
+    const float bounce = 1 + params.restitution;
+    const bool stick = collision == CollideStick;
+
+    // Integrate in place, then test the colliders in order, then count the
+    // survivors of every batch. Every pass is a straight loop over arrays
+    // with selects for the branches, so each vectorises.
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < batches; b++) {
+        const int begin = b * batchSize;
+        const int end = std::min(begin + batchSize, count);
+
+#pragma omp simd
+        for (int i = begin; i < end; i++) {
+            float nvx = vx[i] + (-vx[i] * drag + ax[i]) * delta;
+            float nvy = vy[i] + (-vy[i] * drag + ay[i]) * delta;
+            float nvz = vz[i] + (-vz[i] * drag + az[i]) * delta;
+
+            // normalize(vel) * length(vel), skipped for a stopped particle
+            // like on the GPU.
+            const float sp = std::sqrt(nvx * nvx + nvy * nvy + nvz * nvz);
+            // (no division under a condition, so this stays branch free)
+            const float inv = 1.0f / (sp > 0 ? sp : 1.0f);
+            nvx = sp > 0 ? nvx * inv * sp : nvx;
+            nvy = sp > 0 ? nvy * inv * sp : nvy;
+            nvz = sp > 0 ? nvz * inv * sp : nvz;
+
+            px[i] += nvx * delta;
+            py[i] += nvy * delta;
+            pz[i] += nvz * delta;
+            vx[i] = nvx;
+            vy[i] = nvy;
+            vz[i] = nvz;
+            age[i] += ageStep;
+        }
+
+        // collide() of the update shaders, a pass per sphere. A killed
+        // particle is dropped whatever later spheres do to it.
+        for (int c = 0; c < colliderCount; c++) {
+            const vec4 sphere = colliders[c];
+            const float r2 = sphere.w * sphere.w;
+            if (collision == CollideKill) {
+#pragma omp simd
+                for (int i = begin; i < end; i++) {
+                    const float dx = px[i] - sphere.x, dy = py[i] - sphere.y,
+                                dz = pz[i] - sphere.z;
+                    const float d2 = dx * dx + dy * dy + dz * dz;
+                    age[i] = d2 < r2 && age[i] < lifeTime ? lifeTime : age[i];
+                }
+                continue;
+            }
+#pragma omp simd
+            for (int i = begin; i < end; i++) {
+                const float x = px[i], y = py[i], z = pz[i];
+                const float dx = x - sphere.x, dy = y - sphere.y,
+                            dz = z - sphere.z;
+                const float d2 = dx * dx + dy * dy + dz * dz;
+                const bool hit = d2 < r2;
+
+                // straight up from the centre
+                const float id = 1.0f / std::sqrt(d2 > 0 ? d2 : 1.0f);
+                const float nx = dx * id;
+                const float ny = dy * id + (d2 > 0 ? 0.0f : 1.0f);
+                const float nz = dz * id;
+                // out onto the surface, blended rather than selected: three
+                // selects on hit get merged into a branch and the loop stops
+                // vectorising
+                const float m = hit ? 1.0f : 0.0f;
+                px[i] = x + m * (sphere.x + nx * sphere.w - x);
+                py[i] = y + m * (sphere.y + ny * sphere.w - y);
+                pz[i] = z + m * (sphere.z + nz * sphere.w - z);
+
+                const float vn = vx[i] * nx + vy[i] * ny + vz[i] * nz;
+                const float k = hit & (vn < 0) ? bounce * vn : 0.0f;
+                const bool stop = hit & stick;
+                vx[i] = stop ? 0.0f : vx[i] - k * nx;
+                vy[i] = stop ? 0.0f : vy[i] - k * ny;
+                vz[i] = stop ? 0.0f : vz[i] - k * nz;
+            }
+        }
+
+        int alive = 0;
+#pragma omp simd reduction(+ : alive)
+        for (int i = begin; i < end; i++) {
+            alive += age[i] < lifeTime ? 1 : 0;
+        }
+        batchAlive[b + 1] = alive;
+    }
+
+    for (int b = 0; b < batches; b++) {
+        batchAlive[b + 1] += batchAlive[b];
+    }
+
+    // Compact the survivors after the new particles, keeping their order.
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < batches; b++) {
+        const int begin = b * batchSize;
+        const int end = std::min(begin + batchSize, count);
+        int out = written + batchAlive[b];
+        for (int i = begin; i < end && out < maxParticles; i++) {
+            if (age[i] < lifeTime) {
+                dst.px[out] = px[i];
+                dst.py[out] = py[i];
+                dst.pz[out] = pz[i];
+                dst.vx[out] = vx[i];
+                dst.vy[out] = vy[i];
+                dst.vz[out] = vz[i];
+                dst.age[out] = age[i];
+                out++;
+            }
+        }
+    }
+
+    m_count = std::min(written + batchAlive[batches], maxParticles);
+    m_current = 1 - m_current;
+}
+
+void ParticleSimCPU::store(Particle *records) const {
+    int r = 0;
+    if (m_hasEmitter) {
+        records[r++] = m_emitter;
+    }
+
+    const Particles &p = m_particles[m_current];
+    for (int i = 0; i < m_count; i++) {
+        records[r++] = Particle{PARTICLE_TYPE, vec3(p.px[i], p.py[i], p.pz[i]),
+                                vec3(p.vx[i], p.vy[i], p.vz[i]), p.age[i]};
+    }
+}
+
+double ParticleSimCPU::benchmark(int particles, int steps, int threads,
+                                 int colliders) {
+    ParticleSimCPU sim(particles + 1);
+
+    vector<Particle> records(particles + 1);
+    records[0] = Particle{EMITTER_TYPE, vec3(0), vec3(0), 0};
+    for (int i = 1; i <= particles; i++) {
+        const float f = float(i) / particles;
+        records[i] = Particle{PARTICLE_TYPE, vec3(f, 0, -f),
+                              vec3(0.5f + f, 1, f), 0};
+    }
+    sim.load(records.data(), int(records.size()));
+
+    // Nothing dies or gets emitted, so every step integrates the full pool.
+    ParticleSimParams params;
+    params.delta = 1.0f / 60;
+    params.lifeTime = 1e9f;
+    params.dragStrength = 0.2f;
+    params.constForceDir = vec3(0, -1, 0);
+    params.constForceStrength = 1;
+    params.collision = CollideBounce;
+    params.colliderCount = std::min(colliders, MAX_PARTICLE_COLLIDERS);
+    for (int c = 0; c < params.colliderCount; c++) {
+        params.colliders[c] = vec4(1000 + 10 * c, 0, 0, 1);
+    }
+
+#ifdef CGRA_HAVE_OPENMP
+    const int previousThreads = omp_get_max_threads();
+    omp_set_num_threads(std::max(threads, 1));
+#else
+    (void)threads;
+#endif
+
+    const auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) {
+        sim.step(params);
+    }
+    const double seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+#ifdef CGRA_HAVE_OPENMP
+    omp_set_num_threads(previousThreads);
+#endif
+
+    return seconds > 0 ? double(particles) * steps / seconds : 0.0;
+}
+
+int ParticleSimCPU::maxThreads() {
+#ifdef CGRA_HAVE_OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "opengl.hpp"
+
+class ForceField3D;
+class MeshSurfaceSampler;
+
+// One record of the particle buffers, interleaved the same way the
+// transform feedback varyings are.
+struct Particle {
+    GLfloat type;
+    glm::vec3 pos;
+    glm::vec3 vel;
+    GLfloat age;
+};
+
+// The same record in 24 bytes, written by the shaders when PACKED_RECORDS
+// is defined. Velocity is in half floats, and the type (a small integer)
+// fills the top of the last word. Position and age stay full floats, the
+// per frame steps are too small for halves once far out or near the end of
+// a long life.
+struct PackedParticle {
+    glm::vec3 pos;
+    GLfloat age;
+    GLuint velXY;
+    GLuint velZType;
+};
+
+inline PackedParticle packParticle(const Particle &p) {
+    return PackedParticle{
+        p.pos, p.age, glm::packHalf2x16(glm::vec2(p.vel.x, p.vel.y)),
+        glm::packHalf2x16(glm::vec2(p.vel.z, 0)) | (GLuint(p.type) << 16)};
+}
+
+inline Particle unpackParticle(const PackedParticle &p) {
+    const glm::vec2 xy = glm::unpackHalf2x16(p.velXY);
+    const float z = glm::unpackHalf2x16(p.velZType).x;
+    return Particle{GLfloat(p.velZType >> 16), p.pos, glm::vec3(xy, z), p.age};
+}
+
+// Where new particles appear around the emitter. Every shape draws the same
+// six random numbers per particle, three for the direction and three for
+// the position, so backends that skip ahead in the sequence still agree.
+enum ParticleSpawnShape {
+    SpawnCube,        // within spawnRadius on every axis
+    SpawnSphereShell, // on a sphere of spawnRadius
+    SpawnCone,        // from the emitter, within coneAngle of initVelocity
+    SpawnMeshSurface, // on spawnMesh, placed by spawnMeshBasis
+};
+
+// What a particle does when a step ends inside one of its collider spheres.
+// The sphere tests come after the integration, in collider order.
+enum ParticleCollision {
+    CollideNone,
+    CollideBounce, // back onto the surface, reflected with restitution
+    CollideStick,  // back onto the surface and stopped
+    CollideKill,   // dropped, like one that ran out of life
+};
+
+// Spheres a single update can test against, the length of the uniform
+// arrays in the update shaders (MAX_COLLIDERS).
+const int MAX_PARTICLE_COLLIDERS = 16;
+
+// Everything the update shader gets as uniforms for a single step.
+struct ParticleSimParams {
+    float delta = 0;
+    glm::vec3 emitterVelocity = glm::vec3(0);
+    float emitterSpeed = 0;
+    // Particles the emitter spawns this step, scheduled on the CPU (see
+    // ParticleEmitter::takeParams). 0 leaves the emitter ageing.
+    int emitCount = 0;
+    float spawnRadius = 1;
+    ParticleSpawnShape spawnShape = SpawnCube;
+    float coneAngle = 0.3f; // radians, half the cone's opening
+    const MeshSurfaceSampler *spawnMesh = nullptr;
+    glm::mat3 spawnMeshBasis = glm::mat3(1);
+
+    bool shouldUpdatePosition = false;
+    glm::vec3 updatePos = glm::vec3(0);
+
+    glm::vec3 initVelocity = glm::vec3(0, 1, 0);
+    float initSpeed = 3;
+    float lifeTime = 20;
+
+    glm::vec3 velVariance = glm::vec3(0);
+    glm::vec3 constForceDir = glm::vec3(0);
+    float constForceStrength = 0;
+    float dragStrength = 0;
+    // sampled at every particle's position and added to the acceleration
+    const ForceField3D *forceField = nullptr;
+
+    ParticleCollision collision = CollideNone;
+    float restitution = 0.5f;
+    // centre and radius, in world space
+    int colliderCount = 0;
+    glm::vec4 colliders[MAX_PARTICLE_COLLIDERS];
+
+    float randIterator = 0;
+
+    // the colliders a step tests, none without a response
+    int activeColliders() const {
+        return collision == CollideNone
+                   ? 0
+                   : std::min(colliderCount, MAX_PARTICLE_COLLIDERS);
+    }
+};
+
+// CPU implementation of particle_update_geometry.glsl. Produces the same
+// records in the same order as the transform feedback pass (emitter, then
+// anything it emitted, then the surviving particles), including the
+// shader's quirks, so the two can be swapped or compared.
+//
+// Particles are stored as structure of arrays and integrated in batches
+// across threads. The shader's rand() restarts for every primitive, so
+// every particle gets the same random age step and the integration loop
+// has no per-particle state to vectorise around. Field lookups and
+// collider tests are passes of their own, so the loops over particles are
+// branch free.
+class ParticleSimCPU {
+  private:
+    struct Particles {
+        std::vector<float> px, py, pz;
+        std::vector<float> vx, vy, vz;
+        std::vector<float> age;
+
+        void resize(size_t n);
+    };
+
+    int m_capacity; // in records, including the emitter
+    Particle m_emitter;
+    bool m_hasEmitter = false;
+
+    Particles m_particles[2];
+    int m_count = 0;
+    int m_current = 0;
+
+    std::vector<int> m_batchAlive;
+    // constant force plus the force field, per particle
+    std::vector<float> m_accelX, m_accelY, m_accelZ;
+
+  public:
+    explicit ParticleSimCPU(int capacity = 5000);
+
+    // Starts over with just an emitter at pos.
+    void reset(const glm::vec3 &pos);
+
+    // Replaces the state with records read back from a particle buffer.
+    void load(const Particle *records, int count);
+
+    void step(const ParticleSimParams &params);
+
+    // handleEmitter's update of the emitter record. Returns true if it emits
+    // this step, the new particles spawn around its position before the step.
+    static bool stepEmitter(Particle &emitter, const ParticleSimParams &params);
+
+    // spawnDirection() and spawnOffset() of the update shaders, from the six
+    // random numbers they draw. The direction is unit length.
+    static glm::vec3 spawnDirection(const ParticleSimParams &params,
+                                    const glm::vec3 &r);
+    static glm::vec3 spawnOffset(const ParticleSimParams &params,
+                                 const glm::vec3 &r);
+
+    // Writes count() records, in buffer order.
+    void store(Particle *records) const;
+
+    int count() const { return (m_hasEmitter ? 1 : 0) + m_count; }
+    int capacity() const { return m_capacity; }
+
+    // Steps a full pool of long lived particles and returns the particles
+    // integrated per second using the given number of threads. The
+    // particles are tested against that many colliders they never hit.
+    static double benchmark(int particles, int steps, int threads,
+                            int colliders = 0);
+
+    // Threads a step can use, 1 without OpenMP.
+    static int maxThreads();
+};
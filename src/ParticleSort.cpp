@@ -0,0 +1,364 @@
+#include "ParticleSort.hpp"
+#include "cgra/cgra_assets.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#ifdef CGRA_HAVE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace glm;
+using namespace cgra;
+using namespace std;
+
+namespace {
+// Must match the shaders.
+const int keyGroupSize = 256;
+const int bitonicBlock = 1024; // elements sorted in shared memory at once
+
+const int radixBits = 8;
+const int radixSize = 1 << radixBits;
+// below this many keys per thread, threads cost more than they save
+const int minKeysPerThread = 16384;
+
+// DrawElementsIndirectCommand
+struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLuint baseVertex;
+    GLuint baseInstance;
+};
+
+// Maps depth to a key that sorts farthest first, the same as the key shader.
+uint32_t depthKey(float depth) {
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    bits ^= (bits & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+    return ~bits;
+}
+
+int recordType(const float* word, bool packed) {
+    if(!packed) return int(*word);
+    uint32_t bits;
+    std::memcpy(&bits, word, sizeof(bits));
+    return int(bits >> 16);
+}
+
+int threadCount(int count) {
+#ifdef CGRA_HAVE_OPENMP
+    return std::max(1, std::min(omp_get_max_threads(), count / minKeysPerThread));
+#else
+    (void)count;
+    return 1;
+#endif
+}
+
+int threadIndex() {
+#ifdef CGRA_HAVE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+int nextPowerOfTwo(int n) {
+    int p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+}
+
+bool ParticleSort::gpuSupported()
+{
+    return GLEW_VERSION_4_3;
+}
+
+void ParticleSort::reserveIndices(int count)
+{
+    if(!m_indexBuffer) glGenBuffers(1, &m_indexBuffer);
+    if(count <= m_indexCapacity) return;
+    m_indexCapacity = nextPowerOfTwo(count);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, m_indexCapacity * sizeof(GLuint), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void ParticleSort::sortCpu(const float* records, int count, const mat4& view)
+{
+    m_keys.resize(count);
+    m_values.resize(count);
+
+    // only the view z row is needed for depth
+    const vec4 zRow = vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+    const ParticleRecordLayout l = m_layout;
+
+    int drawn = 0;
+    for(int i = 0; i < count; i++){
+        const float* r = records + size_t(i) * l.stride;
+        if(recordType(r + l.typeOffset, l.packedType) != int(l.drawType)) continue;
+        const float* p = r + l.positionOffset;
+        const float depth = -(zRow.x * p[0] + zRow.y * p[1] + zRow.z * p[2] + zRow.w);
+        m_keys[drawn] = depthKey(depth);
+        m_values[drawn] = i;
+        drawn++;
+    }
+
+    radixSort(drawn);
+
+    reserveIndices(drawn);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, drawn * sizeof(GLuint), m_values.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_cpuCount = drawn;
+    m_lastSort = Cpu;
+}
+
+// Least significant digit first, a byte at a time. Every pass splits the
+// keys into a contiguous chunk per thread, counts digits per chunk, and
+// scatters each chunk to offsets that put it after the same digits of the
+// earlier chunks, so the passes stay stable.
+void ParticleSort::radixSort(int count)
+{
+    const int threads = threadCount(count);
+    m_keysTemp.resize(count);
+    m_valuesTemp.resize(count);
+    m_histograms.resize(threads * radixSize);
+
+    uint32_t* keys = m_keys.data();
+    uint32_t* values = m_values.data();
+    uint32_t* keysOut = m_keysTemp.data();
+    uint32_t* valuesOut = m_valuesTemp.data();
+    int* histograms = m_histograms.data();
+
+    // an even number of passes, so the result ends up back in m_keys
+    for(int shift = 0; shift < 32; shift += radixBits){
+        std::fill(m_histograms.begin(), m_histograms.end(), 0);
+
+#pragma omp parallel num_threads(threads)
+        {
+            const int t = threadIndex();
+            const int begin = int(int64_t(count) * t / threads);
+            const int end = int(int64_t(count) * (t + 1) / threads);
+            int* h = histograms + t * radixSize;
+
+            for(int i = begin; i < end; i++){
+                h[(keys[i] >> shift) & (radixSize - 1)]++;
+            }
+
+#pragma omp barrier
+#pragma omp single
+            {
+                int sum = 0;
+                for(int d = 0; d < radixSize; d++){
+                    for(int c = 0; c < threads; c++){
+                        const int n = histograms[c * radixSize + d];
+                        histograms[c * radixSize + d] = sum;
+                        sum += n;
+                    }
+                }
+            }
+
+            for(int i = begin; i < end; i++){
+                const int o = h[(keys[i] >> shift) & (radixSize - 1)]++;
+                keysOut[o] = keys[i];
+                valuesOut[o] = values[i];
+            }
+        }
+
+        std::swap(keys, keysOut);
+        std::swap(values, valuesOut);
+    }
+}
+
+void ParticleSort::initGpu()
+{
+    // the record layout is passed as uniforms, so every sorter shares these
+    asset_registry& assets = asset_registry::shared();
+    asset_registry::program_desc keyDesc;
+    keyDesc.stages = {{GL_COMPUTE_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_sort_keys.glsl")}};
+    keyShader = assets.acquire_program(keyDesc);
+
+    asset_registry::program_desc bitonicDesc;
+    bitonicDesc.stages = {{GL_COMPUTE_SHADER, CGRA_SRCDIR + std::string("//res//shaders//particle_sort_bitonic.glsl")}};
+    bitonicShader = assets.acquire_program(bitonicDesc);
+
+    m_keyUniforms.recordCount = keyShader.uniform("recordCount");
+    m_keyUniforms.paddedCount = keyShader.uniform("paddedCount");
+    m_keyUniforms.stride = keyShader.uniform("stride");
+    m_keyUniforms.typeOffset = keyShader.uniform("typeOffset");
+    m_keyUniforms.positionOffset = keyShader.uniform("positionOffset");
+    m_keyUniforms.drawType = keyShader.uniform("drawType");
+    m_keyUniforms.packedType = keyShader.uniform("packedType");
+    m_keyUniforms.uModelViewMatrix = keyShader.uniform("uModelViewMatrix");
+
+    m_bitonicUniforms.k = bitonicShader.uniform("k");
+    m_bitonicUniforms.j = bitonicShader.uniform("j");
+    m_bitonicUniforms.localPass = bitonicShader.uniform("localPass");
+    m_bitonicUniforms.presort = bitonicShader.uniform("presort");
+    m_bitonicUniforms.writeIndices = bitonicShader.uniform("writeIndices");
+
+    glGenBuffers(1, &m_pairBuffer);
+    glGenBuffers(1, &m_drawBuffer);
+    const DrawCommand command{0, 1, 0, 0, 0};
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand), &command, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void ParticleSort::sortGpu(GLuint buffer, int records, const mat4& view)
+{
+    if(!keyShader) initGpu();
+
+    // bitonic sorting needs a power of two, the padding keys sort last
+    const int padded = std::max(nextPowerOfTwo(records), bitonicBlock);
+    if(padded > m_pairCapacity){
+        m_pairCapacity = padded;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pairBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, padded * 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    reserveIndices(padded);
+
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(DrawCommand, count), sizeof(GLuint), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_pairBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_drawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_indexBuffer);
+
+    // -- keys --
+    keyShader.use();
+    keyShader.set(m_keyUniforms.recordCount, records);
+    keyShader.set(m_keyUniforms.paddedCount, padded);
+    keyShader.set(m_keyUniforms.stride, m_layout.stride);
+    keyShader.set(m_keyUniforms.typeOffset, m_layout.typeOffset);
+    keyShader.set(m_keyUniforms.positionOffset, m_layout.positionOffset);
+    keyShader.set(m_keyUniforms.drawType, m_layout.drawType);
+    keyShader.set(m_keyUniforms.packedType, m_layout.packedType);
+    keyShader.set(m_keyUniforms.uModelViewMatrix, view);
+    glDispatchCompute(padded / keyGroupSize, 1, 1);
+
+    // -- bitonic sort --
+    // Sequences up to a block long are sorted in shared memory in one go.
+    // Past that, each merge runs its long compare distances as global
+    // passes and finishes the short ones in shared memory.
+    const int groups = padded / bitonicBlock;
+    bitonicShader.use();
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    bitonicShader.set(m_bitonicUniforms.localPass, true);
+    bitonicShader.set(m_bitonicUniforms.presort, true);
+    bitonicShader.set(m_bitonicUniforms.writeIndices, padded == bitonicBlock);
+    glDispatchCompute(groups, 1, 1);
+
+    bitonicShader.set(m_bitonicUniforms.presort, false);
+    for(int k = bitonicBlock * 2; k <= padded; k <<= 1){
+        bitonicShader.set(m_bitonicUniforms.k, k);
+        bitonicShader.set(m_bitonicUniforms.localPass, false);
+        for(int j = k / 2; j >= bitonicBlock; j >>= 1){
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            bitonicShader.set(m_bitonicUniforms.j, j);
+            glDispatchCompute(groups, 1, 1);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        bitonicShader.set(m_bitonicUniforms.localPass, true);
+        bitonicShader.set(m_bitonicUniforms.writeIndices, k == padded);
+        glDispatchCompute(groups, 1, 1);
+    }
+    glUseProgram(0);
+
+    glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    for(int i = 0; i < 4; i++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+    m_lastSort = Gpu;
+}
+
+void ParticleSort::draw()
+{
+    if(m_lastSort == None) return;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    if(m_lastSort == Cpu){
+        glDrawElements(GL_POINTS, m_cpuCount, GL_UNSIGNED_INT, nullptr);
+    }else{
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_drawBuffer);
+        glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+void ParticleSort::destroy()
+{
+    if(m_indexBuffer) glDeleteBuffers(1, &m_indexBuffer);
+    if(m_pairBuffer) glDeleteBuffers(1, &m_pairBuffer);
+    if(m_drawBuffer) glDeleteBuffers(1, &m_drawBuffer);
+    m_indexBuffer = m_pairBuffer = m_drawBuffer = 0;
+    m_indexCapacity = m_pairCapacity = 0;
+    asset_registry::shared().release_program(keyShader);
+    asset_registry::shared().release_program(bitonicShader);
+    keyShader = bitonicShader = program();
+    m_lastSort = None;
+}
+
+ParticleSort::BenchmarkResult ParticleSort::benchmark(int particles)
+{
+    // records in the ParticleEmitter layout, scattered through a cube
+    // around a camera looking down -z
+    const ParticleRecordLayout layout;
+    vector<float> records(size_t(particles) * layout.stride, 0.0f);
+    std::mt19937 rng(350);
+    std::uniform_real_distribution<float> dist(-100, 100);
+    for(int i = 0; i < particles; i++){
+        float* r = &records[size_t(i) * layout.stride];
+        r[layout.typeOffset] = layout.drawType;
+        for(int c = 0; c < 3; c++) r[layout.positionOffset + c] = dist(rng);
+    }
+    const mat4 view = mat4(1);
+    const int runs = 5;
+
+    BenchmarkResult result;
+    result.particles = particles;
+    ParticleSort sorter(layout);
+
+    // first run warms up the allocations
+    sorter.sortCpu(records.data(), particles, view);
+    glFinish();
+    const auto start = chrono::steady_clock::now();
+    for(int i = 0; i < runs; i++){
+        sorter.sortCpu(records.data(), particles, view);
+    }
+    result.cpuMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / runs;
+
+    if(gpuSupported()){
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(float), records.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        sorter.sortGpu(buffer, particles, view);
+
+        GLuint query;
+        glGenQueries(1, &query);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for(int i = 0; i < runs; i++){
+            sorter.sortGpu(buffer, particles, view);
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        result.gpuMs = ns / 1e6 / runs;
+
+        glDeleteQueries(1, &query);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    sorter.destroy();
+    return result;
+}
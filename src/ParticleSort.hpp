@@ -0,0 +1,100 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "cgra/cgra_shader.hpp"
+
+
+// Where a particle record keeps its fields, in floats. The defaults are
+// ParticleEmitter's records.
+struct ParticleRecordLayout {
+    int stride = 8;
+    int typeOffset = 0;
+    int positionOffset = 1;
+    float drawType = 2; // only records of this type are drawn
+    // the type is an integer in the top 16 bits of its word (PackedParticle)
+    bool packedType = false;
+};
+
+// Orders particle records back to front for alpha blending. The records
+// stay where they are, the sort produces an element buffer of record
+// indices to draw them through, farthest first. Only records of the
+// particle type are drawn, so the emitter and any cleared slots drop out.
+//
+// Records are read as floats, so the same sorter works for any of the
+// particle buffer layouts.
+//
+// The CPU path radix sorts depth keys with OpenMP. The GPU path (GL 4.3)
+// computes keys and bitonic sorts them in compute shaders, and never needs
+// the record count: every slot up to the given number of records is keyed,
+// and the draw count comes from an indirect command written by the key pass.
+class ParticleSort
+{
+public:
+    enum Mode { None, Cpu, Gpu };
+
+    struct BenchmarkResult {
+        int particles = 0;
+        double cpuMs = 0;
+        double gpuMs = 0; // 0 without GL 4.3
+    };
+
+private:
+    ParticleRecordLayout m_layout;
+
+    // -- CPU path --
+    std::vector<uint32_t> m_keys, m_values;
+    std::vector<uint32_t> m_keysTemp, m_valuesTemp;
+    std::vector<int> m_histograms;
+    int m_cpuCount = 0;
+
+    // -- GPU path --
+    int m_pairCapacity = 0;
+    GLuint m_pairBuffer = 0;
+    GLuint m_drawBuffer = 0;
+    cgra::program keyShader;
+    cgra::program bitonicShader;
+    struct {
+        cgra::program::uniform_handle recordCount, paddedCount, stride;
+        cgra::program::uniform_handle typeOffset, positionOffset, drawType, packedType;
+        cgra::program::uniform_handle uModelViewMatrix;
+    } m_keyUniforms;
+    struct {
+        cgra::program::uniform_handle k, j, localPass, presort, writeIndices;
+    } m_bitonicUniforms;
+
+    GLuint m_indexBuffer = 0;
+    int m_indexCapacity = 0;
+    Mode m_lastSort = None;
+
+    void initGpu();
+    void reserveIndices(int count);
+    void radixSort(int count);
+
+public:
+    explicit ParticleSort(const ParticleRecordLayout& layout = ParticleRecordLayout()) : m_layout(layout) {}
+
+    void setLayout(const ParticleRecordLayout& layout) { m_layout = layout; }
+
+    static bool gpuSupported();
+
+    // Sorts count records in memory by their depth under view.
+    void sortCpu(const float* records, int count, const glm::mat4& view);
+    // Sorts the first records of buffer on the GPU. Slots past the live
+    // records must not hold the draw type, clear the buffer if unsure.
+    void sortGpu(GLuint buffer, int records, const glm::mat4& view);
+
+    // Draws the last sort's records as points, the caller binds the VAO
+    // (the element buffer binding is left in it) and program.
+    void draw();
+    void destroy();
+
+    // Times both paths on the same random particles.
+    static BenchmarkResult benchmark(int particles);
+};
@@ -0,0 +1,170 @@
+#include "RibbonRenderer.hpp"
+#include "cgra/cgra_assets.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+using namespace glm;
+using namespace cgra;
+using namespace std;
+
+
+void RibbonRenderer::init()
+{
+    asset_registry::program_desc desc;
+    desc.stages = {{GL_VERTEX_SHADER, CGRA_SRCDIR + std::string("//res//shaders//ribbon_vertex.glsl")},
+                   {GL_FRAGMENT_SHADER, CGRA_SRCDIR + std::string("//res//shaders//ribbon_fragment.glsl")}};
+    shader = asset_registry::shared().acquire_program(desc);
+
+    auto& u = m_uniforms;
+    u.uProjectionMatrix = shader.uniform("uProjectionMatrix");
+    u.uViewMatrix = shader.uniform("uViewMatrix");
+    u.uCameraPos = shader.uniform("uCameraPos");
+    u.slots = shader.uniform("slots");
+    u.capacity = shader.uniform("capacity");
+    u.head = shader.uniform("head");
+    u.time = shader.uniform("time");
+    u.lifeTime = shader.uniform("lifeTime");
+    u.headWidth = shader.uniform("headWidth");
+    u.tailWidth = shader.uniform("tailWidth");
+    u.headColor = shader.uniform("headColor");
+    u.tailColor = shader.uniform("tailColor");
+
+    // the samplers never change, so they are set once here
+    shader.use();
+    shader.set(shader.uniform("uHistory"), 0);
+    shader.set(shader.uniform("uTracks"), 1);
+    glUseProgram(0);
+
+    glGenBuffers(1, &m_historyBuffer);
+    glGenTextures(1, &m_historyTexture);
+    glGenBuffers(1, &m_trackBuffer);
+    glGenTextures(1, &m_trackTexture);
+    glGenVertexArrays(1, &m_vao);
+    allocate(64);
+}
+
+int RibbonRenderer::slotsNeeded() const
+{
+    // the whole life, plus the head and a slot fading out past the end
+    return std::max(int(std::ceil(lifeTime / std::max(sampleInterval, 1e-3f))) + 2, 2);
+}
+
+void RibbonRenderer::allocate(int capacity)
+{
+    m_capacity = capacity;
+    m_slots = slotsNeeded();
+    m_head = 0;
+    m_sinceSample = 0;
+    for(Track& t : m_tracks) t.valid = 0;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_historyBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_slots * m_capacity * sizeof(vec4), nullptr, GL_DYNAMIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_historyTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_historyBuffer);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_trackBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_capacity * sizeof(vec4), nullptr, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, m_trackTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_trackBuffer);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void RibbonRenderer::update(const vector<vec3>& positions, double delta)
+{
+    const int count = positions.size();
+    if(count > m_capacity || slotsNeeded() != m_slots){
+        int capacity = std::max(m_capacity, 1);
+        while(capacity < count) capacity *= 2;
+        allocate(capacity);
+    }
+
+    m_time += delta;
+    m_sinceSample += delta;
+    if(m_sinceSample >= sampleInterval){
+        // the head is kept as it was last written, and the newest positions
+        // go into the slot after it
+        m_sinceSample = std::fmod(m_sinceSample, double(sampleInterval));
+        m_head = (m_head + 1) % m_slots;
+        for(Track& t : m_tracks) t.valid = std::min(t.valid + 1, m_slots);
+    }
+
+    m_tracks.resize(count, Track{vec3(0), 0});
+    m_column.resize(count);
+    m_trackTexels.resize(count);
+    for(int i = 0; i < count; i++){
+        Track& t = m_tracks[i];
+        if(t.valid == 0 || distance(t.last, positions[i]) > breakDistance){
+            t.valid = 1;
+        }
+        t.last = positions[i];
+        m_column[i] = vec4(positions[i], float(m_time));
+        m_trackTexels[i] = vec4(t.valid, 0, 0, 0);
+    }
+    if(count == 0) return;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_historyBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, m_head * m_capacity * sizeof(vec4), count * sizeof(vec4), m_column.data());
+    // orphan and refill, the previous frame's draw may still be reading it
+    glBindBuffer(GL_TEXTURE_BUFFER, m_trackBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_capacity * sizeof(vec4), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof(vec4), m_trackTexels.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void RibbonRenderer::render(const mat4& view, const mat4& proj)
+{
+    if(m_tracks.empty()) return;
+
+    shader.use();
+    shader.set(m_uniforms.uProjectionMatrix, proj);
+    shader.set(m_uniforms.uViewMatrix, view);
+    shader.set(m_uniforms.uCameraPos, vec3(inverse(view)[3]));
+    shader.set(m_uniforms.slots, m_slots);
+    shader.set(m_uniforms.capacity, m_capacity);
+    shader.set(m_uniforms.head, m_head);
+    shader.set(m_uniforms.time, float(m_time));
+    shader.set(m_uniforms.lifeTime, lifeTime);
+    shader.set(m_uniforms.headWidth, headWidth);
+    shader.set(m_uniforms.tailWidth, tailWidth);
+    shader.set(m_uniforms.headColor, headColor);
+    shader.set(m_uniforms.tailColor, tailColor);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, m_trackTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_historyTexture);
+
+    // blended like the particles
+    glEnable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    glBindVertexArray(m_vao);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, vertices(), m_tracks.size());
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(0);
+}
+
+void RibbonRenderer::destroy()
+{
+    glDeleteBuffers(1, &m_historyBuffer);
+    glDeleteTextures(1, &m_historyTexture);
+    glDeleteBuffers(1, &m_trackBuffer);
+    glDeleteTextures(1, &m_trackTexture);
+    glDeleteVertexArrays(1, &m_vao);
+    m_historyBuffer = m_historyTexture = m_trackBuffer = m_trackTexture = m_vao = 0;
+    asset_registry::shared().release_program(shader);
+    shader = program();
+}
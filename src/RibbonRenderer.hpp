@@ -0,0 +1,84 @@
+#pragma once
+
+// std
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "cgra/cgra_shader.hpp"
+
+
+// Draws a trail behind each of a list of emitters as one continuous,
+// camera facing strip, instead of the hundreds of overlapping billboards a
+// particle trail needs. A ribbon covers each pixel of the trail about once,
+// so it costs a fraction of the fill rate.
+//
+// Every emitter's recent positions live in a ring buffer on the GPU (a
+// texture buffer of RGBA32F, position and the time it was recorded), one
+// slot every sampleInterval seconds. A frame only writes the newest slot of
+// every emitter, which are next to each other, with one glBufferSubData.
+// The vertex shader builds the strips out of the history, so all the
+// ribbons are one instanced draw, a triangle strip per emitter.
+//
+// Like EmitterBatch, emitters are identified by their index in the list
+// passed to update(). An emitter that jumps further than breakDistance in
+// a frame (respawned, say) starts a new ribbon instead of stretching its
+// old one across the scene.
+class RibbonRenderer
+{
+private:
+    int m_capacity = 0; // emitters per slot
+    int m_slots = 0;
+    int m_head = 0; // slot the newest positions are written to
+    double m_time = 0;
+    double m_sinceSample = 0;
+
+    struct Track {
+        glm::vec3 last;
+        int valid; // slots recorded since the ribbon started, with the head
+    };
+    std::vector<Track> m_tracks;
+    std::vector<glm::vec4> m_column;
+    std::vector<glm::vec4> m_trackTexels;
+
+    GLuint m_historyBuffer = 0;
+    GLuint m_historyTexture = 0;
+    GLuint m_trackBuffer = 0;
+    GLuint m_trackTexture = 0;
+    GLuint m_vao = 0; // no attributes, core profile just needs one bound
+
+    cgra::program shader;
+    using Uniform = cgra::program::uniform_handle;
+    struct {
+        Uniform uProjectionMatrix, uViewMatrix, uCameraPos;
+        Uniform slots, capacity, head, time, lifeTime;
+        Uniform headWidth, tailWidth, headColor, tailColor;
+    } m_uniforms;
+
+    // (re)allocates the history for the current settings, forgetting it
+    void allocate(int capacity);
+    int slotsNeeded() const;
+
+public:
+    // how many seconds of history a ribbon shows, fading out towards the end
+    float lifeTime = 1.5;
+    float sampleInterval = 1.0f / 30;
+    float headWidth = 2;
+    float tailWidth = 0.2;
+    glm::vec3 headColor = glm::vec3(1, 0.3, 0);
+    glm::vec3 tailColor = glm::vec3(1, 0.8, 0);
+    // world units an emitter can move in one update and stay the same ribbon
+    float breakDistance = 20;
+
+    void init();
+    // Records where every emitter is now.
+    void update(const std::vector<glm::vec3>& positions, double delta);
+    void render(const glm::mat4& view, const glm::mat4& proj);
+    void destroy();
+
+    int ribbons() const { return m_tracks.size(); }
+    // per ribbon, two a slot
+    int vertices() const { return m_slots * 2; }
+};
@@ -1,15 +1,22 @@
 
 // std
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 
+#ifdef CGRA_HAVE_OPENMP
+#include <omp.h>
+#endif
+
 // glm
 #include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 // project
 #include "application.hpp"
+#include "cgra/cgra_assets.hpp"
 #include "cgra/cgra_geometry.hpp"
 #include "cgra/cgra_gui.hpp"
 #include "cgra/cgra_image.hpp"
@@ -22,10 +29,18 @@ using namespace glm;
 
 Application::Application(GLFWwindow *window) : m_window(window) {
     m_previousFrameTime = std::chrono::system_clock::now();
+    const auto startupBegin = std::chrono::steady_clock::now();
 
     setup();
 
     asteroidMeshConfig = {0.5, 2.0, 50};
+    m_brdfLut.bake();
+    asteroidMeshConfig.brdf_lut = m_brdfLut.texture();
+
+    m_forceField.strength = 3;
+    m_forceField.scrollVelocity = vec3(0, 0.01, 0);
+    m_forceField.transform = scale(mat4(1), vec3(m_fieldTileSize));
+    m_forceField.bake(m_fieldResolution, m_fieldFrequency);
 
     for (int i = 0; i < asteroidCount; i++) {
         spawnAsteroid();
@@ -33,6 +48,14 @@ Application::Application(GLFWwindow *window) : m_window(window) {
     }
 
     particleEmitter.InitParticleSystem(vec3(0));
+    particleEmitter.forceField = &m_forceField;
+    m_trailBatch.init();
+    m_trailBatch.forceField = &m_forceField;
+    m_ribbons.init();
+
+    m_startupMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - startupBegin)
+                      .count();
 }
 
 void Application::setup() {
@@ -43,7 +66,23 @@ void Application::setup() {
     m_veg_cov_density = 0;
 }
 
+void Application::destroy() {
+    centerBody.destroy();
+    for (auto &aAndPe : m_asteroids) {
+        aAndPe.asteroid.destroy();
+        aAndPe.particleEmitter.destroy();
+    }
+    particleEmitter.destroy();
+    m_trailBatch.destroy();
+    m_ribbons.destroy();
+    m_particleCompositor.destroy();
+    m_forceField.destroy();
+    m_brdfLut.destroy();
+}
+
 void Application::render() {
+    cgra::uniform_stats::frame().reset();
+
     auto currentTime = std::chrono::system_clock::now();
     auto deltaTime =
         std::chrono::duration<double>(currentTime - m_previousFrameTime)
@@ -69,6 +108,8 @@ void Application::render() {
     mat4 view = translate(mat4(1), vec3(0, 0, -m_distance)) *
                 rotate(mat4(1), m_pitch, vec3(1, 0, 0)) *
                 rotate(mat4(1), m_yaw, vec3(0, 1, 0));
+    m_view = view;
+    m_proj = proj;
 
     // helpful draw options
     if (m_show_grid)
@@ -77,6 +118,12 @@ void Application::render() {
         drawAxis(view, proj);
     glPolygonMode(GL_FRONT_AND_BACK, (m_showWireframe) ? GL_LINE : GL_FILL);
 
+    m_forceField.update(deltaTime);
+
+    // what the asteroid trails are drawn with
+    const bool billboards = m_trailStyle != TrailRibbons;
+    const bool ribbons = m_trailStyle != TrailBillboards;
+
     switch (activeScene) {
     case MAIN:
         // central body
@@ -94,20 +141,86 @@ void Application::render() {
             }
         }
 
+        // emission rates for this frame, from where the trails are now
+        m_budgetEntries.clear();
+        for (auto &aAndPe : m_asteroids) {
+            m_budgetEntries.push_back(
+                {&aAndPe.particleEmitter, aAndPe.asteroid.position});
+        }
+        {
+            int live = 0;
+            if (m_batchTrails) {
+                live = m_trailBatch.liveParticles();
+            } else {
+                for (auto &aAndPe : m_asteroids) {
+                    live += aAndPe.particleEmitter.liveParticles();
+                }
+            }
+            m_particleBudget.apportion(m_budgetEntries, live, view, proj,
+                                       height);
+        }
+
+        m_regenMs = 0;
+        m_drawnIndices = 0;
+        m_totalIndices = 0;
         for (auto &aAndPe : m_asteroids) {
+            m_regenMs += aAndPe.asteroid.update_morph(deltaTime);
             aAndPe.asteroid.update_model_transform(deltaTime);
-            aAndPe.particleEmitter.updateParticles(deltaTime);
+        }
+        gatherColliders();
+        for (auto &aAndPe : m_asteroids) {
+            // the spheres the trail can reach, from where the asteroid is now
+            ParticleEmitter &trail = aAndPe.particleEmitter;
+            m_colliders.cull(aAndPe.asteroid.position, trail.particleReach(),
+                             trail.colliders);
+            // dust comes off the surface, as the asteroid is turned now
+            aAndPe.particleEmitter.spawnMesh = &aAndPe.asteroid.surface();
+            aAndPe.particleEmitter.spawnMeshBasis =
+                aAndPe.asteroid.surface_basis();
+            if (!m_batchTrails && billboards) {
+                aAndPe.particleEmitter.updateParticles(deltaTime);
+            }
             aAndPe.asteroid.draw(view, proj);
+            m_drawnIndices += aAndPe.asteroid.last_drawn_indices;
+            m_totalIndices += aAndPe.asteroid.index_count();
         }
 
-        for (auto &aAndPe : m_asteroids) {
-            aAndPe.particleEmitter.render(view, proj);
+        m_particleCompositor.begin(width, height, proj);
+        if (ribbons) {
+            m_ribbonPositions.clear();
+            for (auto &aAndPe : m_asteroids) {
+                m_ribbonPositions.push_back(aAndPe.asteroid.position);
+            }
+            m_ribbons.update(m_ribbonPositions, deltaTime);
+            m_ribbons.render(view, proj);
         }
+        if (billboards && m_batchTrails) {
+            // rebuilt every frame, m_asteroids may have reallocated
+            m_trailEmitters.clear();
+            for (auto &aAndPe : m_asteroids) {
+                m_trailEmitters.push_back(&aAndPe.particleEmitter);
+            }
+            m_trailBatch.update(m_trailEmitters, deltaTime);
+            m_trailBatch.render(view, proj);
+        } else if (billboards) {
+            for (auto &aAndPe : m_asteroids) {
+                aAndPe.particleEmitter.render(view, proj);
+            }
+        }
+        m_particleCompositor.end();
         break;
 
     case PARTICLE:
+        // only the centre body to hit, shown while it's being hit
+        if (particleEmitter.collision != CollideNone) {
+            centerBody.draw(view, proj, deltaTime, m_deformation,
+                            m_veg_cov_density);
+        }
+        particleEmitter.colliders.assign(1, centerBody.bounding_sphere());
         particleEmitter.updateParticles(deltaTime);
+        m_particleCompositor.begin(width, height, proj);
         particleEmitter.render(view, proj);
+        m_particleCompositor.end();
         break;
 
     case ASTEROID:
@@ -115,8 +228,11 @@ void Application::render() {
         m_asteroids.at(0).asteroid.velocity = vec3(0, -0.5, 0);
         m_asteroids.at(0).asteroid.rotation_axis = vec3(0, 1, 0);
         m_asteroids.at(0).asteroid.rotation_velocity = 1;
+        m_regenMs = m_asteroids.at(0).asteroid.update_morph(deltaTime);
         m_asteroids.at(0).asteroid.update_model_transform(deltaTime);
         m_asteroids.at(0).asteroid.draw(view, proj);
+        m_drawnIndices = m_asteroids.at(0).asteroid.last_drawn_indices;
+        m_totalIndices = m_asteroids.at(0).asteroid.index_count();
         break;
     }
 }
@@ -153,6 +269,29 @@ void Application::renderGUI() {
                     1000.0f / ImGui::GetIO().Framerate,
                     ImGui::GetIO().Framerate);
 
+        // every set used to be a glGetUniformLocation and a glUniform call
+        const cgra::uniform_stats &uniformStats = cgra::uniform_stats::frame();
+        ImGui::Text("Uniform sets %d, uploaded %d (%d skipped)",
+                    uniformStats.sets, uniformStats.uploads,
+                    uniformStats.sets - uniformStats.uploads);
+
+        // programs and textures are shared through the registry
+        const asset_registry::counts assets = asset_registry::shared().stats();
+        ImGui::Text("Startup %.0f ms", m_startupMs);
+        ImGui::Text("Programs %d (%d built), textures %d (%d loaded), "
+                    "%d shared",
+                    assets.programs, assets.program_builds, assets.textures,
+                    assets.texture_loads, assets.shared_acquires);
+        const shader_builder::binary_cache_stats &binaries =
+            shader_builder::binary_stats();
+        if (shader_builder::binary_cache().empty()) {
+            ImGui::TextDisabled("Program binary cache off");
+        } else {
+            ImGui::Text("Program binaries: %d loaded, %d built and stored, "
+                        "%d stale",
+                        binaries.hits, binaries.misses, binaries.rejected);
+        }
+
         ImGui::SliderFloat("Pitch", &m_pitch, -pi<float>() / 2, pi<float>() / 2,
                            "%.2f");
         ImGui::SliderFloat("Yaw", &m_yaw, -pi<float>(), pi<float>(), "%.2f");
@@ -181,6 +320,7 @@ void Application::renderGUI() {
                 ImGui::SliderFloat("Deformation", &m_deformation, 0.0, 10, "%.1lf");
                 ImGui::SliderFloat("Distance", &m_distance, 1, 20, "%.1lf");
                 ImGui::SliderFloat("Veg-Cov Density", &m_veg_cov_density, 0.0, 1.0, "%.1lf");
+                centerBodyUi();
             }
 
             if (ImGui::CollapsingHeader("Asteroid Settings")) {
@@ -191,9 +331,33 @@ void Application::renderGUI() {
             		&asteroidMeshConfig.edge_length, 0.1, 5, "%.2f");
 
             	ImGui::SliderInt("Num verts (width)", &asteroidMeshConfig.num_verts, 10, 100);
+
+                asteroidFieldUi();
+                asteroidMorphUi();
+                asteroidAoUi();
+                asteroidCullingUi();
+                asteroidShadingUi();
             }
 
             if (ImGui::CollapsingHeader("Particle emitters")) {
+                trailStyleUi();
+                ImGui::Checkbox("Batch trails (one pass for all emitters)", &m_batchTrails);
+                particleCompositorUi();
+                particleBudgetUi();
+                forceFieldUi();
+                collisionUi();
+                if (m_batchTrails) {
+                    ImGui::Text("%d batched particles, capacity %d%s",
+                                m_trailBatch.liveParticles(),
+                                m_trailBatch.capacity(),
+                                m_trailBatch.hasOverflowed() ? ", overflowed" : "");
+                    ImGui::Checkbox("Grow batch buffers when full",
+                                    &m_trailBatch.autoGrow);
+                    ParticleModifier::sortUi(m_trailBatch.sortMode);
+                    ImGui::Text("%d lifetime curve rows uploaded", m_trailBatch.curveUploads());
+                }
+                ParticleModifier::sortBenchmarkUi();
+                ParticleModifier::formatBenchmarkUi();
                 for (int i = 0; i < m_asteroids.size(); i++) {
                     ParticleModifier pm(m_asteroids.at(i).particleEmitter);
                     pm.drawUi();
@@ -202,6 +366,8 @@ void Application::renderGUI() {
             break;
 
         case PARTICLE:
+            particleCompositorUi();
+            forceFieldUi();
             particleModifier.drawUi();
             break;
         case ASTEROID:
@@ -218,6 +384,12 @@ void Application::renderGUI() {
                     m_asteroids.at(0).asteroid.regenerate_mesh(
                         std::chrono::system_clock::now().time_since_epoch().count());
                 }
+
+                asteroidFieldUi();
+                asteroidMorphUi();
+                asteroidAoUi();
+                asteroidCullingUi();
+                asteroidShadingUi();
             }
             break;
     default:
@@ -227,6 +399,332 @@ void Application::renderGUI() {
     ImGui::End();
 }
 
+void Application::particleCompositorUi() {
+    const char *modes[] = {"Full", "Half", "Quarter"};
+    int mode = m_particleCompositor.mode;
+    if (ImGui::Combo("Particle resolution", &mode, modes,
+                     sizeof(modes) / sizeof(const char *))) {
+        m_particleCompositor.mode = ParticleCompositor::Mode(mode);
+    }
+    // each mode keeps its last time, so switching back and forth compares them
+    for (int m = 0; m < ParticleCompositor::ModeCount; m++) {
+        double ms = m_particleCompositor.milliseconds(ParticleCompositor::Mode(m));
+        if (ms > 0) {
+            ImGui::Text("%s: %.3f ms particle pass", modes[m], ms);
+        }
+    }
+}
+
+void Application::particleBudgetUi() {
+    ImGui::Separator();
+    ImGui::Checkbox("Particle budget", &m_particleBudget.enabled);
+    if (m_particleBudget.enabled) {
+        ImGui::SliderInt("Max live particles",
+                         &m_particleBudget.maxLiveParticles, 1000, 200000);
+    }
+    ImGui::Text("Live %d, allocated %.0f of %.0f wanted (correction %.2f)",
+                m_particleBudget.measuredLive(), m_particleBudget.allocated(),
+                m_particleBudget.demanded(), m_particleBudget.correction());
+
+    // frame time should stay flat as asteroids are added, with the budget on
+    ImGui::SliderInt("Asteroids", &m_targetAsteroids, 1, 1000);
+    ImGui::SameLine();
+    if (ImGui::Button("Apply")) {
+        setAsteroidCount(m_targetAsteroids);
+    }
+    ImGui::Text("%d asteroids, %.3f ms/frame", int(m_asteroids.size()),
+                1000.0f / ImGui::GetIO().Framerate);
+}
+
+void Application::forceFieldUi() {
+    ImGui::Separator();
+    ImGui::SliderFloat("Turbulence strength", &m_forceField.strength, 0, 20);
+    if (ImGui::SliderFloat("Turbulence tile size", &m_fieldTileSize, 1, 500,
+                           "%.1f", 2.0f)) {
+        m_forceField.transform = scale(mat4(1), vec3(m_fieldTileSize));
+    }
+    ImGui::SliderFloat3("Turbulence scroll", value_ptr(m_forceField.scrollVelocity),
+                        -0.2, 0.2);
+
+    ImGui::SliderInt("Turbulence resolution", &m_fieldResolution, 8, 128);
+    ImGui::SliderFloat("Turbulence frequency", &m_fieldFrequency, 1, 16);
+    if (ImGui::Button("Rebake turbulence")) {
+        m_forceField.bake(m_fieldResolution, m_fieldFrequency);
+    }
+    ImGui::SameLine();
+    ImGui::Text("%d^3 baked in %.1f ms", m_forceField.resolution(),
+                m_forceField.bakeMilliseconds());
+}
+
+void Application::trailStyleUi() {
+    const char *styles[] = {"Billboards", "Ribbons", "Ribbons and billboards"};
+    ImGui::Combo("Trails", &m_trailStyle, styles,
+                 sizeof(styles) / sizeof(const char *));
+    if (m_trailStyle == TrailBillboards) return;
+
+    ImGui::SliderFloat("Ribbon length (s)", &m_ribbons.lifeTime, 0.1, 10);
+    ImGui::SliderFloat("Ribbon head width", &m_ribbons.headWidth, 0, 10);
+    ImGui::SliderFloat("Ribbon tail width", &m_ribbons.tailWidth, 0, 10);
+    ImGui::ColorEdit3("Ribbon head color", value_ptr(m_ribbons.headColor));
+    ImGui::ColorEdit3("Ribbon tail color", value_ptr(m_ribbons.tailColor));
+    ImGui::Text("%d ribbons, %d vertices each, 1 draw", m_ribbons.ribbons(),
+                m_ribbons.vertices());
+}
+
+void Application::collisionUi() {
+    ImGui::Separator();
+    const ParticleCollision collision = m_trailCollision;
+    const float restitution = m_trailRestitution;
+    ParticleModifier::collisionUi(m_trailCollision, m_trailRestitution);
+    if (m_trailCollision != collision || m_trailRestitution != restitution) {
+        for (auto &aAndPe : m_asteroids) {
+            aAndPe.particleEmitter.collision = m_trailCollision;
+            aAndPe.particleEmitter.restitution = m_trailRestitution;
+        }
+    }
+
+    int tested = 0;
+    for (auto &aAndPe : m_asteroids) {
+        tested += aAndPe.particleEmitter.colliders.size();
+    }
+    ImGui::Text("%d colliders, %.1f per trail after culling", m_colliders.size(),
+                m_asteroids.empty() ? 0.0f : float(tested) / m_asteroids.size());
+    ParticleModifier::colliderBenchmarkUi();
+}
+
+void Application::gatherColliders() {
+    m_colliders.clear();
+    const vec4 body = centerBody.bounding_sphere();
+    m_colliders.add(vec3(body), body.w);
+    for (auto &aAndPe : m_asteroids) {
+        const vec4 sphere = aAndPe.asteroid.bounding_sphere();
+        m_colliders.add(vec3(sphere), sphere.w);
+    }
+}
+
+void Application::setAsteroidCount(int count) {
+    while (int(m_asteroids.size()) < count) {
+        spawnAsteroid();
+    }
+    while (int(m_asteroids.size()) > count) {
+        // the batch drops the emitters past the end of the list by itself
+        m_asteroids.back().asteroid.destroy();
+        m_asteroids.back().particleEmitter.destroy();
+        m_asteroids.pop_back();
+    }
+}
+
+void Application::centerBodyUi() {
+    ImGui::Separator();
+    bool rebuild = ImGui::Checkbox("CSG surface (craters and boulders)", &m_bodyCsg);
+    if (m_bodyCsg) {
+        ImGui::InputInt("Seed", &m_bodySeed);
+        ImGui::SliderInt("Craters##body", &m_bodyCraters, 0, 200);
+        ImGui::SliderInt("Boulders##body", &m_bodyBoulders, 0, 200);
+        ImGui::SliderInt("Resolution", &m_bodyResolution, 16, 128);
+        rebuild |= ImGui::Button("Rebuild surface");
+        ImGui::Text("Built in %.1f ms", centerBody.surface_milliseconds());
+    }
+    if (rebuild) {
+        if (m_bodyCsg) {
+            centerBody.build_surface(unsigned(m_bodySeed), m_bodyCraters,
+                                     m_bodyBoulders, m_bodyResolution);
+        } else {
+            centerBody.clear_surface();
+        }
+    }
+}
+
+void Application::asteroidFieldUi() {
+    ImGui::Separator();
+    const char *fieldModes[] = {"Noise", "CSG craters"};
+    ImGui::Combo("Field", &asteroidMeshConfig.field_mode, fieldModes,
+                 sizeof(fieldModes) / sizeof(const char *));
+    if (asteroidMeshConfig.field_mode == 1) {
+        ImGui::SliderInt("Craters", &asteroidMeshConfig.crater_count, 0, 400);
+        ImGui::SliderInt("Boulders", &asteroidMeshConfig.boulder_count, 0, 200);
+    }
+}
+
+void Application::asteroidMorphUi() {
+    ImGui::Separator();
+    ImGui::Checkbox("Animate (4D noise)", &asteroidMeshConfig.animate);
+    if (asteroidMeshConfig.animate) {
+        ImGui::SliderFloat("Morph speed", &asteroidMeshConfig.morph_speed, 0.0, 1.0, "%.2f");
+        ImGui::SliderInt("Morph chunks", &asteroidMeshConfig.morph_chunks, 1, 32);
+        ImGui::SliderFloat("Morph budget (ms/frame)", &asteroidMeshConfig.morph_budget_ms, 0.1, 16, "%.1f");
+        ImGui::Text("Regeneration %.3f ms/frame", m_regenMs);
+    }
+}
+
+void Application::asteroidCullingUi() {
+    ImGui::Separator();
+    ImGui::Checkbox("Meshlet culling", &asteroidMeshConfig.meshlet_culling);
+    ImGui::Text("Triangles drawn %d / %d (%.0f%%)", m_drawnIndices / 3,
+                m_totalIndices / 3,
+                m_totalIndices > 0 ? 100.0 * m_drawnIndices / m_totalIndices : 0.0);
+}
+
+void Application::asteroidShadingUi() {
+    ImGui::Separator();
+    ImGui::Checkbox("Texture", &asteroidMeshConfig.use_texture);
+    const char *tiers[] = {"Reference Oren-Nayar", "Qualitative (Fujii)",
+                           "Lookup table"};
+    ImGui::Combo("Shading quality", &asteroidMeshConfig.shading_quality, tiers,
+                 sizeof(tiers) / sizeof(const char *));
+    ImGui::Text("Shader variants used by the first asteroid: %d",
+                m_asteroids.at(0).asteroid.shader_variant_count());
+    ImGui::Text("Lookup table %d^2 baked in %.2f ms", m_brdfLut.resolution(),
+                m_brdfLut.bakeMilliseconds());
+
+    if (ImGui::Button("Compare shading tiers")) {
+        m_shadingReport = compareShadingTiers(20);
+    }
+    if (m_shadingReport.valid) {
+        ImGui::Text("%dx%d, against the reference:", m_shadingReport.width,
+                    m_shadingReport.height);
+        for (int t = 0; t < ShadingTierReport::TIERS; t++) {
+            ImGui::Text("%s: %.3f ms, max error %.0f, mean %.2f", tiers[t],
+                        m_shadingReport.gpuMs[t], m_shadingReport.maxError[t],
+                        m_shadingReport.meanError[t]);
+        }
+    }
+}
+
+ShadingTierReport Application::compareShadingTiers(int timedDraws) {
+    ShadingTierReport report;
+    const int width = int(m_windowsize.x);
+    const int height = int(m_windowsize.y);
+    if (width <= 0 || height <= 0 || m_asteroids.empty()) {
+        return report;
+    }
+    const int drawn = activeScene == ASTEROID ? 1 : int(m_asteroids.size());
+    auto drawAsteroids = [&]() {
+        for (int i = 0; i < drawn; i++) {
+            m_asteroids.at(i).asteroid.draw(m_view, m_proj);
+        }
+    };
+
+    GLint previousFbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+
+    GLuint fbo, renderbuffers[2];
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, renderbuffers[1]);
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    const int quality = asteroidMeshConfig.shading_quality;
+    std::vector<unsigned char> pixels[ShadingTierReport::TIERS];
+    for (int t = 0; t < ShadingTierReport::TIERS; t++) {
+        asteroidMeshConfig.shading_quality = t;
+
+        // the image, which also builds the variants before they're timed
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glDepthFunc(GL_LESS);
+        drawAsteroids();
+        pixels[t].resize(size_t(width) * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                     pixels[t].data());
+
+        // redrawn over the same depth, so every draw shades every fragment
+        glDepthFunc(GL_LEQUAL);
+        glFinish();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int d = 0; d < timedDraws; d++) {
+            drawAsteroids();
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        report.gpuMs[t] = ns / 1e6 / timedDraws;
+
+        // against the reference
+        int covered = 0;
+        double sum = 0;
+        for (size_t p = 0; p < pixels[t].size(); p += 4) {
+            int error = 0;
+            bool lit = false;
+            for (int c = 0; c < 3; c++) {
+                const int a = pixels[0][p + c];
+                const int b = pixels[t][p + c];
+                error = std::max(error, std::abs(a - b));
+                lit = lit || a > 0 || b > 0;
+            }
+            if (lit) {
+                covered++;
+                sum += error;
+            }
+            report.maxError[t] = std::max(report.maxError[t], float(error));
+        }
+        report.meanError[t] = covered > 0 ? float(sum / covered) : 0;
+    }
+    asteroidMeshConfig.shading_quality = quality;
+    glDeleteQueries(1, &query);
+
+    glDepthFunc(GL_LESS);
+    glPolygonMode(GL_FRONT_AND_BACK, (m_showWireframe) ? GL_LINE : GL_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(2, renderbuffers);
+    glViewport(0, 0, width, height);
+
+    report.valid = true;
+    report.width = width;
+    report.height = height;
+    return report;
+}
+
+void Application::asteroidAoUi() {
+    ImGui::Separator();
+    ImGui::Checkbox("Bake ambient occlusion", &asteroidMeshConfig.bake_ao);
+    if (!asteroidMeshConfig.bake_ao) {
+        return;
+    }
+
+    ImGui::SliderInt("AO rays", &asteroidMeshConfig.ao_rays, 1, 64);
+    ImGui::SliderFloat("AO distance (cells)", &asteroidMeshConfig.ao_distance, 1, 20, "%.1f");
+    ImGui::Text("AO bake %.3f ms", m_asteroids.at(0).asteroid.last_ao_bake_ms);
+
+    // Regenerates the first asteroid with one thread and then all of them,
+    // so the bake's scaling across cores can be checked.
+    if (ImGui::Button("Benchmark AO bake")) {
+        auto seed = std::chrono::system_clock::now().time_since_epoch().count();
+#ifdef CGRA_HAVE_OPENMP
+        m_aoBenchThreads = omp_get_max_threads();
+        omp_set_num_threads(1);
+        m_asteroids.at(0).asteroid.regenerate_mesh(seed);
+        m_aoBenchMs[0] = m_asteroids.at(0).asteroid.last_ao_bake_ms;
+        omp_set_num_threads(m_aoBenchThreads);
+#else
+        m_aoBenchThreads = 1;
+        m_asteroids.at(0).asteroid.regenerate_mesh(seed);
+        m_aoBenchMs[0] = m_asteroids.at(0).asteroid.last_ao_bake_ms;
+#endif
+        m_asteroids.at(0).asteroid.regenerate_mesh(seed);
+        m_aoBenchMs[1] = m_asteroids.at(0).asteroid.last_ao_bake_ms;
+    }
+    if (m_aoBenchMs[1] > 0) {
+        ImGui::Text("1 thread %.2f ms, %d threads %.2f ms (%.2fx)",
+                    m_aoBenchMs[0], m_aoBenchThreads, m_aoBenchMs[1],
+                    m_aoBenchMs[0] / m_aoBenchMs[1]);
+    }
+}
+
 void Application::cursorPosCallback(double xpos, double ypos) {
     if (m_leftMouseDown) {
         vec2 whsize = m_windowsize / 2.0f;
@@ -345,4 +843,8 @@ void Application::peSetup(ParticleEmitter& pe){
     pe.endColor = vec3(1, 0.8, 0);
     pe.lifeTime = 4;
     pe.spawnRadius = 1.5;
+    pe.spawnShape = SpawnMeshSurface;
+    pe.forceField = &m_forceField;
+    pe.collision = m_trailCollision;
+    pe.restitution = m_trailRestitution;
 }
@@ -10,10 +10,28 @@
 #include "opengl.hpp"
 
 #include "Asteroid.hpp"
+#include "EmitterBatch.hpp"
+#include "ForceField3D.hpp"
+#include "OrenNayarLut.hpp"
+#include "ParticleBudget.hpp"
+#include "ParticleColliders.hpp"
+#include "ParticleCompositor.hpp"
 #include "ParticleEmitter.hpp"
 #include "ParticleModifier.hpp"
+#include "RibbonRenderer.hpp"
 #include "CenterBody.hpp"
 
+// Each asteroid shading tier drawn offscreen from the same camera, against
+// the reference tier (0), and timed.
+struct ShadingTierReport {
+    static const int TIERS = 3;
+    bool valid = false;
+    int width = 0, height = 0;
+    double gpuMs[TIERS] = {0, 0, 0};     // per draw of the asteroids
+    float maxError[TIERS] = {0, 0, 0};   // in 8 bit steps, any channel
+    float meanError[TIERS] = {0, 0, 0};  // over pixels either image covers
+};
+
 struct AsteroidAndPartEmitter {
     Asteroid asteroid;
     ParticleEmitter particleEmitter;
@@ -67,15 +85,68 @@ class Application {
     AsteroidMeshConfig asteroidMeshConfig;
     std::vector<AsteroidAndPartEmitter> m_asteroids;
 
+    // Oren-Nayar terms for the asteroids' lookup table shading tier
+    OrenNayarLut m_brdfLut;
+    ShadingTierReport m_shadingReport;
+    // last frame's camera, for drawing the tiers outside of render()
+    glm::mat4 m_view = glm::mat4(1);
+    glm::mat4 m_proj = glm::mat4(1);
+
+    // All the asteroid trails in one update pass and one draw.
+    EmitterBatch m_trailBatch;
+    std::vector<ParticleEmitter *> m_trailEmitters;
+    bool m_batchTrails = true;
+
+    // trails as particle billboards, ribbons or both
+    enum TrailStyle { TrailBillboards, TrailRibbons, TrailBoth };
+    int m_trailStyle = TrailBillboards;
+    RibbonRenderer m_ribbons;
+    std::vector<glm::vec3> m_ribbonPositions;
+
+    // particles drawn at reduced resolution and upsampled over the frame
+    ParticleCompositor m_particleCompositor;
+
+    // one limit on the trails' live particles, shared out by screen size
+    ParticleBudget m_particleBudget;
+    std::vector<ParticleBudget::Entry> m_budgetEntries;
+    int m_targetAsteroids = asteroidCount;
+
+    // curl noise turbulence for every particle system, tiled over the scene
+    ForceField3D m_forceField;
+    float m_fieldTileSize = 60;
+    int m_fieldResolution = 32;
+    float m_fieldFrequency = 4;
+
+    // the centre body and asteroids, culled per emitter every frame
+    ParticleColliders m_colliders;
+    ParticleCollision m_trailCollision = CollideBounce;
+    float m_trailRestitution = 0.3;
+
 	  // central body
 	  CenterBody centerBody;
+    // CenterBody::build_surface settings, the UV sphere is drawn when off
+    bool m_bodyCsg = false;
+    int m_bodySeed = 1;
+    int m_bodyCraters = 40;
+    int m_bodyBoulders = 60;
+    int m_bodyResolution = 64;
 
     ParticleEmitter particleEmitter;
     ParticleModifier particleModifier = ParticleModifier(particleEmitter);
 
     std::chrono::time_point<std::chrono::system_clock> m_previousFrameTime;
+    double m_startupMs = 0; // constructor, shader builds and loads included
     float timescale = 1;
 
+    // time spent re-extracting morphing asteroids this frame
+    double m_regenMs = 0;
+    int m_drawnIndices = 0;
+    int m_totalIndices = 0;
+
+    // ambient occlusion bake benchmark (single thread vs all threads)
+    double m_aoBenchMs[2] = {0, 0};
+    int m_aoBenchThreads = 1;
+
   public:
     // setup
     Application(GLFWwindow *);
@@ -86,6 +157,9 @@ class Application {
 
     // setup rotate parameters
     void setup();
+    // releases what's shared through cgra::asset_registry, while the GL
+    // context is still current
+    void destroy();
 
     // rendering callbacks (every frame)
     void render();
@@ -94,6 +168,21 @@ class Application {
     void cullAsteroids();
 
     void randomizeAsteroidParams(AsteroidAndPartEmitter &aAndPe);
+    void centerBodyUi();
+    void asteroidFieldUi();
+    void asteroidMorphUi();
+    void asteroidCullingUi();
+    void asteroidShadingUi();
+    // draws the asteroids the scene shows with every shading tier
+    ShadingTierReport compareShadingTiers(int timedDraws);
+    void asteroidAoUi();
+    void particleCompositorUi();
+    void particleBudgetUi();
+    void forceFieldUi();
+    void collisionUi();
+    void trailStyleUi();
+    void gatherColliders();
+    void setAsteroidCount(int count);
 
     void peSetup(ParticleEmitter &pe);
 
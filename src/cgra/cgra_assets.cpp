@@ -0,0 +1,96 @@
+
+// std
+#include <iostream>
+#include <sstream>
+
+// project
+#include "cgra_assets.hpp"
+#include "cgra_image.hpp"
+
+
+namespace cgra {
+
+	std::string asset_registry::program_desc::key() const {
+		std::ostringstream k;
+		for (const auto &stage : stages) k << stage.first << ":" << stage.second << "|";
+		for (const auto &d : defines) k << d << ";";
+		k << "|";
+		for (const auto &v : varyings) k << v << ",";
+		return k.str();
+	}
+
+
+	asset_registry & asset_registry::shared() {
+		static asset_registry registry;
+		return registry;
+	}
+
+
+	program asset_registry::acquire_program(const program_desc &desc) {
+		const std::string key = desc.key();
+		auto it = m_programs.find(key);
+		if (it != m_programs.end()) {
+			it->second.refs++;
+			m_counts.shared_acquires++;
+			return it->second.prog;
+		}
+
+		shader_builder sb;
+		for (const auto &stage : desc.stages) sb.set_shader(stage.first, stage.second);
+		for (const auto &d : desc.defines) sb.define(d);
+		if (!desc.varyings.empty()) sb.set_transform_feedback_varyings(desc.varyings);
+		program p = sb.build();
+
+		m_programs[key] = program_entry{p, 1};
+		m_program_keys[p.id()] = key;
+		m_counts.program_builds++;
+		return p;
+	}
+
+
+	GLuint asset_registry::acquire_texture(const std::string &filename) {
+		auto it = m_textures.find(filename);
+		if (it != m_textures.end()) {
+			it->second.refs++;
+			m_counts.shared_acquires++;
+			return it->second.id;
+		}
+
+		const GLuint id = rgba_image(filename).uploadTexture();
+		m_textures[filename] = texture_entry{id, 1};
+		m_texture_keys[id] = filename;
+		m_counts.texture_loads++;
+		return id;
+	}
+
+
+	void asset_registry::release_program(GLuint id) {
+		auto key = m_program_keys.find(id);
+		if (key == m_program_keys.end()) return;
+		auto it = m_programs.find(key->second);
+		if (--it->second.refs > 0) return;
+		glDeleteProgram(id);
+		m_programs.erase(it);
+		m_program_keys.erase(key);
+	}
+
+
+	void asset_registry::release_texture(GLuint id) {
+		auto key = m_texture_keys.find(id);
+		if (key == m_texture_keys.end()) return;
+		auto it = m_textures.find(key->second);
+		if (--it->second.refs > 0) return;
+		glDeleteTextures(1, &id);
+		m_textures.erase(it);
+		m_texture_keys.erase(key);
+	}
+
+
+	asset_registry::counts asset_registry::stats() const {
+		counts c = m_counts;
+		c.programs = int(m_programs.size());
+		c.textures = int(m_textures.size());
+		return c;
+	}
+
+}
@@ -0,0 +1,130 @@
+
+#pragma once
+
+// std
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// project
+#include "cgra_shader.hpp"
+#include <opengl.hpp>
+
+
+namespace cgra {
+
+	// Shader programs and textures loaded once and shared by everything that
+	// asks for the same one, instead of every instance compiling and uploading
+	// its own copy. Each acquire adds a reference and each release drops one,
+	// the GL object is deleted with the last reference. Like the objects
+	// holding them, handles are released explicitly (copies share them, so
+	// the last owner releases).
+	class asset_registry {
+	public:
+		// Shader files (type, path) to link into one program, the defines
+		// ("NAME" or "NAME value", see shader_builder::define) and any
+		// transform feedback outputs. All three make up the key.
+		struct program_desc {
+			std::vector<std::pair<GLenum, std::string>> stages;
+			std::vector<std::string> defines;
+			std::vector<std::string> varyings;
+
+			std::string key() const;
+		};
+
+		struct counts {
+			int programs = 0; // alive
+			int textures = 0;
+			int program_builds = 0; // since startup
+			int texture_loads = 0;
+			int shared_acquires = 0; // served without building or loading
+		};
+
+	private:
+		struct program_entry {
+			program prog;
+			int refs = 0;
+		};
+		struct texture_entry {
+			GLuint id = 0;
+			int refs = 0;
+		};
+
+		std::map<std::string, program_entry> m_programs;
+		std::map<GLuint, std::string> m_program_keys;
+		std::map<std::string, texture_entry> m_textures;
+		std::map<GLuint, std::string> m_texture_keys;
+		counts m_counts;
+
+	public:
+		// the registry the whole application shares
+		static asset_registry & shared();
+
+		// Throws like shader_builder if the program doesn't compile or link,
+		// in which case nothing is registered.
+		program acquire_program(const program_desc &desc);
+		// An RGBA8 mipmapped texture of the image file (see rgba_image).
+		GLuint acquire_texture(const std::string &filename);
+
+		// Releasing something the registry doesn't hold does nothing.
+		void release_program(GLuint id);
+		void release_texture(GLuint id);
+
+		counts stats() const;
+	};
+
+
+	// Specialised variants of one program: the same shader files built with
+	// different sets of defines, so features are compile time branches
+	// instead of uniform branches. A variant is keyed by a bit per flag
+	// define and a tier number, and built (through the asset_registry) the
+	// first time it's asked for. Uniforms is the caller's set of handles,
+	// constructed from each variant's program as it's built.
+	template <typename Uniforms>
+	class shader_variants {
+	public:
+		struct variant {
+			program prog;
+			Uniforms uniforms;
+		};
+
+	private:
+		asset_registry::program_desc m_base;
+		std::vector<std::string> m_flags;
+		std::string m_tier; // defined to the tier, empty if there are none
+		std::map<std::pair<unsigned, int>, variant> m_variants;
+
+	public:
+		shader_variants() { }
+		shader_variants(const asset_registry::program_desc &base, const std::vector<std::string> &flags,
+			const std::string &tier_define = "")
+			: m_base(base), m_flags(flags), m_tier(tier_define) { }
+
+		// The variant with flags[i] defined for every bit i set in flags, and
+		// tier_define defined to tier.
+		const variant & get(unsigned flags, int tier = 0) {
+			const auto key = std::make_pair(flags, tier);
+			auto it = m_variants.find(key);
+			if (it != m_variants.end()) return it->second;
+
+			asset_registry::program_desc desc = m_base;
+			for (size_t i = 0; i < m_flags.size(); i++) {
+				if (flags & (1u << i)) desc.defines.push_back(m_flags[i]);
+			}
+			if (!m_tier.empty()) desc.defines.push_back(m_tier + " " + std::to_string(tier));
+			program p = asset_registry::shared().acquire_program(desc);
+			return m_variants.emplace(key, variant{p, Uniforms(p)}).first->second;
+		}
+
+		// variants built so far
+		int size() const { return int(m_variants.size()); }
+
+		// Releases every variant built, they are rebuilt if asked for again.
+		void release() {
+			for (auto &v : m_variants) asset_registry::shared().release_program(v.second.prog);
+			m_variants.clear();
+		}
+	};
+
+}
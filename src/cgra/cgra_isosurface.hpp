@@ -0,0 +1,538 @@
+#pragma once
+
+// std
+#include <cmath>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+
+// Header-only isosurface extraction (marching cubes).
+//
+// Everything is templated on the scalar type and on a field policy, a small
+// callable object `T operator()(T x, T y, T z) const`, so the compiler can
+// inline the field evaluation into the sampling loop per policy instead of
+// going through a virtual or indirect call per sample.
+//
+// Fields use density convention: a point is inside the surface when its value
+// is greater than the iso level. Signed distance fields are negated by
+// sdf_field so they can be extracted at iso level 0.
+namespace cgra {
+	namespace iso {
+
+		// Dense 3D grid of values stored x-major, so slabs along x are
+		// contiguous and can be sampled or extracted independently.
+		template <typename V>
+		struct dense_grid {
+			glm::ivec3 size{0};
+			std::vector<V> values;
+
+			dense_grid() { }
+
+			explicit dense_grid(glm::ivec3 size_, V value = V(0)) : size(size_), values(size_t(size_.x) * size_.y * size_.z, value) { }
+
+			size_t index(int i, int j, int k) const {
+				return (size_t(i) * size.y + j) * size.z + k;
+			}
+
+			V & at(int i, int j, int k) { return values[index(i, j, k)]; }
+
+			const V & at(int i, int j, int k) const { return values[index(i, j, k)]; }
+
+			// trilinear interpolation at a grid-space position (clamped to the grid)
+			V sample(glm::vec3 g) const {
+				g = glm::clamp(g, glm::vec3(0), glm::vec3(size - 1) - 0.001f);
+				const glm::ivec3 i(g);
+				const glm::vec3 f = g - glm::vec3(i);
+
+				const V c00 = glm::mix(at(i.x, i.y, i.z), at(i.x + 1, i.y, i.z), f.x);
+				const V c10 = glm::mix(at(i.x, i.y + 1, i.z), at(i.x + 1, i.y + 1, i.z), f.x);
+				const V c01 = glm::mix(at(i.x, i.y, i.z + 1), at(i.x + 1, i.y, i.z + 1), f.x);
+				const V c11 = glm::mix(at(i.x, i.y + 1, i.z + 1), at(i.x + 1, i.y + 1, i.z + 1), f.x);
+
+				return glm::mix(glm::mix(c00, c10, f.y), glm::mix(c01, c11, f.y), f.z);
+			}
+		};
+
+
+		//
+		// Field policies
+		//
+
+		// Samples another dense grid, given in that grid's index space.
+		template <typename T>
+		struct grid_field {
+			const dense_grid<T> *grid;
+
+			T operator()(T x, T y, T z) const {
+				return grid->sample(glm::vec3(x, y, z));
+			}
+		};
+
+		// Analytic signed distance function (negative inside), negated into
+		// a density so it is extracted at iso level 0.
+		template <typename T, typename Sdf>
+		struct sdf_field {
+			Sdf sdf;
+
+			T operator()(T x, T y, T z) const {
+				return -sdf(x, y, z);
+			}
+		};
+
+		// Octave noise remapped to [0, 1], for any noise type with an
+		// octave3D_01 member (eg. siv::PerlinNoise).
+		template <typename T, typename Noise>
+		struct noise3_field {
+			const Noise *noise;
+			T scale = 1;
+			int octaves = 5;
+
+			T operator()(T x, T y, T z) const {
+				return T(noise->octave3D_01(x * scale, y * scale, z * scale, octaves));
+			}
+		};
+
+		// As noise3_field, sliced at a fixed w (eg. time) through 4D noise
+		// with an octave4D_01 member (eg. cgra::perlin_noise_4d).
+		template <typename T, typename Noise>
+		struct noise4_field {
+			const Noise *noise;
+			T scale = 1;
+			int octaves = 5;
+			T w = 0;
+
+			T operator()(T x, T y, T z) const {
+				return T(noise->octave4D_01(x * scale, y * scale, z * scale, w, octaves));
+			}
+		};
+
+		// Fades a field out towards a sphere of the given radius around the
+		// origin, multiplying by 1 - (dist / radius)^2.
+		template <typename T, typename Field>
+		struct sphere_mask {
+			Field field;
+			T radius = 1;
+
+			T operator()(T x, T y, T z) const {
+				const T d2 = (x * x + y * y + z * z) / (radius * radius);
+				return field(x, y, z) * (T(1) - d2);
+			}
+		};
+
+		// CSG composition on densities. These are only meaningful when both
+		// operands share the same iso level (eg. two sdf_fields at 0).
+		template <typename T, typename A, typename B>
+		struct csg_union {
+			A a;
+			B b;
+
+			T operator()(T x, T y, T z) const {
+				return std::max(a(x, y, z), b(x, y, z));
+			}
+		};
+
+		template <typename T, typename A, typename B>
+		struct csg_intersection {
+			A a;
+			B b;
+
+			T operator()(T x, T y, T z) const {
+				return std::min(a(x, y, z), b(x, y, z));
+			}
+		};
+
+		template <typename T, typename A, typename B>
+		struct csg_difference {
+			A a;
+			B b;
+
+			T operator()(T x, T y, T z) const {
+				return std::min(a(x, y, z), -b(x, y, z));
+			}
+		};
+
+
+		//
+		// Sampling and extraction
+		//
+
+		// Fills the box [lo, hi) of the grid with field(origin + spacing * ijk).
+		template <typename T, typename Field>
+		void sample_box(dense_grid<T> &grid, const Field &field, glm::vec<3, T> origin, T spacing, glm::ivec3 lo, glm::ivec3 hi) {
+			for (int i = lo.x; i < hi.x; i++) {
+				const T x = origin.x + spacing * i;
+				for (int j = lo.y; j < hi.y; j++) {
+					const T y = origin.y + spacing * j;
+					T *row = &grid.at(i, j, 0);
+					for (int k = lo.z; k < hi.z; k++) {
+						row[k] = field(x, y, origin.z + spacing * k);
+					}
+				}
+			}
+		}
+
+		// Fills the slab [x_begin, x_end) of the grid.
+		template <typename T, typename Field>
+		void sample(dense_grid<T> &grid, const Field &field, glm::vec<3, T> origin, T spacing, int x_begin, int x_end) {
+			sample_box(grid, field, origin, spacing, glm::ivec3(x_begin, 0, 0), glm::ivec3(x_end, grid.size.y, grid.size.z));
+		}
+
+		// Central difference gradients for the slab [x_begin, x_end), zero on
+		// the grid boundary.
+		template <typename T>
+		void compute_gradients(const dense_grid<T> &grid, dense_grid<glm::vec3> &grads, int x_begin, int x_end) {
+			const glm::ivec3 s = grid.size;
+			for (int i = x_begin; i < x_end; i++) {
+				for (int j = 0; j < s.y; j++) {
+					for (int k = 0; k < s.z; k++) {
+						// The edge case, literally.
+						if (i == 0 || i == s.x - 1 || j == 0 || j == s.y - 1 || k == 0 || k == s.z - 1) {
+							grads.at(i, j, k) = glm::vec3(0);
+							continue;
+						}
+						grads.at(i, j, k) = glm::vec3(
+							grid.at(i + 1, j, k) - grid.at(i - 1, j, k),
+							grid.at(i, j + 1, k) - grid.at(i, j - 1, k),
+							grid.at(i, j, k + 1) - grid.at(i, j, k - 1)
+						) * 0.5f;
+					}
+				}
+			}
+		}
+
+
+		namespace detail {
+
+			/*
+			 *   2-----3
+			 *  /|    /|
+			 * 6-----7 |
+			 * | 0---|-1
+			 * |/    |/
+			 * 4-----5
+			 */
+			inline glm::vec3 corner_offset(int c) {
+				return glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+			}
+
+			/*     +---2---+
+			 *    /|      /|
+			 *  11 3    10 1
+			 *  /  |    /  |
+			 * +---6---+-0-+
+			 * |  /    |  /
+			 * 7 8     5 9
+			 * |/      |/
+			 * +---4---+
+			 */
+			constexpr int edge_corners[12][2] = {
+				{0, 1}, {1, 3}, {2, 3}, {0, 2},
+				{4, 5}, {5, 7}, {6, 7}, {4, 6},
+				{0, 4}, {1, 5}, {3, 7}, {2, 6}
+			};
+
+			// Edges making up the triangles of each case, in triplets, capped
+			// off with a -1.
+			constexpr signed char tri_table[256][16] = {
+			{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  9,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  8,  1,  1,  8,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  0, 11, 11,  0,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  2, 11,  1,  0,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{11,  1,  2, 11,  9,  1, 11,  8,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  8,  2,  1, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  2,  9,  9,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  2,  3,  8, 10,  2,  8,  9, 10, -1, -1, -1, -1, -1, -1, -1},
+			{11,  3, 10, 10,  3,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  0,  1, 10,  8,  0, 10, 11,  8, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  3,  0,  9, 11,  3,  9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  9, 11, 11,  9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  4,  3,  3,  4,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  8,  7,  0,  9,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  4,  9,  1,  7,  4,  1,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  7,  4, 11,  3,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4, 11,  7,  4,  2, 11,  4,  0,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  9,  1,  8,  7,  4, 11,  3,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  4, 11, 11,  4,  2,  2,  4,  9,  2,  9,  1, -1, -1, -1, -1},
+			{ 4,  8,  7,  2,  1, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  4,  3,  3,  4,  0, 10,  2,  1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  2,  9,  9,  2,  0,  7,  4,  8, -1, -1, -1, -1, -1, -1, -1},
+			{10,  2,  3, 10,  3,  4,  3,  7,  4,  9, 10,  4, -1, -1, -1, -1},
+			{ 1, 10,  3,  3, 10, 11,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1},
+			{10, 11,  1, 11,  7,  4,  1, 11,  4,  1,  4,  0, -1, -1, -1, -1},
+			{ 7,  4,  8,  9,  3,  0,  9, 11,  3,  9, 10, 11, -1, -1, -1, -1},
+			{ 7,  4, 11,  4,  9, 11,  9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  4,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  4,  5,  8,  0,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  5,  0,  0,  5,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  8,  4,  5,  3,  8,  5,  1,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  4,  5, 11,  3,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 11,  0,  0, 11,  8,  5,  9,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  5,  0,  0,  5,  1, 11,  3,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  1,  4,  1,  2, 11,  4,  1, 11,  4, 11,  8, -1, -1, -1, -1},
+			{ 1, 10,  2,  5,  9,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  4,  5,  0,  3,  8,  2,  1, 10, -1, -1, -1, -1, -1, -1, -1},
+			{ 2,  5, 10,  2,  4,  5,  2,  0,  4, -1, -1, -1, -1, -1, -1, -1},
+			{10,  2,  5,  5,  2,  4,  4,  2,  3,  4,  3,  8, -1, -1, -1, -1},
+			{11,  3, 10, 10,  3,  1,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  5,  9, 10,  0,  1, 10,  8,  0, 10, 11,  8, -1, -1, -1, -1},
+			{11,  3,  0, 11,  0,  5,  0,  4,  5, 10, 11,  5, -1, -1, -1, -1},
+			{ 4,  5,  8,  5, 10,  8, 10, 11,  8, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  7,  9,  9,  7,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  9,  0,  3,  5,  9,  3,  7,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  0,  8,  7,  1,  0,  7,  5,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  5,  3,  3,  5,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  9,  7,  7,  9,  8,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 11,  7,  2,  7,  9,  7,  5,  9,  0,  2,  9, -1, -1, -1, -1},
+			{ 2, 11,  3,  7,  0,  8,  7,  1,  0,  7,  5,  1, -1, -1, -1, -1},
+			{ 2, 11,  1, 11,  7,  1,  7,  5,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  7,  9,  9,  7,  5,  2,  1, 10, -1, -1, -1, -1, -1, -1, -1},
+			{10,  2,  1,  3,  9,  0,  3,  5,  9,  3,  7,  5, -1, -1, -1, -1},
+			{ 7,  5,  8,  5, 10,  2,  8,  5,  2,  8,  2,  0, -1, -1, -1, -1},
+			{10,  2,  5,  2,  3,  5,  3,  7,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  7,  5,  8,  5,  9, 11,  3, 10,  3,  1, 10, -1, -1, -1, -1},
+			{ 5, 11,  7, 10, 11,  5,  1,  9,  0, -1, -1, -1, -1, -1, -1, -1},
+			{11,  5, 10,  7,  5, 11,  8,  3,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 5, 11,  7, 10, 11,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7, 11,  6,  3,  8,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  7, 11,  0,  9,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  1,  8,  8,  1,  3,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  2,  7,  7,  2,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  7,  8,  0,  6,  7,  0,  2,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  7,  2,  2,  7,  3,  9,  1,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  7,  8,  6,  8,  1,  8,  9,  1,  2,  6,  1, -1, -1, -1, -1},
+			{11,  6,  7, 10,  2,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  8,  0, 11,  6,  7, 10,  2,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  9,  2,  2,  9, 10,  7, 11,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  7, 11,  8,  2,  3,  8, 10,  2,  8,  9, 10, -1, -1, -1, -1},
+			{ 7, 10,  6,  7,  1, 10,  7,  3,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  0,  7,  7,  0,  6,  6,  0,  1,  6,  1, 10, -1, -1, -1, -1},
+			{ 7,  3,  6,  3,  0,  9,  6,  3,  9,  6,  9, 10, -1, -1, -1, -1},
+			{ 6,  7, 10,  7,  8, 10,  8,  9, 10, -1, -1, -1, -1, -1, -1, -1},
+			{11,  6,  8,  8,  6,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  3, 11,  6,  0,  3,  6,  4,  0, -1, -1, -1, -1, -1, -1, -1},
+			{11,  6,  8,  8,  6,  4,  1,  0,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  3,  9,  3, 11,  6,  9,  3,  6,  9,  6,  4, -1, -1, -1, -1},
+			{ 2,  8,  3,  2,  4,  8,  2,  6,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  0,  6,  6,  0,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  1,  0,  2,  8,  3,  2,  4,  8,  2,  6,  4, -1, -1, -1, -1},
+			{ 9,  1,  4,  1,  2,  4,  2,  6,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  8,  6,  6,  8, 11,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 1, 10,  2,  6,  3, 11,  6,  0,  3,  6,  4,  0, -1, -1, -1, -1},
+			{11,  6,  4, 11,  4,  8, 10,  2,  9,  2,  0,  9, -1, -1, -1, -1},
+			{10,  4,  9,  6,  4, 10, 11,  2,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  8,  3,  4,  3, 10,  3,  1, 10,  6,  4, 10, -1, -1, -1, -1},
+			{ 1, 10,  0, 10,  6,  0,  6,  4,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 4, 10,  6,  9, 10,  4,  0,  8,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 4, 10,  6,  9, 10,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  7, 11,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  5,  9,  7, 11,  6,  3,  8,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  0,  5,  5,  0,  4, 11,  6,  7, -1, -1, -1, -1, -1, -1, -1},
+			{11,  6,  7,  5,  8,  4,  5,  3,  8,  5,  1,  3, -1, -1, -1, -1},
+			{ 3,  2,  7,  7,  2,  6,  9,  4,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  9,  4,  0,  7,  8,  0,  6,  7,  0,  2,  6, -1, -1, -1, -1},
+			{ 3,  2,  6,  3,  6,  7,  1,  0,  5,  0,  4,  5, -1, -1, -1, -1},
+			{ 6,  1,  2,  5,  1,  6,  4,  7,  8, -1, -1, -1, -1, -1, -1, -1},
+			{10,  2,  1,  6,  7, 11,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  8,  4,  5,  9, 11,  6,  7, 10,  2,  1, -1, -1, -1, -1},
+			{ 7, 11,  6,  2,  5, 10,  2,  4,  5,  2,  0,  4, -1, -1, -1, -1},
+			{ 8,  4,  7,  5, 10,  6,  3, 11,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  4,  5,  7, 10,  6,  7,  1, 10,  7,  3,  1, -1, -1, -1, -1},
+			{10,  6,  5,  7,  8,  4,  1,  9,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  3,  0,  7,  3,  4,  6,  5, 10, -1, -1, -1, -1, -1, -1, -1},
+			{10,  6,  5,  8,  4,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  6,  5,  9, 11,  6,  9,  8, 11, -1, -1, -1, -1, -1, -1, -1},
+			{11,  6,  3,  3,  6,  0,  0,  6,  5,  0,  5,  9, -1, -1, -1, -1},
+			{11,  6,  5, 11,  5,  0,  5,  1,  0,  8, 11,  0, -1, -1, -1, -1},
+			{11,  6,  3,  6,  5,  3,  5,  1,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  8,  5,  8,  3,  2,  5,  8,  2,  5,  2,  6, -1, -1, -1, -1},
+			{ 5,  9,  6,  9,  0,  6,  0,  2,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  6,  5,  2,  6,  1,  3,  0,  8, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  6,  5,  2,  6,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 2,  1, 10,  9,  6,  5,  9, 11,  6,  9,  8, 11, -1, -1, -1, -1},
+			{ 9,  0,  1,  3, 11,  2,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1},
+			{11,  0,  8,  2,  0, 11, 10,  6,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 3, 11,  2,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  8,  3,  9,  8,  1,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  5, 10,  0,  1,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  3,  0,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  5, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  5,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  8,  6, 10,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  5,  6,  9,  1,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  8,  1,  1,  8,  9,  6, 10,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 11,  3,  6, 10,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  0, 11, 11,  0,  2,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  0,  9,  2, 11,  3,  6, 10,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  6, 10, 11,  1,  2, 11,  9,  1, 11,  8,  9, -1, -1, -1, -1},
+			{ 5,  6,  1,  1,  6,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  6,  1,  1,  6,  2,  8,  0,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  9,  5,  6,  0,  9,  6,  2,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 6,  2,  5,  2,  3,  8,  5,  2,  8,  5,  8,  9, -1, -1, -1, -1},
+			{ 3,  6, 11,  3,  5,  6,  3,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  0,  1,  8,  1,  6,  1,  5,  6, 11,  8,  6, -1, -1, -1, -1},
+			{11,  3,  6,  6,  3,  5,  5,  3,  0,  5,  0,  9, -1, -1, -1, -1},
+			{ 5,  6,  9,  6, 11,  9, 11,  8,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  6, 10,  7,  4,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  4,  4,  3,  7, 10,  5,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  6, 10,  4,  8,  7,  0,  9,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6, 10,  5,  1,  4,  9,  1,  7,  4,  1,  3,  7, -1, -1, -1, -1},
+			{ 7,  4,  8,  6, 10,  5,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1},
+			{10,  5,  6,  4, 11,  7,  4,  2, 11,  4,  0,  2, -1, -1, -1, -1},
+			{ 4,  8,  7,  6, 10,  5,  3,  2, 11,  1,  0,  9, -1, -1, -1, -1},
+			{ 1,  2, 10, 11,  7,  6,  9,  5,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 2,  1,  6,  6,  1,  5,  8,  7,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  7,  0,  7,  4,  2,  1,  6,  1,  5,  6, -1, -1, -1, -1},
+			{ 8,  7,  4,  6,  9,  5,  6,  0,  9,  6,  2,  0, -1, -1, -1, -1},
+			{ 7,  2,  3,  6,  2,  7,  5,  4,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  8,  7,  3,  6, 11,  3,  5,  6,  3,  1,  5, -1, -1, -1, -1},
+			{ 5,  0,  1,  4,  0,  5,  7,  6, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  5,  4,  6, 11,  7,  0,  8,  3, -1, -1, -1, -1, -1, -1, -1},
+			{11,  7,  6,  9,  5,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6, 10,  4,  4, 10,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6, 10,  4,  4, 10,  9,  3,  8,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 0, 10,  1,  0,  6, 10,  0,  4,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 6, 10,  1,  6,  1,  8,  1,  3,  8,  4,  6,  8, -1, -1, -1, -1},
+			{ 9,  4, 10, 10,  4,  6,  3,  2, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 11,  8,  2,  8,  0,  6, 10,  4, 10,  9,  4, -1, -1, -1, -1},
+			{11,  3,  2,  0, 10,  1,  0,  6, 10,  0,  4,  6, -1, -1, -1, -1},
+			{ 6,  8,  4, 11,  8,  6,  2, 10,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  1,  9,  4,  2,  1,  4,  6,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  8,  0,  4,  1,  9,  4,  2,  1,  4,  6,  2, -1, -1, -1, -1},
+			{ 6,  2,  4,  4,  2,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  8,  2,  8,  4,  2,  4,  6,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  6,  9,  6, 11,  3,  9,  6,  3,  9,  3,  1, -1, -1, -1, -1},
+			{ 8,  6, 11,  4,  6,  8,  9,  0,  1, -1, -1, -1, -1, -1, -1, -1},
+			{11,  3,  6,  3,  0,  6,  0,  4,  6, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  6, 11,  4,  6,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  7,  6, 10,  8,  7, 10,  9,  8, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  7,  0,  7,  6, 10,  0,  7, 10,  0, 10,  9, -1, -1, -1, -1},
+			{ 6, 10,  7,  7, 10,  8,  8, 10,  1,  8,  1,  0, -1, -1, -1, -1},
+			{ 6, 10,  7, 10,  1,  7,  1,  3,  7, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  2, 11, 10,  7,  6, 10,  8,  7, 10,  9,  8, -1, -1, -1, -1},
+			{ 2,  9,  0, 10,  9,  2,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  8,  3,  7,  6, 11,  1,  2, 10, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  6, 11,  1,  2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 2,  1,  9,  2,  9,  7,  9,  8,  7,  6,  2,  7, -1, -1, -1, -1},
+			{ 2,  7,  6,  3,  7,  2,  0,  1,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  7,  0,  7,  6,  0,  6,  2,  0, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  2,  3,  6,  2,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  1,  9,  3,  1,  8, 11,  7,  6, -1, -1, -1, -1, -1, -1, -1},
+			{11,  7,  6,  1,  9,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 6, 11,  7,  0,  8,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{11,  7,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7, 11,  5,  5, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{10,  5, 11, 11,  5,  7,  0,  3,  8, -1, -1, -1, -1, -1, -1, -1},
+			{ 7, 11,  5,  5, 11, 10,  0,  9,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7, 11, 10,  7, 10,  5,  3,  8,  1,  8,  9,  1, -1, -1, -1, -1},
+			{ 5,  2, 10,  5,  3,  2,  5,  7,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  7, 10,  7,  8,  0, 10,  7,  0, 10,  0,  2, -1, -1, -1, -1},
+			{ 0,  9,  1,  5,  2, 10,  5,  3,  2,  5,  7,  3, -1, -1, -1, -1},
+			{ 9,  7,  8,  5,  7,  9, 10,  1,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 1, 11,  2,  1,  7, 11,  1,  5,  7, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  0,  3,  1, 11,  2,  1,  7, 11,  1,  5,  7, -1, -1, -1, -1},
+			{ 7, 11,  2,  7,  2,  9,  2,  0,  9,  5,  7,  9, -1, -1, -1, -1},
+			{ 7,  9,  5,  8,  9,  7,  3, 11,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  1,  7,  7,  1,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  0,  7,  0,  1,  7,  1,  5,  7, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  9,  3,  9,  5,  3,  5,  7,  3, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  7,  8,  5,  7,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  5,  4,  8, 10,  5,  8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3, 11,  0, 11,  5, 11, 10,  5,  4,  0,  5, -1, -1, -1, -1},
+			{ 1,  0,  9,  8,  5,  4,  8, 10,  5,  8, 11, 10, -1, -1, -1, -1},
+			{10,  3, 11,  1,  3, 10,  9,  5,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  2,  8,  8,  2,  4,  4,  2, 10,  4, 10,  5, -1, -1, -1, -1},
+			{10,  5,  2,  5,  4,  2,  4,  0,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  4,  9,  8,  3,  0, 10,  1,  2, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 10,  1,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8, 11,  4, 11,  2,  1,  4, 11,  1,  4,  1,  5, -1, -1, -1, -1},
+			{ 0,  5,  4,  1,  5,  0,  2,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 0, 11,  2,  8, 11,  0,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  4,  9,  2,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  8,  5,  8,  3,  5,  3,  1,  5, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  5,  4,  1,  5,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  4,  9,  3,  0,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 5,  4,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{11,  4,  7, 11,  9,  4, 11, 10,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  8, 11,  4,  7, 11,  9,  4, 11, 10,  9, -1, -1, -1, -1},
+			{11, 10,  7, 10,  1,  0,  7, 10,  0,  7,  0,  4, -1, -1, -1, -1},
+			{ 3, 10,  1, 11, 10,  3,  7,  8,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  2, 10,  3, 10,  4, 10,  9,  4,  7,  3,  4, -1, -1, -1, -1},
+			{ 9,  2, 10,  0,  2,  9,  8,  4,  7, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  4,  7,  0,  4,  3,  1,  2, 10, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  8,  4, 10,  1,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7, 11,  4,  4, 11,  9,  9, 11,  2,  9,  2,  1, -1, -1, -1, -1},
+			{ 1,  9,  0,  4,  7,  8,  2,  3, 11, -1, -1, -1, -1, -1, -1, -1},
+			{ 7, 11,  4, 11,  2,  4,  2,  0,  4, -1, -1, -1, -1, -1, -1, -1},
+			{ 4,  7,  8,  2,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  4,  1,  4,  7,  1,  7,  3,  1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  8,  4,  1,  9,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  4,  7,  0,  4,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 7,  8,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{11, 10,  8,  8, 10,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 0,  3,  9,  3, 11,  9, 11, 10,  9, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  0, 10,  0,  8, 10,  8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+			{10,  3, 11,  1,  3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3,  2,  8,  2, 10,  8, 10,  9,  8, -1, -1, -1, -1, -1, -1, -1},
+			{ 9,  2, 10,  0,  2,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  3,  0, 10,  1,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 2, 10,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 2,  1, 11,  1,  9, 11,  9,  8, 11, -1, -1, -1, -1, -1, -1, -1},
+			{11,  2,  3,  9,  0,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{11,  0,  8,  2,  0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 3, 11,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  8,  3,  9,  8,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 1,  9,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{ 8,  3,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+			};
+		}
+
+		// Marching cubes over the cells [x_begin, x_end) along x. For every
+		// triangle, emit(const glm::vec3 (&pos)[3], const glm::vec3 (&grad)[3])
+		// is called with grid-space positions and interpolated gradients.
+		template <typename T, typename Emit>
+		void extract(const dense_grid<T> &grid, const dense_grid<glm::vec3> &grads, T iso, int x_begin, int x_end, Emit &&emit) {
+			for (int x = x_begin; x < x_end; x++) {
+				for (int y = 0; y < grid.size.y - 1; y++) {
+					for (int z = 0; z < grid.size.z - 1; z++) {
+						T points[8];
+						int mc_case = 0;
+						for (int c = 0; c < 8; c++) {
+							points[c] = grid.at(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1));
+							mc_case |= (points[c] > iso) ? (1 << c) : 0;
+						}
+
+						const signed char *tris = detail::tri_table[mc_case];
+						const glm::vec3 cell(x, y, z);
+
+						for (int t = 0; tris[t] != -1; t += 3) {
+							glm::vec3 pos[3];
+							glm::vec3 grad[3];
+							for (int v = 0; v < 3; v++) {
+								const int a = detail::edge_corners[tris[t + v]][0];
+								const int b = detail::edge_corners[tris[t + v]][1];
+								// where the linear interpolation along the edge crosses iso
+								const float s = float((points[a] - iso) / (points[a] - points[b]));
+								const glm::vec3 oa = detail::corner_offset(a);
+								const glm::vec3 ob = detail::corner_offset(b);
+								pos[v] = cell + glm::mix(oa, ob, s);
+								grad[v] = glm::mix(
+									grads.at(x + int(oa.x), y + int(oa.y), z + int(oa.z)),
+									grads.at(x + int(ob.x), y + int(ob.y), z + int(ob.z)), s);
+							}
+							emit(pos, grad);
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -1,5 +1,9 @@
 
 // std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
 
 // project
@@ -19,6 +23,68 @@ namespace cgra {
 		glDrawElements(mode, index_count, GL_UNSIGNED_INT, 0);
 	}
 
+	int gl_mesh::draw_culled(const mat4 &mvp, const vec3 &eye) {
+		if (vao == 0) return 0;
+		if (meshlets.empty()) {
+			draw();
+			return index_count;
+		}
+
+		// frustum planes in model space (Gribb/Hartmann), xyz is not normalized
+		// so the sphere radius is scaled by its length instead
+		vec4 planes[6];
+		const vec4 row0(mvp[0][0], mvp[1][0], mvp[2][0], mvp[3][0]);
+		const vec4 row1(mvp[0][1], mvp[1][1], mvp[2][1], mvp[3][1]);
+		const vec4 row2(mvp[0][2], mvp[1][2], mvp[2][2], mvp[3][2]);
+		const vec4 row3(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+		planes[0] = row3 + row0;
+		planes[1] = row3 - row0;
+		planes[2] = row3 + row1;
+		planes[3] = row3 - row1;
+		planes[4] = row3 + row2;
+		planes[5] = row3 - row2;
+		float plane_scale[6];
+		for (int i = 0; i < 6; i++) plane_scale[i] = length(vec3(planes[i]));
+
+		// only touched from the GL thread
+		static std::vector<GLsizei> counts;
+		static std::vector<const void *> offsets;
+		counts.clear();
+		offsets.clear();
+
+		int drawn = 0;
+		unsigned int run_end = 0;
+		for (const meshlet &m : meshlets) {
+			bool visible = true;
+			for (int i = 0; i < 6 && visible; i++) {
+				visible = dot(vec3(planes[i]), m.center) + planes[i].w >= -m.radius * plane_scale[i];
+			}
+
+			// the whole normal cone faces away from the eye
+			const vec3 view_dir = m.center - eye;
+			if (visible && dot(view_dir, m.cone_axis) >= m.cone_cutoff * length(view_dir) + m.radius) {
+				visible = false;
+			}
+			if (!visible) continue;
+
+			// merge with the previous range if they are contiguous
+			if (!counts.empty() && run_end == m.index_offset) {
+				counts.back() += m.index_count;
+			} else {
+				counts.push_back(m.index_count);
+				offsets.push_back((const void *)(std::uintptr_t(m.index_offset) * sizeof(unsigned int)));
+			}
+			run_end = m.index_offset + m.index_count;
+			drawn += m.index_count;
+		}
+
+		if (!counts.empty()) {
+			glBindVertexArray(vao);
+			glMultiDrawElements(mode, counts.data(), GL_UNSIGNED_INT, offsets.data(), GLsizei(counts.size()));
+		}
+		return drawn;
+	}
+
 	void gl_mesh::destroy() {
 		// delete the data buffers
 		glDeleteVertexArrays(1, &vao);
@@ -27,6 +93,96 @@ namespace cgra {
 	}
 
 
+	namespace {
+		// spreads the low 10 bits of x out to every third bit
+		std::uint32_t spread_bits(std::uint32_t x) {
+			x &= 0x3ff;
+			x = (x | (x << 16)) & 0x030000ff;
+			x = (x | (x << 8)) & 0x0300f00f;
+			x = (x | (x << 4)) & 0x030c30c3;
+			x = (x | (x << 2)) & 0x09249249;
+			return x;
+		}
+	}
+
+	void mesh_builder::cluster_meshlets(int max_triangles) {
+		meshlets.clear();
+		if (mode != GL_TRIANGLES || indices.empty()) return;
+		max_triangles = std::max(max_triangles, 1);
+
+		const size_t tri_count = indices.size() / 3;
+		auto tri_pos = [&](size_t t, int v) { return vertices[indices[t * 3 + v]].pos; };
+
+		// sort the triangles along a Morton curve through their centroids, so
+		// consecutive runs of triangles form compact patches
+		std::vector<vec3> centroids(tri_count);
+		vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+		for (size_t t = 0; t < tri_count; t++) {
+			centroids[t] = (tri_pos(t, 0) + tri_pos(t, 1) + tri_pos(t, 2)) / 3.0f;
+			lo = min(lo, centroids[t]);
+			hi = max(hi, centroids[t]);
+		}
+		const vec3 scale = 1023.0f / max(hi - lo, vec3(1e-6f));
+
+		std::vector<std::pair<std::uint32_t, unsigned int>> keys(tri_count);
+		for (size_t t = 0; t < tri_count; t++) {
+			const uvec3 q = uvec3((centroids[t] - lo) * scale);
+			keys[t] = { spread_bits(q.x) | (spread_bits(q.y) << 1) | (spread_bits(q.z) << 2), unsigned(t) };
+		}
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<unsigned int> sorted(tri_count * 3);
+		for (size_t t = 0; t < tri_count; t++) {
+			for (int v = 0; v < 3; v++) sorted[t * 3 + v] = indices[keys[t].second * 3 + v];
+		}
+		indices.swap(sorted);
+
+		// bounds for each run of max_triangles
+		for (size_t first = 0; first < tri_count; first += max_triangles) {
+			const size_t last = std::min(first + max_triangles, tri_count);
+			meshlet m;
+			m.index_offset = unsigned(first * 3);
+			m.index_count = unsigned((last - first) * 3);
+
+			// sphere around the box center, not minimal but cheap
+			vec3 b_lo(std::numeric_limits<float>::max()), b_hi(-std::numeric_limits<float>::max());
+			for (size_t i = first * 3; i < last * 3; i++) {
+				b_lo = min(b_lo, vertices[indices[i]].pos);
+				b_hi = max(b_hi, vertices[indices[i]].pos);
+			}
+			m.center = (b_lo + b_hi) * 0.5f;
+			for (size_t i = first * 3; i < last * 3; i++) {
+				m.radius = std::max(m.radius, distance(m.center, vertices[indices[i]].pos));
+			}
+
+			// face normals, oriented to agree with the vertex normals since the
+			// winding isn't guaranteed to be consistent
+			std::vector<vec3> normals;
+			normals.reserve(last - first);
+			vec3 axis(0);
+			for (size_t t = first; t < last; t++) {
+				vec3 n = cross(tri_pos(t, 1) - tri_pos(t, 0), tri_pos(t, 2) - tri_pos(t, 0));
+				const vec3 shading = vertices[indices[t * 3]].norm + vertices[indices[t * 3 + 1]].norm + vertices[indices[t * 3 + 2]].norm;
+				if (dot(n, shading) < 0) n = -n;
+				const float len = length(n);
+				if (len <= 0) continue; // degenerate, faces nowhere
+				normals.push_back(n / len);
+				axis += n / len;
+			}
+
+			if (length(axis) > 0) {
+				m.cone_axis = normalize(axis);
+				float min_dot = 1;
+				for (const vec3 &n : normals) min_dot = std::min(min_dot, dot(n, m.cone_axis));
+				// a cone of 90 degrees or more always has something facing the eye
+				m.cone_cutoff = min_dot <= 0 ? 1 : std::sqrt(1 - min_dot * min_dot);
+			}
+
+			meshlets.push_back(m);
+		}
+	}
+
+
 	gl_mesh mesh_builder::build() const {
 
 		gl_mesh m;
@@ -59,6 +215,10 @@ namespace cgra {
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex), (void *)(offsetof(mesh_vertex, uv)));
 
+		// and baked occlusion at location=3 - a single float
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex), (void *)(offsetof(mesh_vertex, occlusion)));
+
 
 		// IBO
 		//
@@ -70,6 +230,7 @@ namespace cgra {
 		// set the index count and draw modes
 		m.index_count = indices.size();
 		m.mode = mode;
+		m.meshlets = meshlets;
 
 		// clean up by binding VAO 0 (good practice)
 		glBindVertexArray(0);
@@ -15,21 +15,42 @@
 
 namespace cgra {
 
+	// A cluster of consecutive triangles in the index buffer, with bounds used
+	// to cull the whole cluster on the CPU before drawing.
+	struct meshlet {
+		glm::vec3 center{0}; // bounding sphere
+		float radius = 0;
+		glm::vec3 cone_axis{0}; // average facing direction of the triangles
+		float cone_cutoff = 1; // sine of the normal cone's half angle, 1 if it can't be back-face culled
+		unsigned int index_offset = 0;
+		unsigned int index_count = 0;
+	};
+
+
 	// A data structure for holding buffer IDs and other information related to drawing.
 	// Also has a helper functions for drawing the mesh and deleting the gl buffers.
-	// location 1 : positions (vec3)
-	// location 2 : normals (vec3)
-	// location 3 : uv (vec2)
+	// location 0 : positions (vec3)
+	// location 1 : normals (vec3)
+	// location 2 : uv (vec2)
+	// location 3 : occlusion (float)
 	struct gl_mesh {
 		GLuint vao = 0;
 		GLuint vbo = 0;
 		GLuint ibo = 0;
 		GLenum mode = 0; // mode to draw in, eg: GL_TRIANGLES
 		int index_count = 0; // how many indicies to draw (no primitives)
+		std::vector<meshlet> meshlets; // empty unless the builder was clustered
 
 		// calls the draw function on mesh data
 		void draw();
 
+		// draws only the meshlets that are inside the frustum and not facing away
+		// from the eye, with a single glMultiDrawElements. mvp is the full
+		// projection * view * model matrix, eye is the camera position in model
+		// space. Falls back to draw() if there are no meshlets. Returns the number
+		// of indices drawn.
+		int draw_culled(const glm::mat4 &mvp, const glm::vec3 &eye);
+
 		// deletes the gl buffers (cleans up all the data)
 		void destroy();
 	};
@@ -39,6 +60,7 @@ namespace cgra {
 		glm::vec3 pos{0};
 		glm::vec3 norm{0};
 		glm::vec2 uv{0};
+		float occlusion{1}; // baked ambient occlusion, 1 is fully open
 	};
 
 
@@ -49,6 +71,7 @@ namespace cgra {
 		GLenum mode = GL_TRIANGLES;
 		std::vector<mesh_vertex> vertices;
 		std::vector<unsigned int> indices;
+		std::vector<meshlet> meshlets;
 
 		mesh_builder() {}
 
@@ -73,6 +96,10 @@ namespace cgra {
 			indices.insert(indices.end(), inds);
 		}
 
+		// reorders the triangles into spatially coherent clusters of at most
+		// max_triangles and computes their culling bounds (GL_TRIANGLES only)
+		void cluster_meshlets(int max_triangles = 96);
+
 		gl_mesh build() const;
 
 		void print() const {
@@ -80,7 +107,8 @@ namespace cgra {
 			for (mesh_vertex v : vertices) {
 				std::cout << v.pos.x << ", " << v.pos.y << ", " << v.pos.z << ", ";
 				std::cout << v.norm.x << ", " << v.norm.y << ", " << v.norm.z << ", ";
-				std::cout << v.uv.x << ", " << v.uv.y << ", " << std::endl;
+				std::cout << v.uv.x << ", " << v.uv.y << ", ";
+				std::cout << v.occlusion << ", " << std::endl;
 			}
 			std::cout << "idx" << std::endl;
 			for (int i : indices) {
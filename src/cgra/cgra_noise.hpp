@@ -0,0 +1,110 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+
+
+namespace cgra {
+
+	// 4D gradient (Perlin) noise. siv::PerlinNoise only goes up to 3D, this
+	// fills the gap for fields that need to vary smoothly over time (x, y, z, t).
+	// The octave/remap behaviour mirrors siv::PerlinNoise so the two can be
+	// swapped without retuning cutoffs.
+	class perlin_noise_4d {
+	private:
+		std::uint8_t m_perm[512];
+
+		static double fade(double t) noexcept {
+			return t * t * t * (t * (t * 6 - 15) + 10);
+		}
+
+		static double lerp(double a, double b, double t) noexcept {
+			return a + t * (b - a);
+		}
+
+		// 32 gradients of the form (0, +-1, +-1, +-1) and their permutations
+		static double grad(std::uint8_t hash, double x, double y, double z, double w) noexcept {
+			const int h = hash & 31;
+			double a = y, b = z, c = w;
+			switch (h >> 3) {
+			case 1: a = w; b = x; c = y; break;
+			case 2: a = z; b = w; c = x; break;
+			case 3: a = x; b = y; c = z; break;
+			default: break;
+			}
+			return ((h & 4) ? a : -a) + ((h & 2) ? b : -b) + ((h & 1) ? c : -c);
+		}
+
+	public:
+		explicit perlin_noise_4d(std::uint32_t seed = 0) {
+			reseed(seed);
+		}
+
+		void reseed(std::uint32_t seed) {
+			std::iota(m_perm, m_perm + 256, 0);
+			std::shuffle(m_perm, m_perm + 256, std::mt19937(seed));
+			std::copy(m_perm, m_perm + 256, m_perm + 256);
+		}
+
+		// returns noise in roughly [-1, 1]
+		double noise4D(double x, double y, double z, double w) const noexcept {
+			const double fx = std::floor(x), fy = std::floor(y), fz = std::floor(z), fw = std::floor(w);
+			const int X = int(fx) & 255, Y = int(fy) & 255, Z = int(fz) & 255, W = int(fw) & 255;
+			x -= fx; y -= fy; z -= fz; w -= fw;
+
+			const double u = fade(x), v = fade(y), s = fade(z), t = fade(w);
+
+			const int A = m_perm[X] + Y, AA = m_perm[A] + Z, AB = m_perm[A + 1] + Z;
+			const int B = m_perm[X + 1] + Y, BA = m_perm[B] + Z, BB = m_perm[B + 1] + Z;
+
+			const int AAA = m_perm[AA] + W, AAB = m_perm[AA + 1] + W;
+			const int ABA = m_perm[AB] + W, ABB = m_perm[AB + 1] + W;
+			const int BAA = m_perm[BA] + W, BAB = m_perm[BA + 1] + W;
+			const int BBA = m_perm[BB] + W, BBB = m_perm[BB + 1] + W;
+
+			const double w0 = lerp(
+				lerp(
+					lerp(grad(m_perm[AAA], x, y, z, w), grad(m_perm[BAA], x - 1, y, z, w), u),
+					lerp(grad(m_perm[ABA], x, y - 1, z, w), grad(m_perm[BBA], x - 1, y - 1, z, w), u), v),
+				lerp(
+					lerp(grad(m_perm[AAB], x, y, z - 1, w), grad(m_perm[BAB], x - 1, y, z - 1, w), u),
+					lerp(grad(m_perm[ABB], x, y - 1, z - 1, w), grad(m_perm[BBB], x - 1, y - 1, z - 1, w), u), v),
+				s);
+
+			const double w1 = lerp(
+				lerp(
+					lerp(grad(m_perm[AAA + 1], x, y, z, w - 1), grad(m_perm[BAA + 1], x - 1, y, z, w - 1), u),
+					lerp(grad(m_perm[ABA + 1], x, y - 1, z, w - 1), grad(m_perm[BBA + 1], x - 1, y - 1, z, w - 1), u), v),
+				lerp(
+					lerp(grad(m_perm[AAB + 1], x, y, z - 1, w - 1), grad(m_perm[BAB + 1], x - 1, y, z - 1, w - 1), u),
+					lerp(grad(m_perm[ABB + 1], x, y - 1, z - 1, w - 1), grad(m_perm[BBB + 1], x - 1, y - 1, z - 1, w - 1), u), v),
+				s);
+
+			return lerp(w0, w1, t);
+		}
+
+		double octave4D(double x, double y, double z, double w, int octaves, double persistence = 0.5) const noexcept {
+			double result = 0;
+			double amplitude = 1;
+			for (int i = 0; i < octaves; ++i) {
+				result += noise4D(x, y, z, w) * amplitude;
+				x *= 2;
+				y *= 2;
+				z *= 2;
+				w *= 2;
+				amplitude *= persistence;
+			}
+			return result;
+		}
+
+		// octave noise remapped and clamped to [0, 1] (same as siv::PerlinNoise::octave3D_01)
+		double octave4D_01(double x, double y, double z, double w, int octaves, double persistence = 0.5) const noexcept {
+			return std::clamp(octave4D(x, y, z, w, octaves, persistence) * 0.5 + 0.5, 0.0, 1.0);
+		}
+	};
+
+}
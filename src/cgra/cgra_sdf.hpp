@@ -0,0 +1,304 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <random>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
+
+// project
+#include "cgra_isosurface.hpp"
+
+
+// Procedural bodies built from composed signed distance primitives: a
+// noise-displaced base sphere, with boulders unioned on and craters
+// subtracted. Evaluating hundreds of ops per sample is O(ops), so the op
+// bounds are kept in a BVH and each brick of the grid only evaluates the
+// ops that can affect it.
+namespace cgra {
+	namespace sdf {
+
+		struct aabb {
+			glm::vec3 lo{FLT_MAX};
+			glm::vec3 hi{-FLT_MAX};
+
+			void extend(const aabb &o) {
+				lo = glm::min(lo, o.lo);
+				hi = glm::max(hi, o.hi);
+			}
+
+			aabb expanded(float r) const {
+				return { lo - r, hi + r };
+			}
+
+			glm::vec3 centroid() const { return (lo + hi) * 0.5f; }
+
+			bool overlaps(const aabb &o) const {
+				return glm::all(glm::lessThanEqual(lo, o.hi)) && glm::all(glm::lessThanEqual(o.lo, hi));
+			}
+		};
+
+
+		// polynomial smooth minimum, k is the blend radius (0 is a hard min)
+		inline float smooth_min(float a, float b, float k) {
+			if (k <= 0) return std::min(a, b);
+			const float h = std::max(k - std::abs(a - b), 0.0f) / k;
+			return std::min(a, b) - h * h * k * 0.25f;
+		}
+
+		inline float smooth_max(float a, float b, float k) {
+			return -smooth_min(-a, -b, k);
+		}
+
+
+		// Sphere whose surface is pushed out by noise in [-1, 1] scaled by amplitude.
+		struct displaced_sphere {
+			glm::vec3 center{0};
+			float radius = 1;
+			float amplitude = 0;
+			float frequency = 1;
+
+			aabb bounds() const {
+				const float r = radius + std::abs(amplitude);
+				return { center - r, center + r };
+			}
+
+			template <typename Noise>
+			float distance(const glm::vec3 &p, const Noise &noise) const {
+				float d = glm::length(p - center) - radius;
+				if (amplitude != 0) {
+					const glm::vec3 q = p * frequency;
+					d -= amplitude * float(noise.noise3D(q.x, q.y, q.z));
+				}
+				return d;
+			}
+		};
+
+
+		enum class csg_op { unite, subtract };
+
+		struct csg_element {
+			displaced_sphere shape;
+			csg_op op = csg_op::unite;
+			float smoothing = 0;
+
+			// region outside of which this element cannot change the body
+			aabb bounds() const { return shape.bounds().expanded(smoothing); }
+		};
+
+
+		// Bounding volume hierarchy over a set of boxes, built top-down by
+		// splitting at the median centroid along the longest axis.
+		class bvh {
+		private:
+			struct node {
+				aabb box;
+				int left = -1; // children, or -1 for a leaf
+				int right = -1;
+				int first = 0; // range into m_items for leaves
+				int count = 0;
+			};
+
+			std::vector<node> m_nodes;
+			std::vector<int> m_items;
+
+			int build_node(const std::vector<aabb> &boxes, int first, int count) {
+				node n;
+				for (int i = first; i < first + count; i++) n.box.extend(boxes[m_items[i]]);
+
+				const int index = int(m_nodes.size());
+				m_nodes.push_back(n);
+
+				if (count <= 4) {
+					m_nodes[index].first = first;
+					m_nodes[index].count = count;
+					return index;
+				}
+
+				const glm::vec3 extent = n.box.hi - n.box.lo;
+				const int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+				const int mid = first + count / 2;
+				std::nth_element(m_items.begin() + first, m_items.begin() + mid, m_items.begin() + first + count,
+					[&](int a, int b) { return boxes[a].centroid()[axis] < boxes[b].centroid()[axis]; });
+
+				const int left = build_node(boxes, first, mid - first);
+				const int right = build_node(boxes, mid, first + count - mid);
+				m_nodes[index].left = left;
+				m_nodes[index].right = right;
+				return index;
+			}
+
+		public:
+			void build(const std::vector<aabb> &boxes) {
+				m_nodes.clear();
+				m_items.resize(boxes.size());
+				for (size_t i = 0; i < boxes.size(); i++) m_items[i] = int(i);
+				if (!boxes.empty()) build_node(boxes, 0, int(boxes.size()));
+			}
+
+			// appends the index of every box overlapping the query
+			void query(const aabb &box, std::vector<int> &out) const {
+				if (m_nodes.empty()) return;
+				int stack[64];
+				int top = 0;
+				stack[top++] = 0;
+				while (top > 0) {
+					const node &n = m_nodes[stack[--top]];
+					if (!n.box.overlaps(box)) continue;
+					if (n.left < 0) {
+						out.insert(out.end(), m_items.begin() + n.first, m_items.begin() + n.first + n.count);
+					} else {
+						stack[top++] = n.left;
+						stack[top++] = n.right;
+					}
+				}
+			}
+		};
+
+
+		// A body made of a base shape with CSG elements applied to it. All the
+		// unions are applied before the subtractions, so craters also carve
+		// through boulders.
+		template <typename Noise>
+		class csg_body {
+		private:
+			bvh m_bvh;
+
+		public:
+			// held by value, so bodies can be copied and moved with their owner
+			Noise noise;
+			displaced_sphere base;
+			std::vector<csg_element> elements;
+
+			// must be called after changing the elements
+			void build() {
+				std::vector<aabb> boxes;
+				boxes.reserve(elements.size());
+				for (const auto &e : elements) boxes.push_back(e.bounds());
+				m_bvh.build(boxes);
+			}
+
+			aabb bounds() const {
+				aabb b = base.bounds();
+				for (const auto &e : elements) {
+					if (e.op == csg_op::unite) b.extend(e.bounds());
+				}
+				return b;
+			}
+
+			// appends the elements whose bounds overlap box, in element order
+			// (smooth min/max aren't associative, so order must match distance())
+			void query(const aabb &box, std::vector<int> &out) const {
+				const size_t first = out.size();
+				m_bvh.query(box, out);
+				std::sort(out.begin() + first, out.end());
+			}
+
+			// signed distance using only the given elements
+			float distance(const glm::vec3 &p, const int *active, int count) const {
+				float d = base.distance(p, noise);
+				for (int i = 0; i < count; i++) {
+					const csg_element &e = elements[active[i]];
+					if (e.op == csg_op::unite) d = smooth_min(d, e.shape.distance(p, noise), e.smoothing);
+				}
+				for (int i = 0; i < count; i++) {
+					const csg_element &e = elements[active[i]];
+					if (e.op == csg_op::subtract) d = smooth_max(d, -e.shape.distance(p, noise), e.smoothing);
+				}
+				return d;
+			}
+
+			// naive signed distance over every element, O(elements)
+			float distance(const glm::vec3 &p) const {
+				std::vector<int> all(elements.size());
+				for (size_t i = 0; i < all.size(); i++) all[i] = int(i);
+				return distance(p, all.data(), int(all.size()));
+			}
+		};
+
+
+		// Fills a body with a noise-displaced sphere of the given radius, with
+		// boulders unioned onto and craters subtracted from its surface.
+		template <typename Noise>
+		void make_cratered_body(csg_body<Noise> &body, unsigned seed, float radius, int craters, int boulders) {
+			std::mt19937 rng(seed);
+			std::uniform_real_distribution<float> unit(0, 1);
+			std::normal_distribution<float> normal(0, 1);
+			const auto random_dir = [&]() {
+				const glm::vec3 d(normal(rng), normal(rng), normal(rng));
+				return glm::length(d) > 0 ? glm::normalize(d) : glm::vec3(0, 1, 0);
+			};
+
+			body.base = { glm::vec3(0), radius, radius * 0.15f, 3 / radius };
+			body.elements.clear();
+
+			for (int i = 0; i < boulders; i++) {
+				const float r = radius * glm::mix(0.05f, 0.12f, unit(rng));
+				csg_element e;
+				e.shape = { random_dir() * (radius + 0.3f * r), r, 0.2f * r, 1 / r };
+				e.op = csg_op::unite;
+				e.smoothing = 0.5f * r;
+				body.elements.push_back(e);
+			}
+
+			for (int i = 0; i < craters; i++) {
+				const float r = radius * glm::mix(0.08f, 0.22f, unit(rng));
+				csg_element e;
+				e.shape = { random_dir() * (radius + 0.5f * r), r, 0, 1 };
+				e.op = csg_op::subtract;
+				e.smoothing = 0.3f * r;
+				body.elements.push_back(e);
+			}
+
+			body.build();
+		}
+
+
+		// Field policy for cgra::iso over a subset of a body's elements, as a
+		// density of offset - distance (so the surface sits at iso level offset).
+		template <typename T, typename Noise>
+		struct csg_field {
+			const csg_body<Noise> *body;
+			const int *active;
+			int count;
+			T offset = 0;
+
+			T operator()(T x, T y, T z) const {
+				return offset - T(body->distance(glm::vec3(x, y, z), active, count));
+			}
+		};
+
+
+		// Samples the slab [x_begin, x_end) of the grid brick by brick, bricks
+		// aligned to the grid and clipped to the slab. Each brick only
+		// evaluates elements whose bounds come within margin of it; the rest
+		// cannot change the sign of the field near the surface.
+		template <typename T, typename Noise>
+		void sample_bricks(iso::dense_grid<T> &grid, const csg_body<Noise> &body, glm::vec<3, T> origin, T spacing,
+			int x_begin, int x_end, T offset, int brick = 8, float margin = 3)
+		{
+			std::vector<int> active;
+			for (int i0 = x_begin - x_begin % brick; i0 < x_end; i0 += brick) {
+				for (int j0 = 0; j0 < grid.size.y; j0 += brick) {
+					for (int k0 = 0; k0 < grid.size.z; k0 += brick) {
+						const glm::ivec3 lo(std::max(i0, x_begin), j0, k0);
+						const glm::ivec3 hi(std::min(i0 + brick, x_end), std::min(j0 + brick, grid.size.y), std::min(k0 + brick, grid.size.z));
+
+						aabb box;
+						box.lo = glm::vec3(origin) + float(spacing) * glm::vec3(lo);
+						box.hi = glm::vec3(origin) + float(spacing) * glm::vec3(hi - 1);
+
+						active.clear();
+						body.query(box.expanded(margin * float(spacing)), active);
+
+						const csg_field<T, Noise> field{ &body, active.data(), int(active.size()), offset };
+						iso::sample_box(grid, field, origin, spacing, lo, hi);
+					}
+				}
+			}
+		}
+	}
+}
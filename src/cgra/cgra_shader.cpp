@@ -1,5 +1,9 @@
 
 // std
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -60,8 +64,176 @@ void printProgramInfoLog(GLuint obj) {
 }
 
 
+namespace {
+
+	// Start of a cached program binary, followed by length bytes of it.
+	struct binary_header {
+		char magic[4] = {'C', 'G', 'P', 'B'};
+		std::uint32_t format = 0;
+		std::uint32_t length = 0;
+		char key[16] = {}; // the file name, against truncated or moved files
+	};
+
+
+	std::string & binary_cache_dir() {
+		static std::string directory = "shader_cache";
+		return directory;
+	}
+
+
+	cgra::shader_builder::binary_cache_stats & binary_stats_mut() {
+		static cgra::shader_builder::binary_cache_stats stats;
+		return stats;
+	}
+
+
+	bool binary_cache_supported() {
+		static const bool supported = [] {
+			if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			return formats > 0;
+		}();
+		return supported;
+	}
+
+
+	// identifies the driver build the binaries come from
+	const std::string & driver_string() {
+		static const std::string driver = [] {
+			std::string s;
+			for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+				const GLubyte *value = glGetString(name);
+				if (value) s += reinterpret_cast<const char *>(value);
+				s += '\n';
+			}
+			return s;
+		}();
+		return driver;
+	}
+
+
+	std::string binary_path(const std::string &key) {
+		return binary_cache_dir() + "/" + key + ".bin";
+	}
+
+
+	// Links program from the cached binary. A binary that is unreadable or
+	// that the driver rejects (usually after a driver update) is deleted.
+	bool load_binary(GLuint program, const std::string &key) {
+		const std::string path = binary_path(key);
+		std::ifstream in(path, std::ios::binary);
+		if (!in) return false;
+
+		binary_header header;
+		std::vector<char> binary;
+		in.read(reinterpret_cast<char *>(&header), sizeof(header));
+		bool valid = in && std::equal(header.magic, header.magic + 4, binary_header().magic)
+			&& key.compare(0, std::string::npos, header.key, sizeof(header.key)) == 0
+			&& header.length > 0;
+		if (valid) {
+			binary.resize(header.length);
+			in.read(binary.data(), binary.size());
+			valid = bool(in);
+		}
+		in.close();
+
+		GLint link_status = GL_FALSE;
+		if (valid) {
+			glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+			glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+		}
+		if (!link_status) {
+			while (glGetError() != GL_NO_ERROR) { } // an unknown format is GL_INVALID_ENUM
+			binary_stats_mut().rejected++;
+			std::remove(path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+
+	// Writes to a temporary file and renames it over the old one, so a
+	// crash can't leave a partial binary under the key.
+	void store_binary(GLuint program, const std::string &key) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+
+		binary_header header;
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, &length, &format, binary.data());
+		header.format = format;
+		header.length = std::uint32_t(length);
+		std::copy(key.begin(), key.end(), header.key);
+
+		std::error_code ec;
+		std::filesystem::create_directories(binary_cache_dir(), ec);
+		const std::string path = binary_path(key);
+		const std::string temp = path + ".tmp";
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			if (!out) return;
+			out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			out.write(binary.data(), length);
+			if (!out) {
+				out.close();
+				std::remove(temp.c_str());
+				return;
+			}
+		}
+		std::remove(path.c_str()); // rename doesn't replace on Windows
+		std::rename(temp.c_str(), path.c_str());
+	}
+
+}
+
+
 namespace cgra {
 
+	uniform_stats & uniform_stats::frame() {
+		static uniform_stats stats;
+		return stats;
+	}
+
+
+	program::program(GLuint id) : m_state(std::make_shared<state>()) {
+		m_state->id = id;
+
+		GLint count = 0, max_length = 0;
+		glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+		std::vector<char> name(std::max(max_length, 1));
+
+		for (GLint i = 0; i < count; i++) {
+			uniform_slot slot;
+			GLsizei length = 0;
+			glGetActiveUniform(id, GLuint(i), GLsizei(name.size()), &length, &slot.size, &slot.type, name.data());
+			std::string uniform_name(name.data(), length);
+			slot.location = glGetUniformLocation(id, uniform_name.c_str());
+			if (slot.location < 0) continue; // in a uniform block
+
+			const int index = int(m_state->slots.size());
+			m_state->slots.push_back(slot);
+			m_state->names[uniform_name] = index;
+
+			// arrays are reported as "name[0]"
+			const auto bracket = uniform_name.find('[');
+			if (bracket != std::string::npos) m_state->names[uniform_name.substr(0, bracket)] = index;
+		}
+	}
+
+
+	program::uniform_handle program::uniform(const std::string &name) const {
+		uniform_handle u;
+		if (!m_state) return u;
+		auto it = m_state->names.find(name);
+		if (it != m_state->names.end()) u.index = it->second;
+		return u;
+	}
+
+
 	void shader_builder::set_shader(GLenum type, const std::string &filename) {
 		std::ifstream fileStream(filename);
 
@@ -73,20 +245,60 @@ namespace cgra {
 		std::stringstream buffer;
 		buffer << fileStream.rdbuf();
 
-		try {
-			set_shader_source(type, buffer.str());
-		}
-		catch (shader_compile_error &e) {
-			std::cerr << "Error: Could not compile " << filename << std::endl;
-			throw e;
-		}
+		// includes are relative to the file
+		const auto slash = filename.find_last_of("/\\");
+		set_shader_source(type, buffer.str(), slash == std::string::npos ? "" : filename.substr(0, slash));
+		m_stages[type].name = filename;
+	}
+
+
+	void shader_builder::set_shader_source(GLenum type, const std::string &source, const std::string &include_directory) {
+		// assembled and compiled in build(), unless the program binary is cached
+		m_stages[type] = stage{source, "", include_directory};
 	}
 
 
-	void shader_builder::set_shader_source(GLenum type, const std::string &source) {
+	void shader_builder::define(const std::string &name, const std::string &value) {
+		m_defines.push_back(value.empty() ? name : name + " " + value);
+	}
+
+
+	void shader_builder::expand_includes(std::istream &in, const std::string &directory, int first_line,
+		std::vector<std::string> &files, std::ostream &out) {
 
-		// same as GLint shader = glCreateShader(type);
-		gl_object shader = gl_object::gen_shader(type);
+		const int string_index = int(files.size()) - 1;
+		std::string line;
+		for (int line_number = first_line; std::getline(in, line); line_number++) {
+			const auto hash = line.find_first_not_of(" \t");
+			if (hash == std::string::npos || line.compare(hash, 8, "#include") != 0) {
+				out << line << std::endl;
+				continue;
+			}
+
+			const auto open = line.find('"', hash + 8);
+			const auto close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (close == std::string::npos) throw std::runtime_error("Error: Bad #include in " + files.back() + ": " + line);
+			const std::string name = line.substr(open + 1, close - open - 1);
+			const std::string path = directory.empty() ? name : directory + "/" + name;
+
+			// every file only once, which also stops include cycles
+			if (std::find(files.begin(), files.end(), path) == files.end()) {
+				std::ifstream included(path);
+				if (!included) {
+					std::cerr << "Error: Could not locate and open file " << path << std::endl;
+					throw std::runtime_error("Error: Could not locate and open file " + path);
+				}
+				files.push_back(path);
+				out << "#line 1 " << files.size() - 1 << std::endl;
+				const auto slash = path.find_last_of("/\\");
+				expand_includes(included, slash == std::string::npos ? "" : path.substr(0, slash), 1, files, out);
+			}
+			out << "#line " << line_number + 1 << " " << string_index << std::endl;
+		}
+	}
+
+
+	std::string shader_builder::assemble(GLenum type, const stage &s, std::vector<std::string> &files) const {
 
 		// cgra specific extra (allows different shaders to be defined in a single source)
 		// Start of CGRA addition
@@ -103,42 +315,45 @@ namespace cgra {
 				return "_TESS_EVALUATION_";
 			case GL_FRAGMENT_SHADER:
 				return "_FRAGMENT_";
+			case GL_COMPUTE_SHADER:
+				return "_COMPUTE_";
 			default:
 				return "_INVALID_SHADER_TYPE_";
 			}
 		};
 
-		std::istringstream iss(source);
+		std::istringstream iss(s.source);
 		std::ostringstream oss;
+		int lines = 0;
 		while (iss) {
 			std::string line;
 			std::getline(iss, line);
 			oss << line << std::endl;
+			lines++;
 			if (line.find("#version") < line.find("//"))
 				break;
 		}
 		oss << "#define " << get_define(type) << std::endl;
-		oss << iss.rdbuf();
-		std::string final_source = oss.str();
 		//
 		// End of CGRA addition
 
-		// upload and compile the shader
-		const char *text_c = final_source.c_str();
-		glShaderSource(shader, 1, &text_c, nullptr);
-		glCompileShader(shader);
+		for (const auto &d : m_defines) oss << "#define " << d << std::endl;
 
-		// check compilation status
-		GLint compile_status;
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-		printShaderInfoLog(shader); // print warnings and errors
-		if (!compile_status) throw shader_compile_error();
+		// source string 0 is this stage's own source
+		files.assign(1, s.name.empty() ? "source" : s.name);
+		oss << "#line " << lines + 1 << " 0" << std::endl;
+		expand_includes(iss, s.include_directory, lines + 1, files, oss);
+		return oss.str();
+	}
 
-		m_shaders[type] = std::make_shared<gl_object>(std::move(shader));
+
+	void shader_builder::set_transform_feedback_varyings(const std::vector<std::string> &varyings, GLenum mode) {
+		m_varyings = varyings;
+		m_varyings_mode = mode;
 	}
 
 
-	GLuint shader_builder::build(GLuint program) {
+	program shader_builder::build(GLuint program) {
 
 		// if the program exists get attached shaders and detach them
 		if (program) {
@@ -158,12 +373,53 @@ namespace cgra {
 			program = glCreateProgram();
 		}
 
-		// attach shaders
-		for (auto &shader_pair : m_shaders) {
-			glAttachShader(program, *(shader_pair.second));
+		// every stage's final source, and the files its #line numbers refer to
+		std::map<GLenum, std::string> sources;
+		std::map<GLenum, std::vector<std::string>> files;
+		for (auto &stage_pair : m_stages) {
+			sources[stage_pair.first] = assemble(stage_pair.first, stage_pair.second, files[stage_pair.first]);
+		}
+
+		const std::string key = binary_key(sources);
+		if (!key.empty() && load_binary(program, key)) {
+			binary_stats_mut().hits++;
+			return cgra::program(program);
+		}
+
+		// compile and attach shaders
+		m_shaders.clear();
+		for (auto &stage_pair : sources) {
+			// same as GLint shader = glCreateShader(type);
+			gl_object shader = gl_object::gen_shader(stage_pair.first);
+			const char *text_c = stage_pair.second.c_str();
+			glShaderSource(shader, 1, &text_c, nullptr);
+			glCompileShader(shader);
+
+			// check compilation status
+			GLint compile_status;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+			printShaderInfoLog(shader); // print warnings and errors
+			if (!compile_status) {
+				const std::vector<std::string> &stage_files = files[stage_pair.first];
+				std::cerr << "Error: Could not compile " << stage_files[0] << std::endl;
+				for (size_t i = 1; i < stage_files.size(); i++)
+					std::cerr << "  source " << i << ": " << stage_files[i] << std::endl;
+				throw shader_compile_error();
+			}
+
+			glAttachShader(program, shader);
+			m_shaders[stage_pair.first] = std::make_shared<gl_object>(std::move(shader));
+		}
+
+		// transform feedback outputs have to be known at link time
+		if (!m_varyings.empty()) {
+			std::vector<const GLchar *> names;
+			for (const auto &v : m_varyings) names.push_back(v.c_str());
+			glTransformFeedbackVaryings(program, GLsizei(names.size()), names.data(), m_varyings_mode);
 		}
 
 		// link the program
+		if (!key.empty()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(program);
 
 		// check link status
@@ -172,7 +428,52 @@ namespace cgra {
 		printProgramInfoLog(program); // print warnings and errors
 		if (!link_status) throw shader_link_error();
 
-		return program;
+		if (!key.empty()) {
+			binary_stats_mut().misses++;
+			store_binary(program, key);
+		}
+
+		return cgra::program(program);
+	}
+
+
+	std::string shader_builder::binary_key(const std::map<GLenum, std::string> &sources) const {
+		if (binary_cache_dir().empty() || !binary_cache_supported()) return "";
+
+		// 64 bit FNV-1a over everything that changes the linked program
+		std::uint64_t hash = 14695981039346656037ull;
+		const auto mix = [&](const std::string &text) {
+			for (unsigned char c : text + '\0') {
+				hash ^= c;
+				hash *= 1099511628211ull;
+			}
+		};
+		mix(driver_string());
+		for (const auto &stage_pair : sources) {
+			mix(std::to_string(stage_pair.first));
+			mix(stage_pair.second);
+		}
+		for (const auto &v : m_varyings) mix(v);
+		mix(std::to_string(m_varyings_mode));
+
+		char hex[17];
+		std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+		return hex;
+	}
+
+
+	void shader_builder::set_binary_cache(const std::string &directory) {
+		binary_cache_dir() = directory;
+	}
+
+
+	const std::string & shader_builder::binary_cache() {
+		return binary_cache_dir();
+	}
+
+
+	const shader_builder::binary_cache_stats & shader_builder::binary_stats() {
+		return binary_stats_mut();
 	}
 
 }
\ No newline at end of file
@@ -2,9 +2,17 @@
 #pragma once
 
 // std
+#include <algorithm>
+#include <cstring>
+#include <iosfwd>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+// glm
+#include <glm/glm.hpp>
 
 // project
 #include <opengl.hpp>
@@ -12,16 +20,152 @@
 
 namespace cgra {
 
+	// Uniform traffic through cgra::program. The application resets this
+	// every frame so the per frame numbers can be shown.
+	struct uniform_stats {
+		int sets = 0; // setter calls
+		int uploads = 0; // glUniform* calls actually made
+
+		static uniform_stats & frame();
+		void reset() { sets = uploads = 0; }
+	};
+
+
+	// A linked shader program, with its active uniforms reflected once after
+	// linking. Uniforms are set through handles looked up up front (instead of
+	// glGetUniformLocation every frame) and a value is only uploaded if it
+	// differs from the last value uploaded to that uniform. Copies share the
+	// program and its cache. The setters assume the program is in use.
+	class program {
+	public:
+		struct uniform_handle {
+			int index = -1; // -1 if the uniform isn't active
+		};
+
+	private:
+		struct uniform_slot {
+			GLint location = -1;
+			GLenum type = 0;
+			GLint size = 0;
+			bool uploaded = false;
+			unsigned char value[sizeof(glm::mat4)];
+		};
+
+		struct state {
+			GLuint id = 0;
+			std::vector<uniform_slot> slots;
+			std::unordered_map<std::string, int> names;
+		};
+
+		std::shared_ptr<state> m_state;
+
+		// records the value and returns true if it needs uploading
+		template <typename T>
+		bool update(uniform_handle u, const T &value) {
+			uniform_stats::frame().sets++;
+			if (!m_state || u.index < 0) return false;
+			uniform_slot &slot = m_state->slots[u.index];
+			if (slot.uploaded && std::memcmp(slot.value, &value, sizeof(T)) == 0) return false;
+			std::memcpy(slot.value, &value, sizeof(T));
+			slot.uploaded = true;
+			uniform_stats::frame().uploads++;
+			return true;
+		}
+
+		GLint location(uniform_handle u) const { return m_state->slots[u.index].location; }
+
+	public:
+		program() { }
+		explicit program(GLuint id); // takes a linked program and reflects its uniforms
+
+		GLuint id() const { return m_state ? m_state->id : 0; }
+		operator GLuint() const { return id(); }
+
+		void use() const { glUseProgram(id()); }
+
+		// handle for the named uniform, arrays can be named with or without [0]
+		uniform_handle uniform(const std::string &name) const;
+
+		void set(uniform_handle u, float v) { if (update(u, v)) glUniform1f(location(u), v); }
+		void set(uniform_handle u, int v) { if (update(u, v)) glUniform1i(location(u), v); }
+		void set(uniform_handle u, bool v) { set(u, int(v)); }
+		void set(uniform_handle u, const glm::vec2 &v) { if (update(u, v)) glUniform2fv(location(u), 1, &v[0]); }
+		void set(uniform_handle u, const glm::vec3 &v) { if (update(u, v)) glUniform3fv(location(u), 1, &v[0]); }
+		void set(uniform_handle u, const glm::vec4 &v) { if (update(u, v)) glUniform4fv(location(u), 1, &v[0]); }
+		void set(uniform_handle u, const glm::mat3 &v) { if (update(u, v)) glUniformMatrix3fv(location(u), 1, false, &v[0][0]); }
+		void set(uniform_handle u, const glm::mat4 &v) { if (update(u, v)) glUniformMatrix4fv(location(u), 1, false, &v[0][0]); }
+
+		// Arrays are too big for the value cache, so they are uploaded every
+		// call, at most as many elements as the uniform has.
+		void set(uniform_handle u, const glm::vec4 *v, int count) {
+			uniform_stats::frame().sets++;
+			if (!m_state || u.index < 0 || count <= 0) return;
+			uniform_slot &slot = m_state->slots[u.index];
+			slot.uploaded = false;
+			uniform_stats::frame().uploads++;
+			glUniform4fv(slot.location, std::min<int>(count, slot.size), &v[0][0]);
+		}
+	};
+
+
+	// Collects shader sources and links them into a program. In build() each
+	// source gets its stage's define (_VERTEX_ etc.) and the builder's
+	// defines after #version, and every #include "file" line replaced by the
+	// file, relative to the including file (each file is included once).
+	// Sources are only compiled in build(), and not at all if the linked
+	// program is in the binary cache: a directory of program binaries (glGetProgramBinary)
+	// keyed by a hash of the final sources, the transform feedback varyings
+	// and the driver's vendor, renderer and version strings. A binary the
+	// driver rejects is deleted and the program is built from source.
 	class shader_builder {
+	public:
+		struct binary_cache_stats {
+			int hits = 0;
+			int misses = 0; // built from source and stored
+			int rejected = 0; // stale binaries the driver refused
+		};
+
 	private:
+		struct stage {
+			std::string source; // as given
+			std::string name; // file, for errors
+			std::string include_directory;
+		};
+
+		std::map<GLenum, stage> m_stages;
+		std::vector<std::string> m_defines;
 		std::map<GLenum, std::shared_ptr<gl_object>> m_shaders;
+		std::vector<std::string> m_varyings;
+		GLenum m_varyings_mode = GL_INTERLEAVED_ATTRIBS;
+
+		// the final source, files gets the file behind each #line source number
+		std::string assemble(GLenum type, const stage &s, std::vector<std::string> &files) const;
+		static void expand_includes(std::istream &in, const std::string &directory, int first_line,
+			std::vector<std::string> &files, std::ostream &out);
+		std::string binary_key(const std::map<GLenum, std::string> &sources) const;
 
 	public:
 		shader_builder() { }
 		void set_shader(GLenum type, const std::string &filename);
-		void set_shader_source(GLenum type, const std::string &shadersource);
+		// includes in a source without a file are relative to include_directory
+		void set_shader_source(GLenum type, const std::string &shadersource, const std::string &include_directory = "");
+
+		// "#define name value" in every stage
+		void define(const std::string &name, const std::string &value = "");
+
+		// outputs to capture with transform feedback, set before linking
+		void set_transform_feedback_varyings(const std::vector<std::string> &varyings, GLenum mode = GL_INTERLEAVED_ATTRIBS);
+
+		// Throws shader_compile_error or shader_link_error.
+		program build(GLuint id = 0);
 
-		GLuint build(GLuint program = 0);
+		// Directory for the binary cache, created when first written. Empty
+		// turns the cache off. Defaults to "shader_cache" in the working
+		// directory. The cache is also off if the driver has no binary
+		// formats (needs GL 4.1 or ARB_get_program_binary).
+		static void set_binary_cache(const std::string &directory);
+		static const std::string & binary_cache();
+		static const binary_cache_stats & binary_stats();
 	};
 
 }
\ No newline at end of file
@@ -39,8 +39,8 @@ int main() {
 		abort(); // unrecoverable error
 	}
 
-	// force OpenGL to create a 3.3 core context
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	// ask for a 4.3 core context (compute shaders) first, falling back to 3.3
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -57,6 +57,11 @@ int main() {
 
 	// create a windowed mode window and its OpenGL context
 	GLFWwindow *window = glfwCreateWindow(800, 600, "Hello World!", nullptr, nullptr);
+	if (!window) {
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(800, 600, "Hello World!", nullptr, nullptr);
+	}
 	if (!window) {
 		cerr << "Error: Could not create GLFW window" << endl;
 		abort(); // unrecoverable error
@@ -131,6 +136,9 @@ int main() {
 		glfwPollEvents();
 	}
 
+	// release GL resources while the context exists
+	application.destroy();
+
 	// clean up ImGui
 	cgra::gui::shutdown();
 	glfwTerminate();